@@ -0,0 +1,952 @@
+// Copyright 2018 The Beam Team
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <chrono>
+#include <ctime>
+#include <stdio.h>
+#include "../node_db.h"
+#include "../../core/ecc_native.h"
+#include "../../core/block_crypt.h"
+#include "../../core/aes.h"
+#include "../../core/sha256.h"
+#include "../../core/radixtree.h"
+#include "../../utility/serialize.h"
+#include "../../core/serialization_adapters.h"
+#include "version.h"
+
+#if defined(__GLIBC__) && ((__GLIBC__ > 2) || (__GLIBC_MINOR__ >= 33))
+#	include <malloc.h>
+#	define BENCH_HAVE_MALLINFO2
+#endif
+
+// Microbenchmarks for the core crypto and consensus primitives.
+// Usage: beam_bench [--filter <substr>] [--time <seconds per benchmark>] [--json <path, or - for stdout>]
+// The input data is pseudo-random with a fixed seed, so that the runs are repeatable.
+
+namespace beam {
+
+using namespace ECC;
+
+size_t get_HeapUsed()
+{
+#ifdef BENCH_HAVE_MALLINFO2
+	return mallinfo2().uordblks;
+#else
+	return 0; // not supported
+#endif
+}
+
+void GenerateRandom(void* p, uint32_t n)
+{
+	for (uint32_t i = 0; i < n; i++)
+		((uint8_t*) p)[i] = (uint8_t) rand();
+}
+
+void SetRandom(uintBig& x)
+{
+	GenerateRandom(x.m_pData, x.nBytes);
+}
+
+void SetRandom(Scalar::Native& x)
+{
+	Scalar s;
+	while (true)
+	{
+		SetRandom(s.m_Value);
+		if (!x.Import(s))
+			break;
+	}
+}
+
+void SetRandom(Point::Native& x)
+{
+	Point p;
+	p.m_Y = false;
+
+	SetRandom(p.m_X);
+	while (!x.Import(p))
+		p.m_X.Inc();
+}
+
+struct Bench
+{
+	struct Result
+	{
+		std::string m_sName;
+		double m_us; // per operation
+		uint64_t m_Iterations;
+		const char* m_szUnit = NULL; // if set - this is not a timing, m_us is the value in those units
+	};
+
+	std::vector<Result> m_vResults;
+	std::string m_sFilter;
+	double m_Duration_s = 1.;
+	FILE* m_pLog = stdout; // human-readable output
+
+	void Report(Result&& res)
+	{
+		fprintf(m_pLog, "%-32s: %.2f %s\n", res.m_sName.c_str(), res.m_us, res.m_szUnit ? res.m_szUnit : "us");
+		m_vResults.push_back(std::move(res));
+	}
+
+	void ReportValue(const char* sz, double val, const char* szUnit)
+	{
+		Report(Result{ sz, val, 0, szUnit });
+	}
+
+	class Meter
+	{
+		Bench& m_Bench;
+		const char* m_sz;
+		std::chrono::steady_clock::time_point m_Start;
+		uint64_t m_Iterations;
+
+	public:
+		uint32_t N;
+
+		Meter(Bench& b, const char* sz)
+			:m_Bench(b)
+			,m_sz(sz)
+			,m_Iterations(0)
+			,N(1000)
+		{
+			m_Start = std::chrono::steady_clock::now();
+		}
+
+		bool ShouldContinue()
+		{
+			m_Iterations += N;
+
+			double dt_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_Start).count();
+			if (dt_s >= m_Bench.m_Duration_s)
+			{
+				Result res;
+				res.m_sName = m_sz;
+				res.m_us = dt_s * 1e6 / double(m_Iterations);
+				res.m_Iterations = m_Iterations;
+
+				m_Bench.Report(std::move(res));
+				return false;
+			}
+
+			if (dt_s < m_Bench.m_Duration_s * 0.5)
+				N <<= 1;
+
+			return true;
+		}
+	};
+
+	bool IsEnabled(const char* sz) const
+	{
+		return m_sFilter.empty() || strstr(sz, m_sFilter.c_str());
+	}
+
+	void RunAll();
+	void WriteJson(FILE*) const;
+
+	void RunPoint();
+	void RunMultiMac();
+	void RunSignature();
+	void RunBulletProof();
+	void RunHash();
+	void RunAES();
+	void RunUtxoTree();
+	void RunMmr();
+	void RunBlockBody();
+	void RunNodeDB();
+
+	static void CreateBody(Block::Body&, uint32_t nOutputs, uint32_t nInputs, uint32_t nKernels);
+};
+
+void Bench::RunAll()
+{
+	typedef void (Bench::*Func)();
+
+	static const struct {
+		const char* m_sz;
+		Func m_pFn;
+	} s_pGroups[] = {
+		{ "point", &Bench::RunPoint },
+		{ "MultiMac", &Bench::RunMultiMac },
+		{ "signature", &Bench::RunSignature },
+		{ "BulletProof", &Bench::RunBulletProof },
+		{ "Hash", &Bench::RunHash },
+		{ "AES", &Bench::RunAES },
+		{ "UtxoTree", &Bench::RunUtxoTree },
+		{ "Mmr", &Bench::RunMmr },
+		{ "Block.Body", &Bench::RunBlockBody },
+		{ "NodeDB", &Bench::RunNodeDB },
+	};
+
+	for (size_t i = 0; i < _countof(s_pGroups); i++)
+	{
+		// the filter is matched against either the group or the benchmark name
+		if (m_sFilter.empty() || strstr(s_pGroups[i].m_sz, m_sFilter.c_str()))
+		{
+			std::string sFilter;
+			sFilter.swap(m_sFilter);
+			(this->*s_pGroups[i].m_pFn)();
+			m_sFilter.swap(sFilter);
+		}
+		else
+			(this->*s_pGroups[i].m_pFn)();
+	}
+}
+
+void Bench::RunPoint()
+{
+	Scalar::Native k;
+	Point::Native p0, p1;
+	SetRandom(p0);
+	SetRandom(p1);
+
+	if (IsEnabled("point.Multiply"))
+	{
+		Mode::Scope scope(Mode::Fast);
+
+		Meter bm(*this, "point.Multiply");
+		do
+		{
+			SetRandom(k);
+			for (uint32_t i = 0; i < bm.N; i++)
+				p0 += p1 * k;
+
+		} while (bm.ShouldContinue());
+	}
+
+	if (IsEnabled("point.Multiply.Sec"))
+	{
+		Mode::Scope scope(Mode::Secure);
+
+		Meter bm(*this, "point.Multiply.Sec");
+		do
+		{
+			SetRandom(k);
+			for (uint32_t i = 0; i < bm.N; i++)
+				p0 += p1 * k;
+
+		} while (bm.ShouldContinue());
+	}
+
+	if (IsEnabled("point.G.Multiply"))
+	{
+		SetRandom(k);
+
+		Meter bm(*this, "point.G.Multiply");
+		do
+		{
+			for (uint32_t i = 0; i < bm.N; i++)
+				p0 += Context::get().G * k;
+
+		} while (bm.ShouldContinue());
+	}
+}
+
+void Bench::RunMultiMac()
+{
+	if (!IsEnabled("MultiMac.Calculate.x128"))
+		return;
+
+	const uint32_t nCasual = 128;
+
+	typedef MultiMac_WithBufs<nCasual, 1> MyMultiMac;
+	std::unique_ptr<MyMultiMac> pMm(new MyMultiMac);
+	MyMultiMac& mm = *pMm;
+
+	std::vector<Point::Native> vPts(nCasual);
+	std::vector<Scalar::Native> vK(nCasual);
+
+	for (uint32_t i = 0; i < nCasual; i++)
+	{
+		SetRandom(vPts[i]);
+		SetRandom(vK[i]);
+	}
+
+	Scalar::Native kPrep;
+	SetRandom(kPrep);
+
+	Mode::Scope scope(Mode::Fast);
+	Point::Native res;
+
+	Meter bm(*this, "MultiMac.Calculate.x128");
+	bm.N = 10;
+	do
+	{
+		for (uint32_t i = 0; i < bm.N; i++)
+		{
+			mm.Reset();
+
+			for (uint32_t j = 0; j < nCasual; j++)
+				mm.m_Bufs.m_pCasual[mm.m_Casual++].Init(vPts[j], vK[j]);
+
+			mm.m_Bufs.m_ppPrepared[0] = &Context::get().m_Ipp.G_;
+			mm.m_Bufs.m_pKPrep[0] = kPrep;
+			mm.m_Prepared = 1;
+
+			mm.Calculate(res);
+		}
+
+	} while (bm.ShouldContinue());
+}
+
+void Bench::RunSignature()
+{
+	Scalar::Native sk;
+	SetRandom(sk);
+
+	Hash::Value hv;
+	SetRandom(hv);
+
+	Signature sig;
+	sig.Sign(hv, sk);
+
+	Point::Native pk = Context::get().G * sk;
+
+	if (IsEnabled("signature.Sign"))
+	{
+		Meter bm(*this, "signature.Sign");
+		do
+		{
+			for (uint32_t i = 0; i < bm.N; i++)
+				sig.Sign(hv, sk);
+
+		} while (bm.ShouldContinue());
+	}
+
+	if (IsEnabled("signature.IsValid"))
+	{
+		Meter bm(*this, "signature.IsValid");
+		do
+		{
+			for (uint32_t i = 0; i < bm.N; i++)
+				sig.IsValid(hv, pk);
+
+		} while (bm.ShouldContinue());
+	}
+}
+
+void Bench::RunBulletProof()
+{
+	Scalar::Native sk;
+	SetRandom(sk);
+	Amount v = 23110;
+
+	RangeProof::Confidential bp;
+	{
+		Oracle oracle;
+		bp.Create(sk, v, oracle);
+	}
+
+	Point::Native comm = Commitment(sk, v);
+
+	if (IsEnabled("BulletProof.Create"))
+	{
+		Meter bm(*this, "BulletProof.Create");
+		bm.N = 10;
+		do
+		{
+			for (uint32_t i = 0; i < bm.N; i++)
+			{
+				Oracle oracle;
+				bp.Create(sk, v, oracle);
+			}
+
+		} while (bm.ShouldContinue());
+	}
+
+	if (IsEnabled("BulletProof.IsValid"))
+	{
+		Meter bm(*this, "BulletProof.IsValid");
+		bm.N = 10;
+		do
+		{
+			for (uint32_t i = 0; i < bm.N; i++)
+			{
+				Oracle oracle;
+				bp.IsValid(comm, oracle);
+			}
+
+		} while (bm.ShouldContinue());
+	}
+
+	if (IsEnabled("BulletProof.IsValid.Batch.x100"))
+	{
+		typedef InnerProduct::BatchContextEx<100> MyBatch;
+		std::unique_ptr<MyBatch> p(new MyBatch);
+		p->m_bEnableBatch = true;
+
+		InnerProduct::BatchContext::Scope scope(*p);
+
+		Meter bm(*this, "BulletProof.IsValid.Batch.x100");
+		bm.N = 1;
+		do
+		{
+			for (uint32_t i = 0; i < bm.N; i++)
+			{
+				for (int n = 0; n < 100; n++)
+				{
+					Oracle oracle;
+					bp.IsValid(comm, oracle);
+				}
+
+				p->Flush();
+			}
+
+		} while (bm.ShouldContinue());
+	}
+}
+
+void Bench::RunHash()
+{
+	uint8_t pBuf[0x400];
+	GenerateRandom(pBuf, sizeof(pBuf));
+
+	Hash::Value hv;
+
+	if (IsEnabled("Hash.Processor.1K"))
+	{
+		Meter bm(*this, "Hash.Processor.1K");
+		do
+		{
+			for (uint32_t i = 0; i < bm.N; i++)
+			{
+				Hash::Processor hp;
+				hp.Write(pBuf, sizeof(pBuf));
+				hp >> hv;
+			}
+
+		} while (bm.ShouldContinue());
+	}
+
+	if (IsEnabled("Hash.Multi.64B-x1K"))
+	{
+		const uint32_t nCount = 0x400;
+		std::vector<uint8_t> vBuf(nCount * 64);
+		std::vector<Hash::Value> vRes(nCount);
+
+		Meter bm(*this, "Hash.Multi.64B-x1K");
+		bm.N = 10;
+		do
+		{
+			for (uint32_t i = 0; i < bm.N; i++)
+				Hash::Processor::Multi(&vRes.front(), &vBuf.front(), 64, nCount);
+
+		} while (bm.ShouldContinue());
+	}
+}
+
+void Bench::RunAES()
+{
+	if (!IsEnabled("AES.XCrypt-1MB"))
+		return;
+
+	Hash::Value hv;
+	SetRandom(hv);
+
+	AES::Encoder enc;
+	enc.Init(hv.m_pData);
+	AES::StreamCipher asc;
+	asc.Reset();
+
+	uint8_t pBuf[0x400];
+	GenerateRandom(pBuf, sizeof(pBuf));
+
+	Meter bm(*this, "AES.XCrypt-1MB");
+	bm.N = 1;
+	do
+	{
+		for (uint32_t i = 0; i < bm.N; i++)
+		{
+			for (size_t nSize = 0; nSize < 0x100000; nSize += sizeof(pBuf))
+				asc.XCrypt(enc, pBuf, sizeof(pBuf));
+		}
+
+	} while (bm.ShouldContinue());
+}
+
+void Bench::RunUtxoTree()
+{
+	// Each op is a batch: a block-like set of modifications
+	const uint32_t nElements = 100000;
+	const uint32_t nBatch = 100;
+
+	std::vector<UtxoTree::Key> vKeys(nElements + nBatch);
+	for (size_t i = 0; i < vKeys.size(); i++)
+		GenerateRandom(vKeys[i].m_pArr, sizeof(vKeys[i].m_pArr));
+
+	UtxoTree t;
+	UtxoTree::Cursor cu;
+	Merkle::Hash hv;
+
+	for (uint32_t i = 0; i < nElements; i++)
+	{
+		bool bCreate = true;
+		t.Find(cu, vKeys[i], bCreate)->m_Value.m_Count = 1;
+	}
+
+	t.get_Hash(hv);
+
+	if (IsEnabled("UtxoTree.Find.x100"))
+	{
+		// lookups of the existing elements, as for the block inputs
+		Meter bm(*this, "UtxoTree.Find.x100");
+		uint32_t iPos = 0;
+		do
+		{
+			for (uint32_t i = 0; i < bm.N; i++)
+				for (uint32_t j = 0; j < nBatch; j++)
+				{
+					bool bCreate = false;
+					t.Find(cu, vKeys[iPos], bCreate);
+
+					if (++iPos == nElements)
+						iPos = 0;
+				}
+
+		} while (bm.ShouldContinue());
+	}
+
+	bool bInsert = IsEnabled("UtxoTree.Insert.x100");
+	bool bDelete = IsEnabled("UtxoTree.Delete.x100");
+	bool bHash = IsEnabled("UtxoTree.get_Hash.x100");
+
+	if (bInsert || bDelete)
+	{
+		// alternate the insertions and deletions of the same elements, so that the tree size remains stable
+		std::chrono::steady_clock::duration dtIns(0), dtDel(0);
+		uint64_t nIterations = 0;
+
+		for (auto tStart = std::chrono::steady_clock::now(); std::chrono::duration<double>(std::chrono::steady_clock::now() - tStart).count() < m_Duration_s; nIterations++)
+		{
+			auto t0 = std::chrono::steady_clock::now();
+
+			for (uint32_t j = 0; j < nBatch; j++)
+			{
+				bool bCreate = true;
+				t.Find(cu, vKeys[nElements + j], bCreate)->m_Value.m_Count = 1;
+			}
+
+			auto t1 = std::chrono::steady_clock::now();
+
+			for (uint32_t j = 0; j < nBatch; j++)
+			{
+				bool bCreate = false;
+				t.Find(cu, vKeys[nElements + j], bCreate);
+				t.Delete(cu);
+			}
+
+			auto t2 = std::chrono::steady_clock::now();
+
+			dtIns += t1 - t0;
+			dtDel += t2 - t1;
+		}
+
+		if (bInsert)
+			Report(Result{ "UtxoTree.Insert.x100", std::chrono::duration<double>(dtIns).count() * 1e6 / double(nIterations), nIterations });
+		if (bDelete)
+			Report(Result{ "UtxoTree.Delete.x100", std::chrono::duration<double>(dtDel).count() * 1e6 / double(nIterations), nIterations });
+	}
+
+	if (bHash)
+	{
+		// rehash after a batch of modifications. The modifications are not measured
+		std::chrono::steady_clock::duration dt(0);
+		uint64_t nIterations = 0;
+
+		for (auto tStart = std::chrono::steady_clock::now(); std::chrono::duration<double>(std::chrono::steady_clock::now() - tStart).count() < m_Duration_s; nIterations++)
+		{
+			for (uint32_t j = 0; j < nBatch; j++)
+			{
+				bool bCreate = true;
+				UtxoTree::MyLeaf* p = t.Find(cu, vKeys[(nIterations * nBatch + j) % nElements], bCreate);
+				p->m_Value.m_Count++;
+				cu.Invalidate();
+			}
+
+			auto t0 = std::chrono::steady_clock::now();
+			t.get_Hash(hv);
+			dt += std::chrono::steady_clock::now() - t0;
+		}
+
+		Report(Result{ "UtxoTree.get_Hash.x100", std::chrono::duration<double>(dt).count() * 1e6 / double(nIterations), nIterations });
+	}
+
+	if (IsEnabled("UtxoTree.Traverse"))
+	{
+		// the whole tree
+		struct Traveler :public UtxoTree::ITraveler {
+			Input::Count m_Sum = 0;
+			virtual bool OnLeaf(const RadixTree::Leaf& x) override {
+				m_Sum += ((const UtxoTree::MyLeaf&) x).m_Value.m_Count;
+				return true;
+			}
+		} trv;
+
+		Meter bm(*this, "UtxoTree.Traverse");
+		bm.N = 1;
+		do
+		{
+			for (uint32_t i = 0; i < bm.N; i++)
+				t.Traverse(trv);
+
+		} while (bm.ShouldContinue());
+	}
+
+	bool bClear = IsEnabled("UtxoTree.Clear");
+	bool bMem = IsEnabled("UtxoTree.BytesPerUtxo");
+
+	if (bClear || bMem)
+	{
+		t.Clear();
+
+		// build from scratch, then release
+		std::chrono::steady_clock::duration dt(0);
+		uint64_t nIterations = 0;
+		size_t nBytes = 0;
+
+		for (auto tStart = std::chrono::steady_clock::now(); std::chrono::duration<double>(std::chrono::steady_clock::now() - tStart).count() < m_Duration_s; nIterations++)
+		{
+			size_t nHeap0 = get_HeapUsed();
+
+			for (uint32_t i = 0; i < nElements; i++)
+			{
+				bool bCreate = true;
+				t.Find(cu, vKeys[i], bCreate)->m_Value.m_Count = 1;
+			}
+
+			nBytes = get_HeapUsed() - nHeap0;
+
+			auto t0 = std::chrono::steady_clock::now();
+			t.Clear();
+			dt += std::chrono::steady_clock::now() - t0;
+
+			if (!bClear)
+				break;
+		}
+
+		if (bClear)
+			Report(Result{ "UtxoTree.Clear", std::chrono::duration<double>(dt).count() * 1e6 / double(nIterations), nIterations });
+		if (bMem && nBytes)
+			ReportValue("UtxoTree.BytesPerUtxo", double(nBytes) / double(nElements), "bytes");
+	}
+}
+
+struct MyMmr
+	:public Merkle::Mmr
+{
+	typedef std::vector<Merkle::Hash> HashVector;
+	std::vector<HashVector> m_vec;
+
+	Merkle::Hash& get_At(const Merkle::Position& pos)
+	{
+		if (m_vec.size() <= pos.H)
+			m_vec.resize(pos.H + 1);
+
+		HashVector& vec = m_vec[pos.H];
+		if (vec.size() <= size_t(pos.X))
+			vec.resize(size_t(pos.X) + 1);
+
+		return vec[size_t(pos.X)];
+	}
+
+	virtual void LoadElement(Merkle::Hash& hv, const Merkle::Position& pos) const override
+	{
+		hv = ((MyMmr*) this)->get_At(pos);
+	}
+
+	virtual void SaveElement(const Merkle::Hash& hv, const Merkle::Position& pos) override
+	{
+		get_At(pos) = hv;
+	}
+};
+
+void Bench::RunMmr()
+{
+	const uint32_t nCount = 1000000;
+
+	MyMmr mmr;
+	Merkle::Hash hv;
+
+	for (uint32_t i = 0; i < nCount; i++)
+	{
+		SetRandom(hv);
+		mmr.Append(hv);
+	}
+
+	if (IsEnabled("Mmr.Append"))
+	{
+		MyMmr mmr2;
+
+		Meter bm(*this, "Mmr.Append");
+		do
+		{
+			for (uint32_t i = 0; i < bm.N; i++)
+				mmr2.Append(hv);
+
+		} while (bm.ShouldContinue());
+	}
+
+	if (IsEnabled("Mmr.get_Proof"))
+	{
+		Merkle::Proof proof;
+		uint64_t iPos = 0;
+
+		Meter bm(*this, "Mmr.get_Proof");
+		do
+		{
+			for (uint32_t i = 0; i < bm.N; i++)
+			{
+				proof.clear();
+				mmr.get_Proof(proof, iPos);
+				iPos = (iPos + 7919) % nCount; // spread over the whole range
+			}
+
+		} while (bm.ShouldContinue());
+	}
+}
+
+void Bench::CreateBody(Block::Body& body, uint32_t nOutputs, uint32_t nInputs, uint32_t nKernels)
+{
+	body.ZeroInit();
+
+	std::vector<Output::CreateTask> vTasks(nOutputs);
+	for (uint32_t i = 0; i < nOutputs; i++)
+	{
+		Output::Ptr pOutp(new Output);
+
+		Output::CreateTask& t = vTasks[i];
+		t.m_pOutput = pOutp.get();
+		SetRandom(t.m_Key);
+		t.m_Value = 100 + i;
+
+		body.m_vOutputs.push_back(std::move(pOutp));
+	}
+
+	Output::CreateMulti(vTasks);
+
+	for (uint32_t i = 0; i < nInputs; i++)
+	{
+		Input::Ptr pInp(new Input);
+
+		Point::Native pt;
+		SetRandom(pt);
+		pInp->m_Commitment = pt;
+
+		body.m_vInputs.push_back(std::move(pInp));
+	}
+
+	for (uint32_t i = 0; i < nKernels; i++)
+	{
+		TxKernel::Ptr pKrn(new TxKernel);
+
+		Scalar::Native sk;
+		SetRandom(sk);
+		pKrn->m_Excess = Point::Native(Context::get().G * sk);
+		pKrn->m_Fee = i;
+
+		Hash::Value hv;
+		pKrn->get_Hash(hv);
+		pKrn->m_Signature.Sign(hv, sk);
+
+		body.m_vKernelsOutput.push_back(std::move(pKrn));
+	}
+
+	body.Sort();
+}
+
+void Bench::RunBlockBody()
+{
+	bool bSer = IsEnabled("Block.Body.Serialize");
+	bool bDeser = IsEnabled("Block.Body.Deserialize");
+	if (!bSer && !bDeser)
+		return;
+
+	Block::Body body;
+	CreateBody(body, 100, 100, 20);
+
+	Serializer ser;
+
+	if (bSer)
+	{
+		Meter bm(*this, "Block.Body.Serialize");
+		bm.N = 10;
+		do
+		{
+			for (uint32_t i = 0; i < bm.N; i++)
+			{
+				ser.reset();
+				ser & body;
+			}
+
+		} while (bm.ShouldContinue());
+	}
+
+	if (bDeser)
+	{
+		ser.reset();
+		ser & body;
+
+		SerializeBuffer sb = ser.buffer();
+
+		Meter bm(*this, "Block.Body.Deserialize");
+		bm.N = 10;
+		do
+		{
+			for (uint32_t i = 0; i < bm.N; i++)
+			{
+				Block::Body body2;
+
+				Deserializer der;
+				der.reset(sb.first, sb.second);
+				der & body2;
+			}
+
+		} while (bm.ShouldContinue());
+	}
+}
+
+void Bench::RunNodeDB()
+{
+	if (!IsEnabled("NodeDB.InsertBlock"))
+		return;
+
+	const char* szPath = "beam_bench.db";
+	remove(szPath);
+
+	Block::Body body;
+	CreateBody(body, 100, 100, 20);
+
+	Serializer ser;
+	ser & body;
+	SerializeBuffer sb = ser.buffer();
+	NodeDB::Blob blob(sb.first, (uint32_t) sb.second);
+
+	{
+		NodeDB db;
+		db.Open(szPath);
+
+		Block::SystemState::Full s;
+		ZeroObject(s);
+		s.m_Height = Rules::HeightGenesis;
+
+		// a chain of states, each with the block body. Single transaction per block, as in the node
+		Meter bm(*this, "NodeDB.InsertBlock");
+		bm.N = 10;
+		do
+		{
+			for (uint32_t i = 0; i < bm.N; i++)
+			{
+				NodeDB::Transaction t(db);
+
+				uint64_t rowid = db.InsertState(s);
+				db.SetStateBlock(rowid, blob);
+
+				t.Commit();
+
+				s.get_Hash(s.m_Prev);
+				s.m_Height++;
+				s.m_ChainWork.Inc();
+			}
+
+		} while (bm.ShouldContinue());
+	}
+
+	remove(szPath);
+}
+
+void Bench::WriteJson(FILE* pFile) const
+{
+	char szTime[0x40];
+	time_t t = time(NULL);
+	strftime(szTime, sizeof(szTime), "%Y-%m-%dT%H:%M:%SZ", gmtime(&t));
+
+	fprintf(pFile, "{\n");
+	fprintf(pFile, "\t\"version\": \"%s\",\n", PROJECT_VERSION.c_str());
+	fprintf(pFile, "\t\"commit\": \"%s\",\n", GIT_COMMIT_HASH.c_str());
+	fprintf(pFile, "\t\"time\": \"%s\",\n", szTime);
+	fprintf(pFile, "\t\"config\": {\n");
+	fprintf(pFile, "\t\t\"ecc_word_bits\": %u,\n", unsigned(sizeof(Scalar::Native::uint) << 3));
+	fprintf(pFile, "\t\t\"sha_ni\": %s,\n", Sha256::s_bUseShaNi ? "true" : "false");
+	fprintf(pFile, "\t\t\"avx2\": %s,\n", Sha256::s_bUseAvx2 ? "true" : "false");
+	fprintf(pFile, "\t\t\"aes_ni\": %s\n", AES::s_bUseHw ? "true" : "false");
+	fprintf(pFile, "\t},\n");
+	fprintf(pFile, "\t\"results\": [\n");
+
+	for (size_t i = 0; i < m_vResults.size(); i++)
+	{
+		const Result& res = m_vResults[i];
+		const char* szComma = (i + 1 < m_vResults.size()) ? "," : "";
+
+		if (res.m_szUnit)
+			fprintf(pFile, "\t\t{ \"name\": \"%s\", \"value\": %.3f, \"unit\": \"%s\" }%s\n",
+				res.m_sName.c_str(), res.m_us, res.m_szUnit, szComma);
+		else
+			fprintf(pFile, "\t\t{ \"name\": \"%s\", \"us\": %.3f, \"iterations\": %llu }%s\n",
+				res.m_sName.c_str(), res.m_us, (unsigned long long) res.m_Iterations, szComma);
+	}
+
+	fprintf(pFile, "\t]\n");
+	fprintf(pFile, "}\n");
+}
+
+} // namespace beam
+
+int main(int argc, char* argv[])
+{
+	beam::Bench b;
+	const char* szJson = NULL;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const char* szArg = argv[i];
+		const char* szVal = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+		if (!strcmp(szArg, "--filter") && szVal)
+			b.m_sFilter = argv[++i];
+		else if (!strcmp(szArg, "--time") && szVal)
+			b.m_Duration_s = atof(argv[++i]);
+		else if (!strcmp(szArg, "--json") && szVal)
+			szJson = argv[++i];
+		else
+		{
+			printf("Usage: %s [--filter <substr>] [--time <seconds per benchmark>] [--json <path, or - for stdout>]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (szJson && !strcmp(szJson, "-"))
+		b.m_pLog = stderr; // keep stdout clean
+
+	srand(0); // repeatable input data
+
+	b.RunAll();
+
+	if (szJson)
+	{
+		bool bStdOut = !strcmp(szJson, "-");
+		FILE* pFile = bStdOut ? stdout : fopen(szJson, "w");
+		if (!pFile)
+		{
+			printf("Can't open %s\n", szJson);
+			return 1;
+		}
+
+		b.WriteJson(pFile);
+
+		if (!bStdOut)
+			fclose(pFile);
+	}
+
+	return 0;
+}
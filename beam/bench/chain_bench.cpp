@@ -0,0 +1,621 @@
+// Copyright 2018 The Beam Team
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <chrono>
+#include <ctime>
+#include <map>
+#include <thread>
+#include <stdio.h>
+#include "../node.h"
+#include "../../core/ecc_native.h"
+#include "../../utility/serialize.h"
+#include "../../core/serialization_adapters.h"
+#include "version.h"
+
+#ifdef WIN32
+#	include <windows.h>
+#	include <psapi.h>
+#else
+#	include <sys/resource.h>
+#endif
+
+// End-to-end block validation throughput.
+// generate: builds a deterministic synthetic chain (FakePoW) and saves the blocks, plus the whole range exported as a macroblock.
+// replay: feeds the saved chain into a fresh node (OnState/OnBlock, then ImportMacroBlock), for each DB profile and number of verification threads.
+
+namespace beam {
+
+struct ChainBench
+{
+	// generation parameters
+	Height m_Blocks = 200;
+	uint32_t m_Txs = 10; // per block
+	uint32_t m_Inputs = 2; // per tx
+	uint32_t m_Outputs = 2; // per tx
+	std::string m_sSeed = "beam";
+
+	std::string m_sPath = "chain_bench"; // prefix for the chain and macroblock files
+	std::vector<uint32_t> m_vThreads;
+	std::vector<NodeDB::Profile::Enum> m_vProfiles;
+
+	struct Result
+	{
+		NodeDB::Profile::Enum m_Profile;
+		uint32_t m_Threads;
+		Height m_Blocks;
+		uint64_t m_Inputs;
+		double m_Blocks_s; // time to process the blocks
+		double m_Macroblock_s; // time to import the same range as a macroblock
+		NodeProcessor::PerfStats m_Stats;
+		uint64_t m_PeakRss_kb;
+	};
+
+	std::vector<Result> m_vResults;
+
+	struct BlockPlus
+	{
+		Block::SystemState::Full m_Hdr;
+		ByteBuffer m_Body;
+	};
+
+	bool Generate();
+	bool Replay();
+	void WriteJson(FILE*) const;
+
+	std::string get_ChainPath() const { return m_sPath + ".chain"; }
+	std::string get_MacroPath() const { return m_sPath + "-mb"; }
+	std::string get_DbPath() const { return m_sPath + ".db"; }
+
+	static bool Load(const std::string& sPath, std::vector<BlockPlus>&);
+	static uint64_t get_PeakRss_kb();
+	static double get_Seconds(const std::chrono::high_resolution_clock::time_point&);
+};
+
+double ChainBench::get_Seconds(const std::chrono::high_resolution_clock::time_point& t0)
+{
+	return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t0).count();
+}
+
+uint64_t ChainBench::get_PeakRss_kb()
+{
+#ifdef WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+		return 0;
+	return pmc.PeakWorkingSetSize >> 10;
+#else
+	struct rusage ru;
+	if (getrusage(RUSAGE_SELF, &ru))
+		return 0;
+#	ifdef __APPLE__
+	return ru.ru_maxrss >> 10; // in bytes
+#	else
+	return ru.ru_maxrss;
+#	endif
+#endif
+}
+
+/////////////////////////////
+// Generate
+struct MiniWallet
+{
+	ECC::Kdf m_Kdf;
+	uint32_t m_nIdx = 0; // key index within the current height
+
+	struct Utxo
+	{
+		ECC::Scalar m_Key;
+		Amount m_Value;
+	};
+
+	typedef std::multimap<Height, Utxo> UtxoQueue; // by the height they're spendable at
+	UtxoQueue m_Utxos;
+
+	void Add(const ECC::Scalar::Native& k, Amount v, Height hSpendable)
+	{
+		if (!v)
+			return;
+
+		Utxo utxo;
+		utxo.m_Key = k;
+		utxo.m_Value = v;
+		m_Utxos.insert(std::make_pair(hSpendable, utxo));
+	}
+
+	bool MakeTx(Transaction::Ptr&, Height, uint32_t nInputs, uint32_t nOutputs, Amount& fee);
+};
+
+bool MiniWallet::MakeTx(Transaction::Ptr& pTx, Height h, uint32_t nInputs, uint32_t nOutputs, Amount& fee)
+{
+	uint32_t nAvail = 0;
+	for (UtxoQueue::iterator it = m_Utxos.begin(); (m_Utxos.end() != it) && (it->first <= h) && (nAvail < nInputs); it++)
+		nAvail++;
+
+	if (nAvail < nInputs)
+		return false;
+
+	pTx = std::make_shared<Transaction>();
+
+	ECC::Scalar::Native kOffset(Zero), k;
+	Amount val = 0;
+
+	for (uint32_t i = 0; i < nInputs; i++)
+	{
+		UtxoQueue::iterator it = m_Utxos.begin();
+		const Utxo& utxo = it->second;
+
+		Input::Ptr pInp(new Input);
+		pInp->m_Commitment = ECC::Commitment(utxo.m_Key, utxo.m_Value);
+		pTx->m_vInputs.push_back(std::move(pInp));
+
+		k = utxo.m_Key;
+		kOffset += k;
+		val += utxo.m_Value;
+
+		m_Utxos.erase(it);
+	}
+
+	if (val <= fee + nOutputs)
+		fee = val; // dust, just burn it
+	val -= fee;
+
+	std::vector<Output::CreateTask> vTasks;
+	if (val)
+	{
+		vTasks.resize(nOutputs);
+		for (uint32_t i = 0; i < nOutputs; i++)
+		{
+			Output::CreateTask& task = vTasks[i];
+			task.m_Value = (i + 1 < nOutputs) ? (val / nOutputs) : (val - (val / nOutputs) * (nOutputs - 1));
+
+			DeriveKey(task.m_Key, m_Kdf, h, KeyType::Regular, m_nIdx++);
+
+			pTx->m_vOutputs.push_back(Output::Ptr(new Output));
+			task.m_pOutput = pTx->m_vOutputs.back().get();
+
+			k = -task.m_Key;
+			kOffset += k;
+
+			Add(task.m_Key, task.m_Value, h + 1);
+		}
+
+		Output::CreateMulti(vTasks);
+	}
+
+	TxKernel::Ptr pKrn(new TxKernel);
+	pKrn->m_Fee = fee;
+
+	DeriveKey(k, m_Kdf, h, KeyType::Kernel, m_nIdx++);
+	pKrn->m_Excess = ECC::Point::Native(ECC::Context::get().G * k);
+
+	ECC::Hash::Value hv;
+	pKrn->get_Hash(hv);
+	pKrn->m_Signature.Sign(hv, k);
+
+	pTx->m_vKernelsOutput.push_back(std::move(pKrn));
+
+	k = -k;
+	kOffset += k;
+	pTx->m_Offset = kOffset;
+
+	pTx->Sort();
+	return true;
+}
+
+bool ChainBench::Generate()
+{
+	std::string sDb = get_DbPath();
+	DeleteFile(sDb.c_str());
+
+	std::FStream fs;
+	if (!fs.Open(get_ChainPath().c_str(), false))
+	{
+		printf("Can't create %s\n", get_ChainPath().c_str());
+		return false;
+	}
+
+	NodeProcessor np;
+	ECC::Hash::Processor() << "chain_bench" << m_sSeed.c_str() >> np.m_Kdf.m_Secret.V; // same seed - same keys
+	np.Initialize(sDb.c_str());
+
+	MiniWallet wlt;
+	wlt.m_Kdf = np.m_Kdf;
+
+	NodeProcessor::TxPool txPool;
+
+	auto t0 = std::chrono::high_resolution_clock::now();
+
+	for (Height h = Rules::HeightGenesis; h < Rules::HeightGenesis + m_Blocks; h++)
+	{
+		wlt.m_nIdx = 0;
+		Amount feesExpected = 0;
+
+		for (uint32_t i = 0; i < m_Txs; i++)
+		{
+			Transaction::Ptr pTx;
+			Amount fee = 100;
+			if (!wlt.MakeTx(pTx, h, m_Inputs, m_Outputs, fee))
+				break; // not enough mature UTXOs yet
+
+			Transaction::Context ctx;
+			if (!np.ValidateTx(*pTx, ctx))
+			{
+				printf("Tx invalid at %llu\n", (unsigned long long) h);
+				return false;
+			}
+
+			Transaction::KeyType key;
+			pTx->get_Key(key);
+			txPool.AddValidTx(std::move(pTx), ctx, key);
+			feesExpected += fee;
+		}
+
+		BlockPlus blk;
+		Amount fees = 0;
+		if (!np.GenerateNewBlock(txPool, blk.m_Hdr, blk.m_Body, fees))
+		{
+			printf("Block generation failed at %llu\n", (unsigned long long) h);
+			return false;
+		}
+
+		txPool.Clear();
+
+		if (fees != feesExpected)
+		{
+			// the wallet assumes all its txs are included
+			printf("Block %llu is full, reduce the number of txs per block\n", (unsigned long long) h);
+			return false;
+		}
+
+		// the timestamp is the only nondeterministic part, replace it. Keep the desired rate, so that the difficulty doesn't change
+		blk.m_Hdr.m_TimeStamp = 1500000000 + h * Rules::get().DesiredRate_s;
+
+		Block::SystemState::ID id;
+		blk.m_Hdr.get_ID(id);
+
+		if ((NodeProcessor::DataStatus::Accepted != np.OnState(blk.m_Hdr, PeerID())) ||
+			(NodeProcessor::DataStatus::Accepted != np.OnBlock(id, blk.m_Body, PeerID())) ||
+			(np.m_Cursor.m_ID.m_Height != h))
+		{
+			printf("Block rejected at %llu\n", (unsigned long long) h);
+			return false;
+		}
+
+		ECC::Scalar::Native kCoinbase, kFee, kKernel, kOffset(Zero);
+		NodeProcessor::DeriveKeys(np.m_Kdf, h, fees, kCoinbase, kFee, kKernel, kOffset);
+
+		wlt.Add(kCoinbase, Rules::get().CoinbaseEmission, h + Rules::get().MaturityCoinbase);
+		wlt.Add(kFee, fees, h + std::max<Height>(Rules::get().MaturityStd, 1));
+
+		Serializer ser;
+		ser & blk.m_Hdr;
+		ser & blk.m_Body;
+
+		SerializeBuffer sb = ser.buffer();
+		uint32_t nSize = (uint32_t) sb.second;
+		fs.write(&nSize, sizeof(nSize));
+		fs.write(sb.first, sb.second);
+	}
+
+	fs.Close();
+
+	printf("Generated %llu blocks in %.2f s\n", (unsigned long long) m_Blocks, get_Seconds(t0));
+
+	Block::BodyBase::RW rw;
+	rw.m_sPath = get_MacroPath();
+	rw.Open(false);
+	np.ExportMacroBlock(rw, HeightRange(Rules::HeightGenesis, np.m_Cursor.m_ID.m_Height));
+	rw.Close();
+
+	DeleteFile(sDb.c_str());
+	return true;
+}
+
+/////////////////////////////
+// Replay
+bool ChainBench::Load(const std::string& sPath, std::vector<BlockPlus>& v)
+{
+	std::FStream fs;
+	if (!fs.Open(sPath.c_str(), true))
+	{
+		printf("Can't open %s\n", sPath.c_str());
+		return false;
+	}
+
+	ByteBuffer bb;
+	while (fs.get_Remaining())
+	{
+		uint32_t nSize;
+		fs.read(&nSize, sizeof(nSize));
+
+		bb.resize(nSize);
+		if (nSize)
+			fs.read(&bb.at(0), nSize);
+
+		v.emplace_back();
+		BlockPlus& blk = v.back();
+
+		Deserializer der;
+		der.reset(bb.empty() ? NULL : &bb.at(0), bb.size());
+		der & blk.m_Hdr;
+		der & blk.m_Body;
+	}
+
+	return true;
+}
+
+// The node itself, without the network. The blocks are fed directly to its processor, and verified by the node's verifier (with its persistent worker threads)
+void InitNode(Node& node, const std::string& sDb, const ChainBench::Result& res)
+{
+	node.m_Cfg.m_sPathLocal = sDb;
+	node.m_Cfg.m_DbProfile = res.m_Profile;
+	node.m_Cfg.m_VerificationThreads = res.m_Threads;
+	node.m_Cfg.m_Sync.m_SrcPeers = 0; // no fast sync
+	node.Initialize();
+}
+
+bool ChainBench::Replay()
+{
+	std::vector<BlockPlus> vBlocks;
+	if (!Load(get_ChainPath(), vBlocks))
+		return false;
+
+	uint64_t nInputs = 0;
+	for (size_t i = 0; i < vBlocks.size(); i++)
+	{
+		Block::Body body;
+		Deserializer der;
+		der.reset(vBlocks[i].m_Body.empty() ? NULL : &vBlocks[i].m_Body.at(0), vBlocks[i].m_Body.size());
+		der & body;
+		nInputs += body.m_vInputs.size();
+	}
+
+	printf("Loaded %u blocks, %llu inputs\n", (unsigned int) vBlocks.size(), (unsigned long long) nInputs);
+	printf("%-8s %-8s %10s %12s %10s %10s %10s %10s %12s %12s\n", "profile", "threads", "blocks/s", "inputs/s", "deser, s", "verify, s", "apply, s", "commit, s", "macroblk, s", "peak RSS, KB");
+
+	std::string sDb = get_DbPath();
+
+	for (size_t iRun = 0; iRun < m_vProfiles.size() * m_vThreads.size(); iRun++)
+	{
+		Result res;
+		res.m_Profile = m_vProfiles[iRun / m_vThreads.size()];
+		res.m_Threads = m_vThreads[iRun % m_vThreads.size()];
+		res.m_Blocks = vBlocks.size();
+		res.m_Inputs = nInputs;
+
+		{
+			DeleteFile(sDb.c_str());
+
+			io::Reactor::Ptr pReactor(io::Reactor::create());
+			io::Reactor::Scope scope(*pReactor); // needed by the node, though never run
+
+			Node node;
+			InitNode(node, sDb, res);
+
+			NodeProcessor& np = node.get_Processor();
+			np.m_pPerfStats = &res.m_Stats;
+
+			auto t0 = std::chrono::high_resolution_clock::now();
+
+			for (size_t i = 0; i < vBlocks.size(); i++)
+			{
+				const BlockPlus& blk = vBlocks[i];
+
+				Block::SystemState::ID id;
+				blk.m_Hdr.get_ID(id);
+
+				np.OnState(blk.m_Hdr, PeerID());
+				np.OnBlock(id, blk.m_Body, PeerID());
+
+				if (np.m_Cursor.m_ID.m_Height != blk.m_Hdr.m_Height)
+				{
+					printf("Block %llu rejected\n", (unsigned long long) blk.m_Hdr.m_Height);
+					return false;
+				}
+			}
+
+			res.m_Blocks_s = get_Seconds(t0);
+		}
+
+		{
+			DeleteFile(sDb.c_str());
+
+			io::Reactor::Ptr pReactor(io::Reactor::create());
+			io::Reactor::Scope scope(*pReactor);
+
+			Node node;
+			InitNode(node, sDb, res);
+
+			NodeProcessor& np = node.get_Processor();
+
+			Block::BodyBase::RW rw;
+			rw.m_sPath = get_MacroPath();
+			rw.Open(true);
+
+			auto t0 = std::chrono::high_resolution_clock::now();
+
+			if (!np.ImportMacroBlock(rw))
+			{
+				printf("Macroblock rejected\n");
+				return false;
+			}
+
+			res.m_Macroblock_s = get_Seconds(t0);
+		}
+
+		DeleteFile(sDb.c_str());
+
+		res.m_PeakRss_kb = get_PeakRss_kb(); // process-wide, i.e. the maximum of this and all the previous runs
+
+		printf("%-8s %-8u %10.1f %12.1f %10.3f %10.3f %10.3f %10.3f %12.3f %12llu\n",
+			NodeDB::Profile::get_Name(res.m_Profile),
+			res.m_Threads,
+			res.m_Blocks / res.m_Blocks_s,
+			res.m_Inputs / res.m_Blocks_s,
+			res.m_Stats.m_Deserialize_us * 1e-6,
+			res.m_Stats.m_Verify_us * 1e-6,
+			res.m_Stats.m_Apply_us * 1e-6,
+			res.m_Stats.m_Commit_us * 1e-6,
+			res.m_Macroblock_s,
+			(unsigned long long) res.m_PeakRss_kb);
+
+		m_vResults.push_back(res);
+	}
+
+	return true;
+}
+
+void ChainBench::WriteJson(FILE* pFile) const
+{
+	char szTime[0x40];
+	time_t t = time(NULL);
+	strftime(szTime, sizeof(szTime), "%Y-%m-%dT%H:%M:%SZ", gmtime(&t));
+
+	fprintf(pFile, "{\n");
+	fprintf(pFile, "\t\"version\": \"%s\",\n", PROJECT_VERSION.c_str());
+	fprintf(pFile, "\t\"commit\": \"%s\",\n", GIT_COMMIT_HASH.c_str());
+	fprintf(pFile, "\t\"time\": \"%s\",\n", szTime);
+	fprintf(pFile, "\t\"hardware_threads\": %u,\n", std::thread::hardware_concurrency());
+	fprintf(pFile, "\t\"results\": [\n");
+
+	for (size_t i = 0; i < m_vResults.size(); i++)
+	{
+		const Result& res = m_vResults[i];
+		fprintf(pFile, "\t\t{ \"profile\": \"%s\", \"threads\": %u, \"blocks\": %llu, \"inputs\": %llu, \"blocks_per_s\": %.3f, \"inputs_per_s\": %.3f, "
+			"\"deserialize_us\": %llu, \"verify_us\": %llu, \"apply_us\": %llu, \"commit_us\": %llu, \"macroblock_s\": %.3f, \"peak_rss_kb\": %llu }%s\n",
+			NodeDB::Profile::get_Name(res.m_Profile),
+			res.m_Threads,
+			(unsigned long long) res.m_Blocks,
+			(unsigned long long) res.m_Inputs,
+			res.m_Blocks / res.m_Blocks_s,
+			res.m_Inputs / res.m_Blocks_s,
+			(unsigned long long) res.m_Stats.m_Deserialize_us,
+			(unsigned long long) res.m_Stats.m_Verify_us,
+			(unsigned long long) res.m_Stats.m_Apply_us,
+			(unsigned long long) res.m_Stats.m_Commit_us,
+			res.m_Macroblock_s,
+			(unsigned long long) res.m_PeakRss_kb,
+			(i + 1 < m_vResults.size()) ? "," : "");
+	}
+
+	fprintf(pFile, "\t]\n");
+	fprintf(pFile, "}\n");
+}
+
+} // namespace beam
+
+int main(int argc, char* argv[])
+{
+	beam::ChainBench b;
+	const char* szJson = NULL;
+
+	bool bGenerate = false, bReplay = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const char* szArg = argv[i];
+		const char* szVal = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+		if (!strcmp(szArg, "generate"))
+			bGenerate = true;
+		else if (!strcmp(szArg, "replay"))
+			bReplay = true;
+		else if (!strcmp(szArg, "--blocks") && szVal)
+			b.m_Blocks = atoi(argv[++i]);
+		else if (!strcmp(szArg, "--txs") && szVal)
+			b.m_Txs = atoi(argv[++i]);
+		else if (!strcmp(szArg, "--inputs") && szVal)
+			b.m_Inputs = std::max(atoi(argv[++i]), 1);
+		else if (!strcmp(szArg, "--outputs") && szVal)
+			b.m_Outputs = std::max(atoi(argv[++i]), 1);
+		else if (!strcmp(szArg, "--seed") && szVal)
+			b.m_sSeed = argv[++i];
+		else if (!strcmp(szArg, "--path") && szVal)
+			b.m_sPath = argv[++i];
+		else if (!strcmp(szArg, "--threads") && szVal)
+		{
+			// comma-separated list
+			for (const char* sz = argv[++i]; *sz; )
+			{
+				b.m_vThreads.push_back(atoi(sz));
+				const char* szNext = strchr(sz, ',');
+				sz = szNext ? (szNext + 1) : (sz + strlen(sz));
+			}
+		}
+		else if (!strcmp(szArg, "--profiles") && szVal)
+		{
+			// comma-separated list
+			std::string s = argv[++i];
+			for (size_t nPos = 0; nPos <= s.size(); )
+			{
+				size_t nNext = s.find(',', nPos);
+				if (std::string::npos == nNext)
+					nNext = s.size();
+
+				beam::NodeDB::Profile::Enum e;
+				if (!beam::NodeDB::Profile::FromName(e, s.substr(nPos, nNext - nPos).c_str()))
+				{
+					printf("Unknown profile in %s\n", s.c_str());
+					return 1;
+				}
+
+				b.m_vProfiles.push_back(e);
+				nPos = nNext + 1;
+			}
+		}
+		else if (!strcmp(szArg, "--json") && szVal)
+			szJson = argv[++i];
+		else
+		{
+			printf("Usage: %s [generate] [replay] [--blocks <n>] [--txs <per block>] [--inputs <per tx>] [--outputs <per tx>] [--seed <str>] [--path <file prefix>] [--threads <n,n,...>] [--profiles <default|safe|sync,...>] [--json <path>]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (!bGenerate && !bReplay)
+		bGenerate = bReplay = true;
+
+	if (b.m_vThreads.empty())
+		b.m_vThreads.push_back(0);
+
+	if (b.m_vProfiles.empty())
+		b.m_vProfiles.push_back(beam::NodeDB::Profile::Default);
+
+	beam::Rules::get().FakePoW = true;
+	beam::Rules::get().UpdateChecksum();
+
+	if (bGenerate && !b.Generate())
+		return 1;
+
+	if (bReplay)
+	{
+		if (!b.Replay())
+			return 1;
+
+		if (szJson)
+		{
+			FILE* pFile = fopen(szJson, "w");
+			if (!pFile)
+			{
+				printf("Can't open %s\n", szJson);
+				return 1;
+			}
+
+			b.WriteJson(pFile);
+			fclose(pFile);
+		}
+	}
+
+	return 0;
+}
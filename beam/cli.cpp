@@ -146,6 +146,18 @@ int main_impl(int argc, char* argv[])
 					node.m_Cfg.m_MiningThreads = vm[cli::MINING_THREADS].as<uint32_t>();
 					node.m_Cfg.m_MinerID = vm[cli::MINER_ID].as<uint32_t>();
 					node.m_Cfg.m_VerificationThreads = vm[cli::VERIFICATION_THREADS].as<int>();
+					node.m_Cfg.m_SnapshotPeriod = vm[cli::SNAPSHOT_PERIOD].as<Height>();
+
+					node.m_Cfg.m_GroupCommitBlocks = vm[cli::GROUP_COMMIT_BLOCKS].as<uint32_t>();
+					node.m_Cfg.m_GroupCommit_ms = vm[cli::GROUP_COMMIT_MS].as<uint32_t>();
+
+					string sDbProfile = vm[cli::DB_PROFILE].as<string>();
+					if (!NodeDB::Profile::FromName(node.m_Cfg.m_DbProfile, sDbProfile.c_str()))
+					{
+						LOG_ERROR() << "unknown db profile: " << sDbProfile;
+						return -1;
+					}
+
 					if (node.m_Cfg.m_MiningThreads > 0)
 					{
 						if (!beam::read_wallet_seed(node.m_Cfg.m_WalletKey, vm)) {
@@ -34,6 +34,7 @@ void Node::RefreshCongestions()
 	for (TaskSet::iterator it = m_setTasks.begin(); m_setTasks.end() != it; it++)
 		it->m_bRelevant = false;
 
+	m_hHdrMissing = 0;
 	m_Processor.EnumCongestions();
 
 	for (TaskList::iterator it = m_lstTasksUnassigned.begin(); m_lstTasksUnassigned.end() != it; )
@@ -42,6 +43,72 @@ void Node::RefreshCongestions()
 		if (!t.m_bRelevant)
 			DeleteUnassignedTask(t);
 	}
+
+	// the tasks that were requested before may be assigned now, if peers have free slots
+	for (TaskList::iterator it = m_lstTasksUnassigned.begin(); m_lstTasksUnassigned.end() != it; )
+		TryAssignTask(*(it++), NULL);
+
+	RequestHdrRanges();
+}
+
+bool Node::IsHdrRangePending(Height h) const
+{
+	Task tKey;
+	tKey.m_Key.first.m_Height = h;
+	tKey.m_Key.first.m_Hash = Zero;
+	tKey.m_Key.second = false;
+
+	return m_setTasks.end() != m_setTasks.find(tKey);
+}
+
+void Node::RequestHdrRanges()
+{
+	const Height hCursor = m_Processor.m_Cursor.m_ID.m_Height;
+	const uint32_t nPackSize = m_Cfg.m_HdrDownload.m_PackSize;
+
+	if (!nPackSize || (m_hHdrMissing <= hCursor))
+		return;
+
+	// The range of the highest missing header is requested by its ID. Start from the one below
+	Height hTop = (m_hHdrMissing - 1) / nPackSize * nPackSize;
+
+	for (uint32_t nCandidates = m_Cfg.m_HdrDownload.m_MaxPacks * 2; nCandidates && (hTop > hCursor); nCandidates--, hTop -= nPackSize)
+	{
+		if (m_nTasksPackHdr >= m_Cfg.m_HdrDownload.m_MaxPacks)
+			break;
+
+		Task tKey;
+		tKey.m_Key.first.m_Height = hTop;
+		tKey.m_Key.first.m_Hash = Zero;
+		tKey.m_Key.second = false;
+
+		// skip if anything is already requested or known at this height
+		TaskSet::iterator it = m_setTasks.lower_bound(tKey);
+		if ((m_setTasks.end() != it) && (it->m_Key.first.m_Height == hTop))
+			continue;
+
+		NodeDB::WalkerState ws(m_Processor.get_DB());
+		m_Processor.get_DB().EnumStatesAt(ws, hTop);
+		if (ws.MoveNext())
+			continue;
+
+		Task* pTask = new Task;
+		pTask->m_Key = tKey.m_Key;
+		pTask->m_bRelevant = false; // not re-requested if the peer fails
+		pTask->m_bPack = false;
+		pTask->m_pOwner = NULL;
+
+		m_setTasks.insert(*pTask);
+		m_lstTasksUnassigned.push_back(*pTask);
+
+		TryAssignTask(*pTask, NULL);
+
+		if (!pTask->m_pOwner)
+		{
+			DeleteUnassignedTask(*pTask);
+			break; // no suitable peers
+		}
+	}
 }
 
 void Node::DeleteUnassignedTask(Task& t)
@@ -202,16 +269,50 @@ void Node::TryAssignTask(Task& t, const PeerID* pPeerID)
 			PeerMan::PeerInfoPlus* pInfo = (PeerMan::PeerInfoPlus*) m_PeerMan.Find(*pPeerID, bCreate);
 
 			if (pInfo && pInfo->m_pLive && (Peer::Flags::PiRcvd & pInfo->m_pLive->m_Flags))
-				pSel = pInfo->m_pLive;
+			{
+				Peer& p = *pInfo->m_pLive;
+				if (t.m_Key.second ?
+					(p.get_BlocksInFlight() < p.m_BlockWindow.get_Size(m_Cfg.m_BlockDownload)) :
+					!IsHdrRangePending(t.m_Key.first.m_Height))
+					pSel = &p;
+			}
 		}
 
-		for (PeerList::iterator it = m_lstPeers.begin(); !pSel && (m_lstPeers.end() != it); it++)
+		if (!pSel)
 		{
-			Peer& p = *it;
-			if (ShouldAssignTask(t, p))
+			// blocks: pick the peer with the most free slots, header ranges: with the least packs in flight. To spread the heights
+			bool bRange = IsHdrRange(t);
+			uint32_t nFreeMax = 0, nPacksMin = 0;
+
+			for (PeerList::iterator it = m_lstPeers.begin(); m_lstPeers.end() != it; it++)
 			{
-				pSel = &p;
-				break;
+				Peer& p = *it;
+				if (!ShouldAssignTask(t, p))
+					continue;
+
+				if (bRange)
+				{
+					uint32_t nPacks = p.get_HdrPacksInFlight();
+					if (!pSel || (nPacks < nPacksMin))
+					{
+						nPacksMin = nPacks;
+						pSel = &p;
+					}
+					continue;
+				}
+
+				if (!t.m_Key.second)
+				{
+					pSel = &p;
+					break;
+				}
+
+				uint32_t nFree = p.m_BlockWindow.get_Size(m_Cfg.m_BlockDownload) - p.get_BlocksInFlight();
+				if (nFree > nFreeMax)
+				{
+					nFreeMax = nFree;
+					pSel = &p;
+				}
 			}
 		}
 
@@ -232,21 +333,6 @@ void Node::TryAssignTask(Task& t, const PeerID* pPeerID)
 
 void Node::AssignTask(Task& t, Peer& p)
 {
-	uint32_t nPackSize = 0;
-	if (t.m_Key.first.m_Height > m_Processor.m_Cursor.m_ID.m_Height)
-	{
-		Height dh = t.m_Key.first.m_Height - m_Processor.m_Cursor.m_ID.m_Height;
-
-		const uint32_t nThreshold = 5;
-
-		if (dh >= nThreshold)
-		{
-			nPackSize = proto::g_HdrPackMaxSize;
-			if (nPackSize > dh)
-				nPackSize = (uint32_t) dh;
-		}
-	}
-
 	if (t.m_Key.second)
 	{
 		proto::GetBody msg;
@@ -255,21 +341,58 @@ void Node::AssignTask(Task& t, Peer& p)
 	}
 	else
 	{
-		if (!m_nTasksPackHdr && nPackSize)
+		const Height h = t.m_Key.first.m_Height;
+		bool bRange = IsHdrRange(t);
+
+		uint32_t nPackSize = 0;
+		if (h > m_Processor.m_Cursor.m_ID.m_Height)
+		{
+			Height dh = h - m_Processor.m_Cursor.m_ID.m_Height;
+
+			const uint32_t nThreshold = 5;
+
+			if (bRange || ((dh >= nThreshold) && (m_nTasksPackHdr < m_Cfg.m_HdrDownload.m_MaxPacks)))
+			{
+				nPackSize = p.get_HdrPackSize();
+				if (nPackSize > dh)
+					nPackSize = (uint32_t) dh;
+
+				// don't go below the aligned range, it's requested separately
+				if (m_Cfg.m_HdrDownload.m_PackSize)
+				{
+					Height dhRange = h - (h - 1) / m_Cfg.m_HdrDownload.m_PackSize * m_Cfg.m_HdrDownload.m_PackSize;
+					if (nPackSize > dhRange)
+						nPackSize = (uint32_t) dhRange;
+				}
+			}
+		}
+
+		if (bRange)
 		{
-			proto::GetHdrPack msg;
-			msg.m_Top = t.m_Key.first;
+			proto::GetHdrRange msg;
+			msg.m_Top = h;
 			msg.m_Count = nPackSize;
 			p.Send(msg);
-
-			t.m_bPack = true;
-			m_nTasksPackHdr++;
 		}
 		else
+			if (nPackSize)
+			{
+				proto::GetHdrPack msg;
+				msg.m_Top = t.m_Key.first;
+				msg.m_Count = nPackSize;
+				p.Send(msg);
+			}
+			else
+			{
+				proto::GetHdr msg;
+				msg.m_ID = t.m_Key.first;
+				p.Send(msg);
+			}
+
+		if (nPackSize)
 		{
-			proto::GetHdr msg;
-			msg.m_ID = t.m_Key.first;
-			p.Send(msg);
+			t.m_bPack = true;
+			m_nTasksPackHdr++;
 		}
 	}
 
@@ -277,6 +400,7 @@ void Node::AssignTask(Task& t, Peer& p)
 
 	assert(!t.m_pOwner);
 	t.m_pOwner = &p;
+	t.m_Sent_ms = GetTime_ms();
 
 	m_lstTasksUnassigned.erase(TaskList::s_iterator_to(t));
 	p.m_lstTasks.push_back(t);
@@ -311,20 +435,111 @@ bool Node::ShouldAssignTask(Task& t, Peer& p)
 	if (!((Peer::Flags::PiRcvd & p.m_Flags) && p.m_pInfo))
 		return false;
 
-	// check if the peer currently transfers a block
-	for (TaskList::iterator it = p.m_lstTasks.begin(); p.m_lstTasks.end() != it; it++)
-		if (it->m_Key.second)
-			return false;
+	// blocks are pipelined up to the peer window. Headers aren't requested while the peer transfers blocks
+	uint32_t nBlocks = p.get_BlocksInFlight();
+	if (nBlocks >= (t.m_Key.second ? p.m_BlockWindow.get_Size(m_Cfg.m_BlockDownload) : 1))
+		return false;
+
+	if (IsHdrRange(t) && !(Peer::Flags::HdrPackEx & p.m_Flags))
+		return false;
+
+	// wait for the range that covers this header
+	if (!t.m_Key.second && !IsHdrRange(t) && IsHdrRangePending(t.m_Key.first.m_Height))
+		return false;
 
 	return p.m_setRejected.end() == p.m_setRejected.find(t.m_Key);
 }
 
+uint32_t Node::Peer::get_BlocksInFlight() const
+{
+	uint32_t n = 0;
+	for (TaskList::const_iterator it = m_lstTasks.begin(); m_lstTasks.end() != it; it++)
+		if (it->m_Key.second)
+			n++;
+	return n;
+}
+
+uint32_t Node::get_BlocksInFlightMax() const
+{
+	uint32_t n = 0;
+	for (PeerList::const_iterator it = m_lstPeers.begin(); m_lstPeers.end() != it; it++)
+		n = std::max(n, it->get_BlocksInFlight());
+	return n;
+}
+
+void Node::get_TxPauseStats(uint32_t& nPaused, uint32_t& nResumed) const
+{
+	nPaused = m_TxPipeline.m_nPaused;
+	nResumed = m_TxPipeline.m_nResumed;
+}
+
+bool Node::IsSyncExcluded(const io::Address& addr) const
+{
+	for (PeerList::const_iterator it = m_lstPeers.begin(); m_lstPeers.end() != it; it++)
+		if (it->m_RemoteAddr == addr)
+			return (Peer::Flags::DontSync & it->m_Flags) != 0;
+
+	return false;
+}
+
+uint32_t Node::Peer::get_HdrPacksInFlight() const
+{
+	uint32_t n = 0;
+	for (TaskList::const_iterator it = m_lstTasks.begin(); m_lstTasks.end() != it; it++)
+		if (!it->m_Key.second && it->m_bPack)
+			n++;
+	return n;
+}
+
+uint32_t Node::Peer::get_HdrPackSize() const
+{
+	uint32_t n = (Flags::HdrPackEx & m_Flags) ? proto::g_HdrPackMaxSizeEx : proto::g_HdrPackMaxSize;
+	return std::max(1U, std::min(n, m_This.m_Cfg.m_HdrDownload.m_PackSize));
+}
+
+void Node::Peer::BlockWindow::OnBlock(uint32_t nSent_ms)
+{
+	uint32_t t_ms = GetTime_ms();
+
+	if (m_bRcv && (int32_t(m_LastRcv_ms - nSent_ms) >= 0))
+	{
+		// was queued behind the previous response
+		uint32_t dt_ms = t_ms - m_LastRcv_ms;
+		m_Transfer_ms = m_bTransfer ? ((m_Transfer_ms * 3 + dt_ms) >> 2) : dt_ms;
+		m_bTransfer = true;
+	}
+	else
+	{
+		uint32_t dt_ms = t_ms - nSent_ms;
+		m_Rtt_ms = m_bRtt ? ((m_Rtt_ms * 3 + dt_ms) >> 2) : dt_ms;
+		m_bRtt = true;
+	}
+}
+
+uint32_t Node::Peer::BlockWindow::get_Size(const Config::BlockDownload& cfg) const
+{
+	uint32_t n = cfg.m_WindowInitial;
+	if (m_bRtt)
+	{
+		if (m_bTransfer)
+			// bandwidth-delay product, in blocks. The RTT sample includes one transfer
+			n = m_Transfer_ms ? ((m_Rtt_ms + m_Transfer_ms - 1) / m_Transfer_ms + 1) : cfg.m_WindowMax;
+		else
+			n = std::max(n, 2U); // the transfer time is measured only for a request queued behind another one
+	}
+
+	return std::max(1U, std::min(n, cfg.m_WindowMax));
+}
+
 void Node::Processor::RequestData(const Block::SystemState::ID& id, bool bBlock, const PeerID* pPreferredPeer)
 {
 	Task tKey;
 	tKey.m_Key.first = id;
 	tKey.m_Key.second = bBlock;
 
+	if (!bBlock)
+		get_ParentObj().m_hHdrMissing = std::max(get_ParentObj().m_hHdrMissing, id.m_Height);
+
 	TaskSet::iterator it = get_ParentObj().m_setTasks.find(tKey);
 	if (get_ParentObj().m_setTasks.end() == it)
 	{
@@ -409,8 +624,56 @@ void Node::Processor::OnRolledBack()
 		get_ParentObj().m_Compressor.OnRolledBack();
 }
 
+struct Node::Processor::ReaderNoOutputs
+	:public TxBase::IReader
+{
+	// hides the outputs, if they're already verified and summarized
+	TxBase::IReader& m_R;
+	TxBase::IReader::Ptr m_pOwn;
+
+	ReaderNoOutputs(TxBase::IReader& r) :m_R(r) {}
+
+	void Sync()
+	{
+		m_pUtxoIn = m_R.m_pUtxoIn;
+		m_pUtxoOut = NULL;
+		m_pKernelIn = m_R.m_pKernelIn;
+		m_pKernelOut = m_R.m_pKernelOut;
+	}
+
+	virtual void Clone(Ptr& pOut) override
+	{
+		TxBase::IReader::Ptr pR;
+		m_R.Clone(pR);
+
+		ReaderNoOutputs* pRet = new ReaderNoOutputs(*pR);
+		pOut.reset(pRet);
+		pRet->m_pOwn = std::move(pR);
+	}
+
+	virtual void Reset() override { m_R.Reset(); Sync(); }
+	virtual void NextUtxoIn() override { m_R.NextUtxoIn(); Sync(); }
+	virtual void NextUtxoOut() override { assert(false); }
+	virtual void NextKernelIn() override { m_R.NextKernelIn(); Sync(); }
+	virtual void NextKernelOut() override { m_R.NextKernelOut(); Sync(); }
+};
+
 bool Node::Processor::VerifyBlock(const Block::BodyBase& block, TxBase::IReader&& r, const HeightRange& hr)
 {
+	return VerifyBlockInternal(block, std::move(r), hr, NULL);
+}
+
+bool Node::Processor::VerifyMacroBlock(const Block::BodyBase& block, TxBase::IReader&& r, const HeightRange& hr)
+{
+	const TxBase::Context* pCtxOutputs = (m_pPrecheck && m_pPrecheck->get_OutputsVerified()) ? &m_pPrecheck->m_ctxOutputs : NULL;
+	return VerifyBlockInternal(block, std::move(r), hr, pCtxOutputs);
+}
+
+bool Node::Processor::VerifyBlockInternal(const Block::BodyBase& block, TxBase::IReader&& r, const HeightRange& hr, const TxBase::Context* pCtxOutputs)
+{
+	ReaderNoOutputs rNoOutputs(r);
+	TxBase::IReader& rr = pCtxOutputs ? rNoOutputs : r;
+
 	uint32_t nThreads = get_ParentObj().m_Cfg.m_VerificationThreads;
 	if (!nThreads)
 	{
@@ -418,39 +681,98 @@ bool Node::Processor::VerifyBlock(const Block::BodyBase& block, TxBase::IReader&
 		p->m_bEnableBatch = true;
 		Verifier::MyBatch::Scope scope(*p);
 
+		TxBase::Context ctx;
+		ctx.m_bBlockMode = true;
+		ctx.m_Height = hr;
+
 		return
-			NodeProcessor::VerifyBlock(block, std::move(r), hr) &&
-			p->Flush();
+			ctx.ValidateAndSummarize(block, std::move(rr)) &&
+			p->Flush() &&
+			(!pCtxOutputs || ctx.Merge(*pCtxOutputs)) &&
+			ctx.IsValidBlock(block, m_Cursor.m_SubsidyOpen);
 	}
 
 	Verifier& v = m_Verifier; // alias
 	std::unique_lock<std::mutex> scope(v.m_Mutex);
 
-	if (v.m_vThreads.empty())
+	v.m_pTx = &block;
+	v.m_pR = &rr;
+	v.m_pStates = NULL;
+	v.m_Context.m_bBlockMode = true;
+	v.m_Context.m_Height = hr;
+
+	v.RunLocked(scope, nThreads);
+
+	return
+		!v.m_bFail &&
+		(!pCtxOutputs || v.m_Context.Merge(*pCtxOutputs)) &&
+		v.m_Context.IsValidBlock(block, m_Cursor.m_SubsidyOpen);
+}
+
+bool Node::Processor::VerifyMacroBlockStates(const Block::SystemState::Full* pS, size_t nCount)
+{
+	if (m_pPrecheck && m_pPrecheck->get_HdrsVerified())
+		return true; // already verified
+
+	return VerifyStates(pS, nCount);
+}
+
+bool Node::Processor::VerifyStates(const Block::SystemState::Full* pS, size_t nCount)
+{
+	uint32_t nThreads = get_ParentObj().m_Cfg.m_VerificationThreads;
+	if (!nThreads || (nCount < 2))
+		return NodeProcessor::VerifyStates(pS, nCount);
+
+	Verifier& v = m_Verifier; // alias
+	std::unique_lock<std::mutex> scope(v.m_Mutex);
+
+	v.m_pStates = pS;
+	v.m_nStates = nCount;
+
+	v.RunLocked(scope, nThreads);
+
+	v.m_pStates = NULL;
+	return !v.m_bFail;
+}
+
+void Node::Processor::Verifier::StartLocked(uint32_t nThreads)
+{
+	if (m_vThreads.empty())
 	{
-		v.m_iTask = 1;
+		m_iTask = 1;
 
-		v.m_vThreads.resize(nThreads);
+		m_vThreads.resize(nThreads);
 		for (uint32_t i = 0; i < nThreads; i++)
-			v.m_vThreads[i] = std::thread(&Verifier::Thread, &v, i);
+			m_vThreads[i] = std::thread(&Verifier::Thread, this, i);
 	}
+}
 
+void Node::Processor::Verifier::RunLocked(std::unique_lock<std::mutex>& scope, uint32_t nThreads)
+{
+	StartLocked(nThreads);
 
-	v.m_iTask ^= 2;
-	v.m_pTx = &block;
-	v.m_pR = &r;
-	v.m_bFail = false;
-	v.m_Remaining = nThreads;
-	v.m_Context.m_bBlockMode = true;
-	v.m_Context.m_Height = hr;
-	v.m_Context.m_nVerifiers = nThreads;
+	m_iTask ^= 2;
+	m_bFail = false;
+	m_Remaining = nThreads;
+	m_Context.m_nVerifiers = nThreads;
+
+	m_TaskNew.notify_all();
 
-	v.m_TaskNew.notify_all();
+	while (m_Remaining)
+		m_TaskFinished.wait(scope);
+}
 
-	while (v.m_Remaining)
-		v.m_TaskFinished.wait(scope);
+bool Node::Processor::Verifier::VerifyStates(uint32_t iVerifier) const
+{
+	// interleaved, to balance the load
+	for (size_t i = iVerifier; i < m_nStates; i += m_Context.m_nVerifiers)
+	{
+		const Block::SystemState::Full& s = m_pStates[i];
+		if (!s.IsSane() || !s.IsValidPoW())
+			return false;
+	}
 
-	return !v.m_bFail && v.m_Context.IsValidBlock(block, m_Cursor.m_SubsidyOpen);
+	return true;
 }
 
 void Node::Processor::Verifier::Thread(uint32_t iVerifier)
@@ -459,24 +781,53 @@ void Node::Processor::Verifier::Thread(uint32_t iVerifier)
 	p->m_bEnableBatch = true;
 	Verifier::MyBatch::Scope scope(*p);
 
+	TxPipeline& txp = get_ParentObj().get_ParentObj().m_TxPipeline;
+	std::vector<TxPipeline::Task*> vTxs;
+
 	for (uint32_t iTask = 1; ; )
 	{
 		{
 			std::unique_lock<std::mutex> scope(m_Mutex);
 
-			while (m_iTask == iTask)
+			// the block (or headers) first, the pending txs only if there's nothing else to do
+			while ((m_iTask == iTask) && !txp.TakeLocked(vTxs))
 				m_TaskNew.wait(scope);
 
 			if (!m_iTask)
 				return;
 
-			iTask = m_iTask;
+			if (vTxs.empty())
+				iTask = m_iTask;
 		}
 
-		p->Reset();
+		if (!vTxs.empty())
+		{
+			txp.Verify(vTxs, *p);
+			vTxs.clear();
+			continue;
+		}
 
 		assert(m_Remaining);
 
+		if (m_pStates)
+		{
+			bool bValid = VerifyStates(iVerifier);
+
+			std::unique_lock<std::mutex> scope(m_Mutex);
+
+			verify(m_Remaining--);
+
+			if (!bValid)
+				m_bFail = true;
+
+			if (!m_Remaining)
+				m_TaskFinished.notify_one();
+
+			continue;
+		}
+
+		p->Reset();
+
 		TxBase::Context ctx;
 		ctx.m_bBlockMode = true;
 		ctx.m_Height = m_Context.m_Height;
@@ -536,6 +887,15 @@ void Node::Processor::OnBlockData()
 	ReportProgress();
 }
 
+void Node::Processor::OnGroupCommitPending()
+{
+	// in case no more blocks arrive soon
+	if (!m_pGroupCommitTimer)
+		m_pGroupCommitTimer = io::Timer::create(io::Reactor::get_Current().shared_from_this());
+
+	m_pGroupCommitTimer->start(m_GroupCommit.m_MaxTime_ms, false, [this]() { FlushGroupCommit(); });
+}
+
 void Node::Processor::ReportProgress()
 {
 	auto observer = get_ParentObj().m_Cfg.m_Observer;
@@ -575,6 +935,11 @@ Node::Peer* Node::AllocPeer(const beam::io::Address& addr)
 void Node::Initialize()
 {
 	m_Processor.m_Horizon = m_Cfg.m_Horizon;
+	m_Processor.m_Snapshot.m_Period = m_Cfg.m_SnapshotPeriod;
+	m_Processor.get_DB().set_Profile(m_Cfg.m_DbProfile);
+	m_Processor.m_GroupCommit.m_MaxBlocks = m_Cfg.m_GroupCommitBlocks;
+	m_Processor.m_GroupCommit.m_MaxTime_ms = m_Cfg.m_GroupCommit_ms;
+	m_Processor.m_RequestBlocksAhead = m_Cfg.m_BlockDownload.m_Ahead;
 	m_Processor.Initialize(m_Cfg.m_sPathLocal.c_str());
 	m_Processor.m_Kdf.m_Secret = m_Cfg.m_WalletKey;
 
@@ -611,6 +976,8 @@ void Node::Initialize()
 		m_Cfg.m_VerificationThreads = (numCores > m_Cfg.m_MiningThreads + 1) ? (numCores - m_Cfg.m_MiningThreads) : 0;
 	}
 
+	m_Processor.set_RehashThreads(m_Cfg.m_VerificationThreads);
+
 	if (!m_Processor.m_Cursor.m_ID.m_Height)
 	{
 		if (!m_Cfg.m_vTreasury.empty())
@@ -634,6 +1001,7 @@ void Node::Initialize()
 				if (m_pSync->m_Trg.m_Height)
 				{
 					LOG_INFO() << "Resuming sync up to " << m_pSync->m_Trg;
+					SyncPrepare();
 				}
 				else
 				{
@@ -705,6 +1073,9 @@ void Node::Initialize()
 		m_Miner.SetTimer(0, true); // async start mining, since this method may be followed by ImportMacroblock.
 	}
 
+	if (m_Cfg.m_VerificationThreads > 0)
+		m_TxPipeline.Start();
+
 	ZeroObject(m_Compressor.m_hrNew);
 	m_Compressor.m_bEnabled = !m_Cfg.m_HistoryCompression.m_sPathOutput.empty();
 
@@ -779,8 +1150,9 @@ void Node::ImportMacroblock(Height h)
 	if (!m_Processor.ImportMacroBlock(rw))
 		throw std::runtime_error("import failed");
 
-	if (m_Processor.m_Cursor.m_Sid.m_Row)
-		m_Processor.get_DB().MacroblockIns(m_Processor.m_Cursor.m_Sid.m_Row);
+	// the cursor may already be above, if the following blocks were present
+	if (m_Processor.m_Cursor.m_Sid.m_Height >= h)
+		m_Processor.get_DB().MacroblockIns(m_Processor.FindActiveAtStrict(h));
 }
 
 Node::~Node()
@@ -829,6 +1201,17 @@ Node::~Node()
 				v.m_vThreads[i].join();
 	}
 
+	m_TxPipeline.Stop();
+
+	try {
+		m_Processor.FlushGroupCommit();
+	} catch (const std::exception& e) {
+		LOG_ERROR() << "Group commit failed: " << e.what();
+	}
+
+	if (m_Cfg.m_SnapshotPeriod && (m_Processor.m_Snapshot.m_hLast != m_Processor.m_Cursor.m_ID.m_Height))
+		m_Processor.SaveSnapshot();
+
 	LOG_INFO() << "Node stopped";
 }
 
@@ -908,6 +1291,7 @@ void Node::Peer::OnConnectedSecure()
 
 	ECC::Scalar::Native sk = m_This.m_MyPrivateID.V;
 	ProveID(sk, proto::IDType::Node);
+	ProveID(sk, proto::IDType::HdrPackEx); // older nodes ignore unknown ID types, unlike the unknown messages or Config fields
 
 	proto::Config msgCfg;
 	msgCfg.m_CfgChecksum = Rules::get().Checksum;
@@ -935,6 +1319,9 @@ void Node::Peer::OnMsg(proto::Authentication&& msg)
 			m_Flags |= Flags::Owner;
 	}
 
+	if (proto::IDType::HdrPackEx == msg.m_IDType)
+		m_Flags |= Flags::HdrPackEx;
+
 	if (proto::IDType::Node != msg.m_IDType)
 		return;
 
@@ -1100,6 +1487,9 @@ void Node::Peer::DeleteSelf(bool bIsError, uint8_t nByeReason)
 	ReleaseTasks();
 	Unsubscribe();
 
+	if (m_TxPending)
+		m_This.m_TxPipeline.OnPeerDeleted(*this);
+
 	if (m_pInfo)
 	{
 		// detach
@@ -1112,16 +1502,45 @@ void Node::Peer::DeleteSelf(bool bIsError, uint8_t nByeReason)
 			m_This.m_PeerMan.OnRemoteError(*m_pInfo, ByeReason::Ban == nByeReason);
 	}
 
-	if (m_This.m_pSync && (Flags::SyncPending & m_Flags))
+	if (m_This.m_pSync && !m_dqSync.empty())
 	{
-		assert(m_This.m_pSync && m_This.m_pSync->m_RequestsPending);
-		m_Flags &= ~Flags::SyncPending;
-		m_Flags |= Flags::DontSync;
-		m_This.m_pSync->m_RequestsPending--;
+		// the requested portions are re-requested from other peers
+		FirstTimeSync& s = *m_This.m_pSync;
+		for (; !m_dqSync.empty(); m_dqSync.pop_front())
+		{
+			const FirstTimeSync::Range& r = m_dqSync.front();
+
+			assert(s.m_RequestsPending && s.m_pStream[r.m_iData].m_InFlight);
+			s.m_RequestsPending--;
+			s.m_pStream[r.m_iData].m_InFlight--;
+
+			s.m_Holes.push_back(r);
+		}
 
+		m_Flags |= Flags::DontSync;
 		m_This.SyncCycle();
+
+		if (s.IsComplete())
+		{
+			// the responses of this peer were the last pending ones. Not from here, the import may throw
+			Node& n = m_This;
+			s.m_pTimer = io::Timer::create(io::Reactor::get_Current().shared_from_this());
+			s.m_pTimer->start(0, false, [&n]() {
+				try {
+					if (n.m_pSync && n.m_pSync->IsComplete())
+						n.SyncComplete();
+				} catch (const std::exception& e) {
+					LOG_ERROR() << "Macroblock import failed: " << e.what();
+				}
+			});
+		}
 	}
 
+	if (m_This.m_pSync)
+		for (int i = 0; i < Block::Body::RW::s_Datas; i++)
+			if (this == m_This.m_pSync->m_pStream[i].m_pEndBy)
+				m_This.m_pSync->m_pStream[i].m_pEndBy = NULL;
+
 	m_This.m_lstPeers.erase(PeerList::s_iterator_to(*this));
 	delete this;
 }
@@ -1222,12 +1641,14 @@ void Node::Peer::OnMsg(proto::NewTip&& msg)
 	if (m_This.m_pSync->m_bDetecting)
 	{
 		if (!nProvenWork/* && (m_This.m_pSync->m_Best <= m_Tip.m_ChainWork)*/)
+		{
 			// maybe take it
 			Send(proto::MacroblockGet());
+			m_Flags |= Flags::SyncDetect;
+		}
 	}
 	else
-		if (!(Flags::DontSync & m_Flags) && !m_This.m_pSync->m_RequestsPending && nProvenWork)
-			m_This.SyncCycle(*this);
+		m_This.SyncCycle(*this);
 
 }
 
@@ -1256,25 +1677,23 @@ void Node::Peer::OnMsg(proto::Macroblock&& msg)
 	if (!(Flags::ProvenWork & m_Flags))
 		ThrowUnexpected();
 
-	if (Flags::SyncPending & m_Flags)
+	if (!(Flags::SyncDetect & m_Flags))
 	{
-		assert(m_This.m_pSync->m_RequestsPending);
-		m_Flags &= ~Flags::SyncPending;
-		m_This.m_pSync->m_RequestsPending--;
+		if (m_dqSync.empty())
+			ThrowUnexpected();
 
-		if (msg.m_ID == m_This.m_pSync->m_Trg)
-		{
-			LOG_INFO() << "Peer " << m_RemoteAddr << " DL Macroblock portion";
-			m_This.SyncCycle(*this, msg.m_Portion);
-		}
-		else
-		{
-			m_Flags |= Flags::DontSync;
+		FirstTimeSync::Range r = m_dqSync.front();
+		m_dqSync.pop_front();
+
+		m_This.SyncOnPortion(*this, r, msg);
+
+		if (m_This.m_pSync)
 			m_This.SyncCycle();
-		}
 	}
 	else
 	{
+		m_Flags &= ~Flags::SyncDetect;
+
 		if (!m_This.m_pSync->m_bDetecting)
 			return;
 
@@ -1318,6 +1737,7 @@ void Node::OnSyncTimer()
 		m_pSync->m_bDetecting = false;
 		m_pSync->m_RequestsPending = 0;
 
+		SyncPrepare();
 		SyncCycle();
 	}
 	else
@@ -1328,84 +1748,495 @@ void Node::OnSyncTimer()
 	}
 }
 
-void Node::SyncCycle()
+void Node::SyncPrepare()
 {
-	assert(m_pSync && !m_pSync->m_bDetecting && !m_pSync->m_RequestsPending);
+	assert(m_pSync && !m_pSync->m_bDetecting);
 
-	for (PeerList::iterator it = m_lstPeers.begin(); m_lstPeers.end() != it; it++)
-		if (SyncCycle(*it))
-			break;
+	Block::Body::RW rw;
+	m_Compressor.FmtPath(rw, m_pSync->m_Trg.m_Height, NULL);
+
+	m_pSync->m_Precheck.m_sPath = rw.m_sPath;
+	m_pSync->m_Precheck.m_nThreads = std::max(m_Cfg.m_VerificationThreads, 1);
+
+	for (int i = 0; i < Block::Body::RW::s_Datas; i++)
+	{
+		std::string sPath;
+		rw.GetPath(sPath, i);
+
+		// resume from what's already downloaded
+		std::FStream fs;
+		if (fs.Open(sPath.c_str(), true))
+		{
+			FirstTimeSync::Stream& x = m_pSync->m_pStream[i];
+			x.m_Done = x.m_Next = x.m_RcvMax = fs.get_Remaining();
+		}
+	}
 }
 
-bool Node::SyncCycle(Peer& p)
+bool Node::FirstTimeSync::get_NextRange(Range& r, uint32_t nPortion, bool bNew, const Peer& p, bool bOnlySource)
 {
-	assert(m_pSync && !m_pSync->m_bDetecting && !m_pSync->m_RequestsPending);
-	assert(!(Peer::Flags::SyncPending & p.m_Flags));
+	// holes first, they precede the data that is already received. The ones beyond the end are kept, in case it's revoked.
+	// The one at the end is requested from another peer (if there's one), to confirm it
+	for (size_t i = 0; i < m_Holes.size(); i++)
+	{
+		const Stream& x = m_pStream[m_Holes[i].m_iData];
+		uint64_t nOffset = m_Holes[i].m_Offset;
 
-	if (Peer::Flags::DontSync & p.m_Flags)
-		return false;
+		if ((nOffset < x.m_End) ||
+			((nOffset == x.m_End) && !x.m_bEndConfirmed && (bOnlySource || (x.m_pEndBy != &p))))
+		{
+			r = m_Holes[i];
+			m_Holes.erase(m_Holes.begin() + i);
+			return true;
+		}
+	}
 
-	if (p.m_Tip.m_Height < m_pSync->m_Trg.m_Height/* + Rules::get().MaxRollbackHeight*/)
+	if (!bNew || !nPortion)
 		return false;
 
-	proto::MacroblockGet msg;
-	msg.m_ID = m_pSync->m_Trg;
-	msg.m_Data = m_pSync->m_iData;
-
-	assert(m_pSync->m_iData < Block::Body::RW::s_Datas);
-
-	Block::Body::RW rw;
-	m_Compressor.FmtPath(rw, m_pSync->m_Trg.m_Height, NULL);
+	// The streams verified by SyncPrecheck (outputs and headers) are requested first, so that they're verified while the rest is downloaded.
+	// The others are requested once those have no free range. Within each group the streams are interleaved (the one with the fewest portions in flight).
+	// The requests beyond the end (unknown in advance) are cheap.
+	Stream* pSel = NULL;
+	for (int iPass = 0; (iPass < 2) && !pSel; iPass++)
+	{
+		for (uint8_t i = 0; i < Block::Body::RW::s_Datas; i++)
+		{
+			if (SyncPrecheck::IsSupported(i) != !iPass)
+				continue;
 
-	std::string sPath;
-	rw.GetPath(sPath, m_pSync->m_iData);
+			Stream& x = m_pStream[i];
+			if ((x.m_Next < x.m_End) && (!pSel || (x.m_InFlight < pSel->m_InFlight)))
+			{
+				pSel = &x;
+				r.m_iData = i;
+			}
+		}
+	}
 
-	std::FStream fs;
-	if (fs.Open(sPath.c_str(), true))
-		msg.m_Offset = fs.get_Remaining();
+	if (!pSel)
+		return false;
 
-	p.Send(msg);
-	p.m_Flags |= Peer::Flags::SyncPending;
-	m_pSync->m_RequestsPending++;
+	r.m_Offset = pSel->m_Next;
+	r.m_Size = nPortion;
+	pSel->m_Next += nPortion;
 
 	return true;
 }
 
-void Node::SyncCycle(Peer& p, const ByteBuffer& buf)
+bool Node::FirstTimeSync::IsComplete() const
+{
+	for (int i = 0; i < Block::Body::RW::s_Datas; i++)
+		if (!m_pStream[i].IsComplete())
+			return false;
+
+	return true;
+}
+
+void Node::SyncCycle()
+{
+	assert(m_pSync && !m_pSync->m_bDetecting);
+
+	for (PeerList::iterator it = m_lstPeers.begin(); m_lstPeers.end() != it; it++)
+		SyncCycle(*it);
+}
+
+bool Node::SyncIsSource(const Peer& p) const
+{
+	assert(m_pSync && !m_pSync->m_bDetecting);
+
+	if ((Peer::Flags::DontSync & p.m_Flags) || !(Peer::Flags::ProvenWork & p.m_Flags))
+		return false;
+
+	return (p.m_Tip.m_Height >= m_pSync->m_Trg.m_Height/* + Rules::get().MaxRollbackHeight*/);
+}
+
+bool Node::SyncHasOtherSource(const Peer& p) const
+{
+	for (PeerList::const_iterator it = m_lstPeers.begin(); m_lstPeers.end() != it; it++)
+		if ((&p != &*it) && SyncIsSource(*it))
+			return true;
+
+	return false;
+}
+
+void Node::SyncCycle(Peer& p)
 {
-	assert(m_pSync && !m_pSync->m_bDetecting && !m_pSync->m_RequestsPending);
-	assert(m_pSync->m_iData < Block::Body::RW::s_Datas);
+	if (!SyncIsSource(p))
+		return;
+
+	FirstTimeSync& s = *m_pSync;
+	const Config::Sync& cfg = m_Cfg.m_Sync;
+	bool bOnlySource = !SyncHasOtherSource(p);
+
+	while (p.m_dqSync.size() < cfg.m_PortionsPerPeer)
+	{
+		FirstTimeSync::Range r;
+		if (!s.get_NextRange(r, cfg.m_Portion, s.m_RequestsPending + s.m_Buffered < cfg.m_PortionsMax, p, bOnlySource))
+			break;
+
+		proto::MacroblockGet msg;
+		msg.m_ID = s.m_Trg;
+		msg.m_Data = r.m_iData;
+		msg.m_Offset = r.m_Offset;
+
+		p.Send(msg);
+
+		p.m_dqSync.push_back(r);
+		s.m_pStream[r.m_iData].m_InFlight++;
+		s.m_RequestsPending++;
+	}
+}
+
+void Node::SyncOnPortion(Peer& p, const FirstTimeSync::Range& r, proto::Macroblock& msg)
+{
+	assert(m_pSync && !m_pSync->m_bDetecting && (r.m_iData < Block::Body::RW::s_Datas));
+
+	FirstTimeSync& s = *m_pSync;
+	FirstTimeSync::Stream& x = s.m_pStream[r.m_iData];
+
+	assert(s.m_RequestsPending && x.m_InFlight);
+	s.m_RequestsPending--;
+	x.m_InFlight--;
+
+	ByteBuffer& buf = msg.m_Portion;
+
+	// Only the bounds are checked here, against what's received so far (from all the peers). The contents are verified after the download.
+	// The end can't be proven: if a peer sends data beyond it - the end is revoked, and the peer that reported it is blamed
+	bool bValid = (msg.m_ID == s.m_Trg);
+	if (bValid)
+	{
+		if (buf.empty())
+			bValid = (r.m_Offset >= x.m_RcvMax);
+		else
+			if (r.m_Offset + buf.size() > x.m_End)
+			{
+				if (Peer::Flags::DontSync & p.m_Flags)
+					bValid = false; // already blamed, not trusted
+				else
+				{
+					bValid = (x.m_pEndBy != &p); // otherwise it contradicts itself
+					SyncRevokeEnd(r.m_iData);
+				}
+			}
+	}
+
+	if (buf.size() > r.m_Size)
+		buf.resize(r.m_Size); // the peer's portion is larger, the rest belongs to other ranges
+
+	if (!bValid)
+	{
+		LOG_WARNING() << "Peer " << p.m_RemoteAddr << " Macroblock portion rejected";
+
+		p.m_Flags |= Peer::Flags::DontSync;
+		s.m_Holes.push_back(r);
+
+		SyncCheckComplete(r.m_iData); // might have been the last pending response
+		return;
+	}
 
 	if (buf.empty())
 	{
-		if (++m_pSync->m_iData == Block::Body::RW::s_Datas)
+		if (!(Peer::Flags::DontSync & p.m_Flags)) // the peers that are already blamed aren't trusted
 		{
-			Height h = m_pSync->m_Trg.m_Height;
-			m_pSync = NULL;
+			if (r.m_Offset < x.m_End)
+			{
+				x.m_End = r.m_Offset;
+				x.m_pEndBy = &p;
+				x.m_bEndConfirmed = false;
+			}
+
+			// by another peer, or by the same one if there's no other to ask
+			if ((r.m_Offset == x.m_End) && ((x.m_pEndBy != &p) || !SyncHasOtherSource(p)))
+				x.m_bEndConfirmed = true;
+		}
 
-			LOG_INFO() << "Sync DL complete";
+		s.m_Holes.push_back(r); // requested again only to confirm the end, or if it's revoked
+	}
+	else
+	{
+		LOG_INFO() << "Peer " << p.m_RemoteAddr << " DL Macroblock portion " << static_cast<uint32_t>(r.m_iData) << " at " << r.m_Offset;
 
-			ImportMacroblock(h);
-			RefreshCongestions();
+		x.m_RcvMax = std::max(x.m_RcvMax, r.m_Offset + buf.size());
 
-			return;
+		if (buf.size() < r.m_Size)
+		{
+			// the rest is requested separately
+			FirstTimeSync::Range r2 = r;
+			r2.m_Offset += buf.size();
+			r2.m_Size -= static_cast<uint32_t>(buf.size());
+			s.m_Holes.push_back(r2);
+		}
+
+		if (r.m_Offset == x.m_Done)
+		{
+			SyncWrite(r.m_iData, buf);
+			x.m_Done += buf.size();
+
+			// flush the following portions, if already received
+			while (!x.m_mapRcv.empty() && (x.m_mapRcv.begin()->first == x.m_Done))
+			{
+				const ByteBuffer& buf2 = x.m_mapRcv.begin()->second;
+				SyncWrite(r.m_iData, buf2);
+				x.m_Done += buf2.size();
+
+				x.m_mapRcv.erase(x.m_mapRcv.begin());
+				assert(s.m_Buffered);
+				s.m_Buffered--;
+			}
+		}
+		else
+		{
+			assert(r.m_Offset > x.m_Done);
+			x.m_mapRcv[r.m_Offset].swap(buf);
+			s.m_Buffered++;
 		}
 	}
-	else
+
+	SyncCheckComplete(r.m_iData);
+}
+
+void Node::SyncCheckComplete(uint8_t iData)
+{
+	FirstTimeSync& s = *m_pSync;
+
+	if (s.m_pStream[iData].IsComplete())
+		s.m_Precheck.Start(iData);
+
+	if (s.IsComplete())
+		SyncComplete();
+}
+
+void Node::SyncComplete()
+{
+	assert(m_pSync && m_pSync->IsComplete());
+	Height h = m_pSync->m_Trg.m_Height;
+
+	for (PeerList::iterator it = m_lstPeers.begin(); m_lstPeers.end() != it; it++)
+		it->m_dqSync.clear(); // the responses will be ignored
+
+	std::unique_ptr<FirstTimeSync> pSync(std::move(m_pSync)); // keep the precheck results
+
+	LOG_INFO() << "Sync DL complete";
+
+	pSync->m_Precheck.Wait();
+	m_Processor.m_pPrecheck = &pSync->m_Precheck;
+
+	try {
+		ImportMacroblock(h);
+	} catch (...) {
+		m_Processor.m_pPrecheck = NULL;
+		throw;
+	}
+
+	m_Processor.m_pPrecheck = NULL;
+
+	RefreshCongestions();
+}
+
+void Node::SyncPrecheck::Start(uint8_t iData)
+{
+	bool* pStarted;
+	void (SyncPrecheck::*pfn)(uint32_t);
+
+	switch (iData)
 	{
-		Block::Body::RW rw;
-		m_Compressor.FmtPath(rw, m_pSync->m_Trg.m_Height, NULL);
+	case s_iOutputs:
+		pStarted = &m_bOutputs;
+		pfn = &SyncPrecheck::RunOutputs;
+		m_ctxOutputs.m_bBlockMode = true;
+		break;
 
-		std::string sPath;
-		rw.GetPath(sPath, m_pSync->m_iData);
+	case s_iHdrs:
+		pStarted = &m_bHdrs;
+		pfn = &SyncPrecheck::RunHdrs;
+		break;
 
-		std::FStream fs;
-		fs.Open(sPath.c_str(), false, true, true);
+	default:
+		return;
+	}
+
+	if (*pStarted)
+		return;
+	*pStarted = true;
 
-		fs.write(&buf.at(0), buf.size());
+	LOG_INFO() << "Macroblock " << Block::BodyBase::RW::s_pszSufix[iData] << " downloaded, verifying...";
+
+	for (uint32_t i = 0; i < m_nThreads; i++)
+		m_vThreads.push_back(std::thread(pfn, this, i));
+}
+
+void Node::SyncPrecheck::Discard(uint8_t iData)
+{
+	std::unique_lock<std::mutex> scope(m_Mutex);
+
+	switch (iData)
+	{
+	case s_iOutputs:
+		if (m_bOutputs)
+			m_bOutputsValid = false;
+		break;
+
+	case s_iHdrs:
+		if (m_bHdrs)
+			m_bHdrsValid = false;
 	}
+}
+
+void Node::SyncPrecheck::Wait()
+{
+	for (size_t i = 0; i < m_vThreads.size(); i++)
+		if (m_vThreads[i].joinable())
+			m_vThreads[i].join();
+
+	m_vThreads.clear();
+}
+
+Node::SyncPrecheck::~SyncPrecheck()
+{
+	m_bStop = true;
+	Wait();
+}
+
+void Node::SyncPrecheck::RunHdrs(uint32_t iThread)
+{
+	// the same states as during the import. Each thread verifies its share
+	bool bValid = true;
 
-	SyncCycle(p);
+	try {
+		Block::BodyBase::RW rw;
+		rw.m_sPath = m_sPath;
+		rw.Open(true);
+
+		Block::BodyBase body;
+		Block::SystemState::Full s;
+		rw.get_Start(body, s);
+
+		for (uint32_t i = 0; rw.get_NextHdr(s); s.NextPrefix(), i++)
+		{
+			if (m_bStop)
+			{
+				bValid = false;
+				break;
+			}
+
+			if (i)
+				s.m_PoW.m_Difficulty.Inc(s.m_ChainWork);
+
+			if ((i % m_nThreads == iThread) && !(s.IsSane() && s.IsValidPoW()))
+			{
+				bValid = false;
+				break;
+			}
+		}
+
+	} catch (const std::exception&) {
+		bValid = false;
+	}
+
+	if (!bValid)
+	{
+		std::unique_lock<std::mutex> scope(m_Mutex);
+		m_bHdrsValid = false;
+	}
+}
+
+void Node::SyncPrecheck::RunOutputs(uint32_t iThread)
+{
+	TxBase::Context ctx;
+	ctx.m_bBlockMode = true;
+
+	bool bValid;
+	try {
+		bValid = RunOutputsInternal(iThread, ctx);
+	} catch (const std::exception&) {
+		bValid = false;
+	}
+
+	std::unique_lock<std::mutex> scope(m_Mutex);
+
+	if (bValid && m_bOutputsValid)
+		bValid = m_ctxOutputs.Merge(ctx);
+
+	if (!bValid)
+		m_bOutputsValid = false;
+}
+
+bool Node::SyncPrecheck::RunOutputsInternal(uint32_t iThread, TxBase::Context& ctx)
+{
+	// Same as the outputs part of TxBase::Context::ValidateAndSummarize()
+	std::unique_ptr<Processor::Verifier::MyBatch> p(new Processor::Verifier::MyBatch);
+	p->m_bEnableBatch = true;
+	Processor::Verifier::MyBatch::Scope scope(*p);
+
+	Block::BodyBase::RW rw;
+	rw.m_sPath = m_sPath;
+	rw.Open(true); // only the outputs are read, the other streams may be incomplete
+
+	ECC::Point::Native pt;
+
+	const Output* pPrev = NULL;
+	for (uint32_t i = 0; ; pPrev = rw.m_pUtxoOut, i++)
+	{
+		rw.NextUtxoOut();
+		if (!rw.m_pUtxoOut)
+			break;
+
+		if (m_bStop)
+			return false;
+
+		if (i % m_nThreads != iThread)
+			continue;
+
+		if (pPrev && (*pPrev > *rw.m_pUtxoOut))
+			return false;
+
+		if (!rw.m_pUtxoOut->IsValid(pt))
+			return false;
+
+		ctx.m_Sigma += pt;
+
+		if (rw.m_pUtxoOut->m_Coinbase)
+		{
+			assert(rw.m_pUtxoOut->m_pPublic); // must have already been checked
+			ctx.m_Coinbase += rw.m_pUtxoOut->m_pPublic->m_Value;
+		}
+	}
+
+	return p->Flush();
+}
+
+void Node::SyncRevokeEnd(uint8_t iData)
+{
+	FirstTimeSync& s = *m_pSync;
+	FirstTimeSync::Stream& x = s.m_pStream[iData];
+
+	if (x.m_pEndBy)
+	{
+		LOG_WARNING() << "Peer " << x.m_pEndBy->m_RemoteAddr << " Macroblock end contradicted";
+		x.m_pEndBy->m_Flags |= Peer::Flags::DontSync;
+	}
+
+	x.m_End = static_cast<uint64_t>(-1);
+	x.m_pEndBy = NULL;
+	x.m_bEndConfirmed = false;
+	m_SyncEndsRevoked++;
+
+	s.m_Precheck.Discard(iData); // might have started on the incomplete stream
+}
+
+void Node::SyncWrite(uint8_t iData, const ByteBuffer& buf)
+{
+	Block::Body::RW rw;
+	m_Compressor.FmtPath(rw, m_pSync->m_Trg.m_Height, NULL);
+
+	std::string sPath;
+	rw.GetPath(sPath, iData);
+
+	std::FStream fs;
+	fs.Open(sPath.c_str(), false, true, true);
+
+	fs.write(&buf.at(0), buf.size());
 }
 
 Node::Task& Node::Peer::get_FirstTask()
@@ -1417,6 +2248,9 @@ Node::Task& Node::Peer::get_FirstTask()
 
 void Node::Peer::OnFirstTaskDone()
 {
+	m_BlockWindow.m_LastRcv_ms = GetTime_ms();
+	m_BlockWindow.m_bRcv = true;
+
 	ReleaseTask(get_FirstTask());
 	SetTimerWrtFirstTask();
 }
@@ -1464,35 +2298,48 @@ void Node::Peer::OnMsg(proto::Hdr&& msg)
 }
 
 void Node::Peer::OnMsg(proto::GetHdrPack&& msg)
+{
+	if (msg.m_Count > proto::g_HdrPackMaxSizeEx)
+		ThrowUnexpected();
+
+	uint64_t rowid = msg.m_Count ? m_This.m_Processor.get_DB().StateFindSafe(msg.m_Top) : 0;
+	SendHdrPack(rowid, msg.m_Count);
+}
+
+void Node::Peer::OnMsg(proto::GetHdrRange&& msg)
+{
+	if (msg.m_Count > proto::g_HdrPackMaxSizeEx)
+		ThrowUnexpected();
+
+	const NodeProcessor::Cursor& c = m_This.m_Processor.m_Cursor;
+	bool bValid = msg.m_Count && (msg.m_Top >= Rules::HeightGenesis) && (msg.m_Top <= c.m_Sid.m_Height);
+
+	SendHdrPack(bValid ? m_This.m_Processor.FindActiveAtStrict(msg.m_Top) : 0, msg.m_Count);
+}
+
+void Node::Peer::SendHdrPack(uint64_t rowid, uint32_t nCount)
 {
 	proto::HdrPack msgOut;
 
-	if (msg.m_Count)
+	if (rowid)
 	{
-		if (msg.m_Count > proto::g_HdrPackMaxSize)
-			ThrowUnexpected();
-
 		NodeDB& db = m_This.m_Processor.get_DB();
-		uint64_t rowid = db.StateFindSafe(msg.m_Top);
-		if (rowid)
-		{
-			msgOut.m_vElements.reserve(msg.m_Count);
-
-			Block::SystemState::Full s;
-			for (uint32_t n = 0; ; )
-			{
-				db.get_State(rowid, s);
-				msgOut.m_vElements.push_back(s);
+		msgOut.m_vElements.reserve(nCount);
 
-				if (++n == msg.m_Count)
-					break;
+		Block::SystemState::Full s;
+		for (uint32_t n = 0; ; )
+		{
+			db.get_State(rowid, s);
+			msgOut.m_vElements.push_back(s);
 
-				if (!db.get_Prev(rowid))
-					break;
-			}
+			if (++n == nCount)
+				break;
 
-			msgOut.m_Prefix = s;
+			if (!db.get_Prev(rowid))
+				break;
 		}
+
+		msgOut.m_Prefix = s;
 	}
 
 	if (msgOut.m_vElements.empty())
@@ -1508,19 +2355,38 @@ void Node::Peer::OnMsg(proto::HdrPack&& msg)
 	if (t.m_Key.second || !t.m_bPack)
 		ThrowUnexpected();
 
-	if (msg.m_vElements.empty() || (msg.m_vElements.size() > proto::g_HdrPackMaxSize))
+	if (msg.m_vElements.empty() || (msg.m_vElements.size() > get_HdrPackSize()))
 		ThrowUnexpected();
 
-	Block::SystemState::Full s;
-	((Block::SystemState::Sequence::Prefix&) s) = msg.m_Prefix;
-	((Block::SystemState::Sequence::Element&) s) = msg.m_vElements.back();
+	// unpack all the headers (ascending), verify their PoW at once (may be parallel), then insert them sequentially
+	size_t nCount = msg.m_vElements.size();
+	std::vector<Block::SystemState::Full> vStates(nCount);
+
+	for (size_t i = 0; i < nCount; i++)
+	{
+		Block::SystemState::Full& s = vStates[i];
+		if (i)
+		{
+			s = vStates[i - 1];
+			s.NextPrefix();
+		}
+		else
+			((Block::SystemState::Sequence::Prefix&) s) = msg.m_Prefix;
+
+		((Block::SystemState::Sequence::Element&) s) = msg.m_vElements[nCount - 1 - i];
+
+		if (i)
+			s.m_PoW.m_Difficulty.Inc(s.m_ChainWork);
+	}
+
+	bool bVerified = m_This.m_Processor.VerifyStates(&vStates.front(), nCount); // if failed - each header is checked individually
 
 	uint32_t nAccepted = 0;
 	bool bInvalid = false;
 
-	for (size_t i = msg.m_vElements.size(); ; )
+	for (size_t i = 0; i < nCount; i++)
 	{
-		NodeProcessor::DataStatus::Enum eStatus = m_This.m_Processor.OnState(s, m_pInfo->m_ID.m_Key);
+		NodeProcessor::DataStatus::Enum eStatus = m_This.m_Processor.OnState(vStates[i], m_pInfo->m_ID.m_Key, bVerified);
 		switch (eStatus)
 		{
 		case NodeProcessor::DataStatus::Invalid:
@@ -1533,21 +2399,15 @@ void Node::Peer::OnMsg(proto::HdrPack&& msg)
 		default:
 			break; // suppress warning
 		}
-
-		if (! --i)
-			break;
-
-		s.NextPrefix();
-		((Block::SystemState::Sequence::Element&) s) = msg.m_vElements[i - 1];
-		s.m_PoW.m_Difficulty.Inc(s.m_ChainWork);
 	}
 
 	// just to be pedantic
 	Block::SystemState::ID id;
-	s.get_ID(id);
-	if (id != t.m_Key.first)
+	vStates.back().get_ID(id);
+	if (IsHdrRange(t) ? (id.m_Height != t.m_Key.first.m_Height) : (id != t.m_Key.first))
 		bInvalid = true;
 
+	t.m_bRelevant = false; // received. If still missing - will be requested again
 	OnFirstTaskDone();
 
 	if (nAccepted)
@@ -1594,6 +2454,7 @@ void Node::Peer::OnMsg(proto::Body&& msg)
 	m_This.m_PeerMan.ModifyRating(*m_pInfo, PeerMan::Rating::RewardBlock, true);
 
 	const Block::SystemState::ID& id = t.m_Key.first;
+	m_BlockWindow.OnBlock(t.m_Sent_ms);
 
 	NodeProcessor::DataStatus::Enum eStatus = m_This.m_Processor.OnBlock(id, msg.m_Buffer, m_pInfo->m_ID.m_Key);
 	OnFirstTaskDone(eStatus);
@@ -1617,16 +2478,29 @@ void Node::Peer::OnMsg(proto::NewTransaction&& msg)
 		ThrowUnexpected(); // our deserialization permits NULL Ptrs.
 	// However the transaction body must have already been checked for NULLs
 
-	proto::Boolean msgOut;
-	msgOut.m_Value = m_This.OnTransaction(std::move(msg.m_Transaction), msg.m_Fluff, this);
-	Send(msgOut);
+	if (m_This.m_TxPipeline.IsEnabled())
+		m_This.m_TxPipeline.Push(std::move(msg.m_Transaction), msg.m_Fluff, *this); // the response is sent once it's processed
+	else
+	{
+		proto::Boolean msgOut;
+		msgOut.m_Value = m_This.OnTransaction(std::move(msg.m_Transaction), msg.m_Fluff, this);
+		Send(msgOut);
+	}
 }
 
-bool Node::ValidateAndLogTx(Transaction::Context& ctx, const Transaction& tx, const Transaction::KeyType& key, const Peer* pPeer)
-{
-	bool bValid = !tx.m_vInputs.empty() && !tx.m_vKernelsOutput.empty();
+bool Node::ValidateTxContextFree(const Transaction& tx, Transaction::Context& ctx)
+{
+	return
+		!tx.m_vInputs.empty() &&
+		!tx.m_vKernelsOutput.empty() &&
+		tx.IsValid(ctx);
+}
+
+bool Node::ValidateAndLogTx(Transaction::Context& ctx, const Transaction& tx, const Transaction::KeyType& key, const Peer* pPeer, const TxPipeline::Task* pTask)
+{
+	bool bValid = pTask ? pTask->m_bValid : ValidateTxContextFree(tx, ctx);
 	if (bValid)
-		bValid = m_Processor.ValidateTx(tx, ctx);
+		bValid = m_Processor.ValidateTxWrtHeight(ctx);
 
 	{
 		// Log it
@@ -1684,7 +2558,7 @@ uint32_t RandomUInt32(uint32_t threshold, ECC::uintBig& hvRnd)
 	return threshold;
 }
 
-bool Node::OnTransaction(Transaction::Ptr&& ptx, bool bFluff, const Peer* pPeer)
+bool Node::OnTransaction(Transaction::Ptr&& ptx, bool bFluff, const Peer* pPeer, TxPipeline::Task* pTask)
 {
 	ECC::uintBig& hvRnd = m_SChannelSeed.V;
 	uint32_t nStemPeers;
@@ -1716,7 +2590,8 @@ bool Node::OnTransaction(Transaction::Ptr&& ptx, bool bFluff, const Peer* pPeer)
 	Dandelion::TxSet::iterator it0 = m_Dandelion.m_setTxs.find(key0);
 
 	const Transaction& tx = *ptx;
-	Transaction::Context ctx;
+	Transaction::Context ctxLocal;
+	Transaction::Context& ctx = pTask ? pTask->m_Ctx : ctxLocal;
 
 	if (!bFluff)
 	{
@@ -1729,7 +2604,7 @@ bool Node::OnTransaction(Transaction::Ptr&& ptx, bool bFluff, const Peer* pPeer)
 		}
 		else
 		{
-			if (!ValidateAndLogTx(ctx, tx, key0.m_Key, pPeer))
+			if (!ValidateAndLogTx(ctx, tx, key0.m_Key, pPeer, pTask))
 				return false;
 
 			pVal = new Dandelion::Element;
@@ -1777,7 +2652,7 @@ bool Node::OnTransaction(Transaction::Ptr&& ptx, bool bFluff, const Peer* pPeer)
 
 	// new transaction
 
-	if (/*!bValid && */!ValidateAndLogTx(ctx, tx, key.m_Key, pPeer)) // we need the fee
+	if (/*!bValid && */!ValidateAndLogTx(ctx, tx, key.m_Key, pPeer, pTask)) // we need the fee
 		return false;
 
 	proto::HaveTransaction msgOut;
@@ -1801,6 +2676,153 @@ bool Node::OnTransaction(Transaction::Ptr&& ptx, bool bFluff, const Peer* pPeer)
 	return true;
 }
 
+void Node::TxPipeline::Start()
+{
+	assert(!m_pEvtDone);
+	m_pEvtDone = io::AsyncEvent::create(io::Reactor::get_Current().shared_from_this(), [this]() { OnDone(); });
+
+	Processor::Verifier& v = get_ParentObj().m_Processor.m_Verifier;
+
+	std::unique_lock<std::mutex> scope(v.m_Mutex);
+	v.StartLocked(get_ParentObj().m_Cfg.m_VerificationThreads);
+}
+
+void Node::TxPipeline::Stop()
+{
+	while (!m_lst.empty())
+	{
+		Task& t = m_lst.front();
+		m_lst.pop_front();
+		delete &t;
+	}
+
+	m_pNext = NULL;
+	m_pEvtDone.reset();
+}
+
+void Node::TxPipeline::Push(Transaction::Ptr&& ptx, bool bFluff, Peer& peer)
+{
+	Task* pTask = new Task;
+	pTask->m_pTx = std::move(ptx);
+	pTask->m_pPeer = &peer;
+	pTask->m_bFluff = bFluff;
+	pTask->m_bValid = false;
+	pTask->m_bDone = false;
+
+	{
+		Processor::Verifier& v = get_ParentObj().m_Processor.m_Verifier;
+		std::unique_lock<std::mutex> scope(v.m_Mutex);
+
+		m_lst.push_back(*pTask);
+		if (!m_pNext)
+			m_pNext = pTask;
+
+		v.m_TaskNew.notify_one();
+	}
+
+	if (++peer.m_TxPending == get_ParentObj().m_Cfg.m_TxValidation.m_MaxPendingPerPeer)
+	{
+		peer.PauseRead(true);
+		m_nPaused++;
+	}
+}
+
+void Node::TxPipeline::OnPeerDeleted(Peer& peer)
+{
+	std::unique_lock<std::mutex> scope(get_ParentObj().m_Processor.m_Verifier.m_Mutex);
+
+	for (TaskList::iterator it = m_lst.begin(); m_lst.end() != it; it++)
+		if (&peer == it->m_pPeer)
+			it->m_pPeer = NULL;
+}
+
+bool Node::TxPipeline::TakeLocked(std::vector<Task*>& vTasks)
+{
+	if (!m_pNext)
+		return false;
+
+	const uint32_t nBatchSize = std::max(get_ParentObj().m_Cfg.m_TxValidation.m_BatchSize, 1U);
+
+	TaskList::iterator it = TaskList::s_iterator_to(*m_pNext);
+	for (; (m_lst.end() != it) && (vTasks.size() < nBatchSize); it++)
+		vTasks.push_back(&*it);
+
+	m_pNext = (m_lst.end() == it) ? NULL : &*it;
+	return true;
+}
+
+void Node::TxPipeline::Verify(std::vector<Task*>& vTasks, Processor::Verifier::MyBatch& b)
+{
+	// Verify all the txs in a single batch. If it fails - verify them one-by-one, to find the culprit(s)
+	b.Reset();
+
+	bool bValid = true;
+	for (size_t i = 0; bValid && (i < vTasks.size()); i++)
+		bValid = ValidateTxContextFree(*vTasks[i]->m_pTx, vTasks[i]->m_Ctx);
+
+	if (bValid)
+		bValid = b.Flush();
+
+	for (size_t i = 0; i < vTasks.size(); i++)
+	{
+		Task& t = *vTasks[i];
+
+		if (bValid || (1 == vTasks.size()))
+			t.m_bValid = bValid;
+		else
+		{
+			b.Reset();
+			t.m_Ctx.Reset();
+			t.m_bValid = ValidateTxContextFree(*t.m_pTx, t.m_Ctx) && b.Flush();
+		}
+	}
+
+	{
+		std::unique_lock<std::mutex> scope(get_ParentObj().m_Processor.m_Verifier.m_Mutex);
+
+		for (size_t i = 0; i < vTasks.size(); i++)
+			vTasks[i]->m_bDone = true;
+	}
+
+	m_pEvtDone->post();
+}
+
+void Node::TxPipeline::OnDone()
+{
+	// admit the txs in the order of arrival
+	while (true)
+	{
+		Task* pTask;
+		{
+			std::unique_lock<std::mutex> scope(get_ParentObj().m_Processor.m_Verifier.m_Mutex);
+
+			if (m_lst.empty() || !m_lst.front().m_bDone)
+				break;
+
+			pTask = &m_lst.front();
+			m_lst.pop_front();
+		}
+
+		std::unique_ptr<Task> pGuard(pTask);
+		Peer* pPeer = pTask->m_pPeer;
+
+		proto::Boolean msgOut;
+		msgOut.m_Value = get_ParentObj().OnTransaction(std::move(pTask->m_pTx), pTask->m_bFluff, pPeer, pTask);
+
+		if (pPeer)
+		{
+			pPeer->Send(msgOut);
+
+			assert(pPeer->m_TxPending);
+			if (pPeer->m_TxPending-- == get_ParentObj().m_Cfg.m_TxValidation.m_MaxPendingPerPeer)
+			{
+				pPeer->PauseRead(false);
+				m_nResumed++;
+			}
+		}
+	}
+}
+
 void Node::Dandelion::Delete(Element& x)
 {
 	uint32_t n_ms;
@@ -2372,9 +3394,10 @@ void Node::Peer::OnMsg(proto::MacroblockGet&& msg)
 				rw.GetPath(sPath, msg.m_Data);
 
 				std::FStream fs;
-				if (fs.Open(sPath.c_str(), true) && (fs.get_Remaining() > msg.m_Offset))
+				uint64_t nSize = fs.Open(sPath.c_str(), true) ? std::min(fs.get_Remaining(), m_This.m_Cfg.m_TestMode.m_FakeMacroblockEnd) : 0;
+				if (nSize > msg.m_Offset)
 				{
-					uint64_t nDelta = fs.get_Remaining() - msg.m_Offset;
+					uint64_t nDelta = nSize - msg.m_Offset;
 
 					uint32_t nPortion = m_This.m_Cfg.m_HistoryCompression.m_UploadPortion;
 					if (nPortion > nDelta)
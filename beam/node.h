@@ -21,6 +21,8 @@
 #include <boost/intrusive/list.hpp>
 #include <boost/intrusive/set.hpp>
 #include <condition_variable>
+#include <deque>
+#include <map>
 
 namespace beam
 {
@@ -44,6 +46,15 @@ struct Node
 		ECC::NoLeak<ECC::uintBig> m_WalletKey;
 		NodeProcessor::Horizon m_Horizon;
 
+		// Save the live data snapshot once in this number of blocks, and on shutdown. 0 - disabled (the live data is rebuilt from the DB on startup)
+		Height m_SnapshotPeriod = 0;
+
+		NodeDB::Profile::Enum m_DbProfile = NodeDB::Profile::Default;
+
+		// During the catch-up commit the blocks in groups of this size, or at least once in this time. 0 or 1 - commit each block
+		uint32_t m_GroupCommitBlocks = 0;
+		uint32_t m_GroupCommit_ms = 1000;
+
 		bool m_RestrictMinedReportToOwner = true;
 
 		struct Timeout {
@@ -65,11 +76,17 @@ struct Node
 		uint32_t m_MiningThreads = 0; // by default disabled
 		uint32_t m_MinerID = 0; // used as a seed for miner nonce generation
 
-		// Number of verification threads for CPU-hungry cryptography. Currently used for block validation only.
+		// Number of verification threads for CPU-hungry cryptography. Used for block validation, and for the context-free validation of incoming transactions.
 		// 0: single threaded
 		// negative: number of cores minus number of mining threads. 
 		int m_VerificationThreads = 0;
 
+		struct TxValidation
+		{
+			uint32_t m_BatchSize = 16; // max num of txs verified by a thread in a single batch
+			uint32_t m_MaxPendingPerPeer = 64; // stop reading from the peer that has more unprocessed txs
+		} m_TxValidation;
+
 		struct HistoryCompression
 		{
 			std::string m_sPathOutput;
@@ -85,6 +102,7 @@ struct Node
 		struct TestMode {
 			// for testing only!
 			uint32_t m_FakePowSolveTime_ms = 15 * 1000;
+			uint64_t m_FakeMacroblockEnd = static_cast<uint64_t>(-1); // the served macroblock streams are truncated here (a lying peer)
 
 		} m_TestMode;
 
@@ -92,11 +110,31 @@ struct Node
 
 		Block::SystemState::ID m_ControlState;
 
+		// Blocks are requested from each peer in a pipelined manner. The window (max number of requests in flight) is adjusted per peer,
+		// wrt its measured round-trip time and the time it takes to transfer a block, so that the link is kept busy.
+		struct BlockDownload {
+			uint32_t m_WindowInitial = 4; // until both are measured
+			uint32_t m_WindowMax = 32;
+			uint32_t m_Ahead = 128; // max blocks requested at once per branch, from all the peers
+		} m_BlockDownload;
+
+		// Header packs are requested concurrently. Below the highest missing header the chain is split into pack-sized ranges (aligned by height),
+		// which are requested by height from the active chains of the peers. The received packs are linked in the DB, as usual.
+		struct HdrDownload {
+			uint32_t m_MaxPacks = 8; // in flight, from all the peers
+			uint32_t m_PackSize = proto::g_HdrPackMaxSizeEx; // requested (if the peer supports it) and served
+		} m_HdrDownload;
+
 		struct Sync {
 			// during sync phase we try to pick the best peer to sync from.
 			// Our logic: decide when either examined enough peers, or timeout expires
 			uint32_t m_SrcPeers = 5;
 			uint32_t m_Timeout_ms = 10000;
+
+			// The macroblock is downloaded in portions, requested in parallel from all the peers that have it
+			uint32_t m_Portion = 5 * 1024 * 1024; // requested size, should match m_UploadPortion of the peers
+			uint32_t m_PortionsPerPeer = 2; // in flight, pipelined
+			uint32_t m_PortionsMax = 16; // in flight and received out of order, from all the peers. Bounds the memory footprint
 		} m_Sync;
 
 		struct Dandelion
@@ -122,9 +160,15 @@ struct Node
 	void ImportMacroblock(Height); // throws on err
 
 	NodeProcessor& get_Processor() { return m_Processor; } // for tests only!
+	uint32_t get_BlocksInFlightMax() const; // over all the peers. For tests only!
+	uint32_t get_SyncEndsRevoked() const { return m_SyncEndsRevoked; } // for tests only!
+	void get_TxPauseStats(uint32_t& nPaused, uint32_t& nResumed) const; // peers paused/resumed by the TxPipeline backpressure. For tests only!
+	bool IsSyncExcluded(const io::Address&) const; // the peer is connected, and not trusted for the sync. For tests only!
 
 private:
 
+	struct SyncPrecheck;
+
 	struct Processor
 		:public NodeProcessor
 	{
@@ -134,21 +178,35 @@ private:
 		void OnNewState() override;
 		void OnRolledBack() override;
 		bool VerifyBlock(const Block::BodyBase&, TxBase::IReader&&, const HeightRange&) override;
+		bool VerifyStates(const Block::SystemState::Full*, size_t nCount) override;
+		bool VerifyMacroBlockStates(const Block::SystemState::Full*, size_t nCount) override;
+		bool VerifyMacroBlock(const Block::BodyBase&, TxBase::IReader&&, const HeightRange&) override;
 		bool ApproveState(const Block::SystemState::ID&) override;
 		void AdjustFossilEnd(Height&) override;
 		void OnStateData() override;
 		void OnBlockData() override;
+		void OnGroupCommitPending() override;
 
 		void ReportProgress();
 
+		struct ReaderNoOutputs;
+		bool VerifyBlockInternal(const Block::BodyBase&, TxBase::IReader&&, const HeightRange&, const TxBase::Context* pCtxOutputs);
+
+		const SyncPrecheck* m_pPrecheck = NULL; // set during the import of the downloaded macroblock. Consulted only for the macroblock itself
+
+		io::Timer::Ptr m_pGroupCommitTimer;
+
 		struct Verifier
 		{
-			typedef ECC::InnerProduct::BatchContextEx<100> MyBatch; // seems to be ok, for larger batches difference is marginal
+			typedef ECC::InnerProduct::BatchContextEx<100> MyBatch; // seems to be ok. Uses the bucket method (MultiMac::Pippenger), larger batches are currently bound by the memory footprint of MultiMac::Casual
 
 			const TxBase* m_pTx;
 			TxBase::IReader* m_pR;
 			TxBase::Context m_Context;
 
+			const Block::SystemState::Full* m_pStates; // if set - the task is headers verification, instead of the block
+			size_t m_nStates;
+
 			bool m_bFail;
 			uint32_t m_iTask;
 			uint32_t m_Remaining;
@@ -160,6 +218,9 @@ private:
 			std::vector<std::thread> m_vThreads;
 
 			void Thread(uint32_t);
+			void StartLocked(uint32_t nThreads); // if not started yet
+			void RunLocked(std::unique_lock<std::mutex>&, uint32_t nThreads); // start the threads if needed, dispatch the task and wait for its completion
+			bool VerifyStates(uint32_t iVerifier) const;
 
 			IMPLEMENT_GET_PARENT_OBJ(Processor, m_Verifier)
 		} m_Verifier;
@@ -188,6 +249,7 @@ private:
 		bool m_bPack;
 		bool m_bRelevant;
 		Peer* m_pOwner;
+		uint32_t m_Sent_ms; // valid when assigned
 
 		bool operator < (const Task& t) const { return (m_Key < t.m_Key); }
 	};
@@ -198,37 +260,119 @@ private:
 	uint32_t m_nTasksPackHdr = 0;
 	uint32_t m_nTasksPackBody = 0;
 
+	Height m_hHdrMissing = 0; // the highest missing header, collected while the congestions are enumerated
+
 	TaskList m_lstTasksUnassigned;
 	TaskSet m_setTasks;
 
+	// Context-free verification of the downloaded macroblock streams (outputs and headers), each is started once the stream is complete.
+	// Runs in the background while the rest is downloaded. The import waits for it, and verifies only the rest.
+	struct SyncPrecheck
+	{
+		std::string m_sPath;
+		uint32_t m_nThreads = 1;
+		volatile bool m_bStop = false;
+
+		std::vector<std::thread> m_vThreads;
+		std::mutex m_Mutex; // for results
+
+		bool m_bHdrs = false; // started
+		bool m_bHdrsValid = true;
+
+		bool m_bOutputs = false;
+		bool m_bOutputsValid = true;
+		TxBase::Context m_ctxOutputs; // summarized
+
+		bool get_HdrsVerified() const { return m_bHdrs && m_bHdrsValid; }
+		bool get_OutputsVerified() const { return m_bOutputs && m_bOutputsValid; }
+
+		// the verified streams (Block::Body::RW data indices)
+		static const uint8_t s_iOutputs = 1;
+		static const uint8_t s_iHdrs = 4;
+		static bool IsSupported(uint8_t iData) { return (s_iOutputs == iData) || (s_iHdrs == iData); }
+
+		void Start(uint8_t iData); // ignored if not supported or already started
+		void Discard(uint8_t iData); // the stream turned out to be incomplete. The results (if started) won't be used
+		void Wait();
+
+		~SyncPrecheck();
+
+	private:
+		void RunHdrs(uint32_t iThread);
+		void RunOutputs(uint32_t iThread);
+		bool RunOutputsInternal(uint32_t iThread, TxBase::Context&);
+	};
+
 	struct FirstTimeSync
 	{
 		// there are 2 phases:
 		//	1. Detection, pick the best peer to sync from
-		//	2. Sync phase
+		//	2. Sync phase. The macroblock streams are split into ranges, which are requested in parallel from all the peers that have the target.
+		//		Each stream is written to its file contiguously (hence the download is resumed from the file size), portions received out of order are kept in memory.
 		bool m_bDetecting;
 
-		io::Timer::Ptr m_pTimer; // set during the 1st phase
+		io::Timer::Ptr m_pTimer; // set during the 1st phase. In the 2nd - to complete it, if the last pending response is lost
 		Difficulty::Raw m_Best;
 
 		Block::SystemState::ID m_Trg;
 
-		uint32_t m_RequestsPending = 0;
-		uint32_t m_iData = 0;
+		uint32_t m_RequestsPending = 0; // 1st phase: responses so far, 2nd phase: portions in flight
+		uint32_t m_Buffered = 0; // portions received out of order
+
+		struct Range
+		{
+			uint8_t m_iData;
+			uint64_t m_Offset;
+			uint32_t m_Size;
+		};
+
+		std::deque<Range> m_Holes; // to be (re)requested
+
+		struct Stream
+		{
+			uint64_t m_Done = 0; // written to the file
+			uint64_t m_Next = 0; // not requested yet from here
+			uint64_t m_End = static_cast<uint64_t>(-1); // upper bound, a portion at this offset turned out to be empty. Revoked if others send data beyond it
+			Peer* m_pEndBy = NULL; // reported m_End, blamed if it's revoked
+			bool m_bEndConfirmed = false; // reported by another peer as well, or there was no other peer to ask
+			uint64_t m_RcvMax = 0; // lower bound, received up to here
+			uint32_t m_InFlight = 0;
+			std::map<uint64_t, ByteBuffer> m_mapRcv; // out of order, by offset
+
+			bool IsComplete() const { return (m_Done >= m_End) && m_bEndConfirmed && !m_InFlight; } // no pending responses that may contradict the end
+		} m_pStream[Block::Body::RW::s_Datas];
+
+		SyncPrecheck m_Precheck;
+
+		bool get_NextRange(Range&, uint32_t nPortion, bool bNew, const Peer&, bool bOnlySource);
+		bool IsComplete() const;
 	};
 
 	void OnSyncTimer();
+	void SyncPrepare();
 	void SyncCycle();
-	bool SyncCycle(Peer&);
-	void SyncCycle(Peer&, const ByteBuffer&);
+	void SyncCycle(Peer&);
+	bool SyncIsSource(const Peer&) const;
+	bool SyncHasOtherSource(const Peer&) const;
+	void SyncOnPortion(Peer&, const FirstTimeSync::Range&, proto::Macroblock&);
+	void SyncRevokeEnd(uint8_t iData);
+	void SyncCheckComplete(uint8_t iData);
+	void SyncComplete();
+	void SyncWrite(uint8_t iData, const ByteBuffer&);
 
 	std::unique_ptr<FirstTimeSync> m_pSync;
+	uint32_t m_SyncEndsRevoked = 0;
 
 	void TryAssignTask(Task&, const PeerID*);
 	bool ShouldAssignTask(Task&, Peer&);
 	void AssignTask(Task&, Peer&);
 	void DeleteUnassignedTask(Task&);
 
+	// Header ranges are tasks with zero hash, their height is the range top
+	static bool IsHdrRange(const Task& t) { return !t.m_Key.second && (t.m_Key.first.m_Hash == Zero); }
+	bool IsHdrRangePending(Height) const;
+	void RequestHdrRanges();
+
 	struct Wanted
 	{
 		typedef ECC::Hash::Value KeyType;
@@ -323,8 +467,50 @@ private:
 
 	} m_Dandelion;
 
-	bool OnTransaction(Transaction::Ptr&&, bool bFluff, const Peer*);
-	bool ValidateAndLogTx(Transaction::Context&, const Transaction&, const Transaction::KeyType&, const Peer*);
+	struct TxPipeline
+	{
+		// Context-free validation of incoming txs (signatures, range proofs) is offloaded to the verification threads (Processor::Verifier),
+		// which verify them in batches when there's no block or headers to verify.
+		// Then the txs are admitted to the TxPool/Dandelion on the reactor thread, in the order of arrival.
+		struct Task
+			:public boost::intrusive::list_base_hook<>
+		{
+			Transaction::Ptr m_pTx;
+			Transaction::Context m_Ctx;
+			Peer* m_pPeer; // reset if the peer is deleted meanwhile
+			bool m_bFluff;
+			bool m_bValid;
+			bool m_bDone;
+		};
+
+		typedef boost::intrusive::list<Task> TaskList;
+
+		// all the following is protected by the Verifier mutex
+		TaskList m_lst; // in order of arrival
+		Task* m_pNext = NULL; // 1st task not taken by the threads yet
+
+		io::AsyncEvent::Ptr m_pEvtDone;
+
+		uint32_t m_nPaused = 0;
+		uint32_t m_nResumed = 0;
+
+		bool IsEnabled() const { return !!m_pEvtDone; }
+		void Start();
+		void Stop(); // after the verification threads are stopped
+		void Push(Transaction::Ptr&&, bool bFluff, Peer&);
+		void OnPeerDeleted(Peer&);
+
+		bool TakeLocked(std::vector<Task*>&); // called by the verification threads
+		void Verify(std::vector<Task*>&, Processor::Verifier::MyBatch&);
+		void OnDone();
+
+		IMPLEMENT_GET_PARENT_OBJ(Node, m_TxPipeline)
+	} m_TxPipeline;
+
+	static bool ValidateTxContextFree(const Transaction&, Transaction::Context&); // can be called from any thread
+
+	bool OnTransaction(Transaction::Ptr&&, bool bFluff, const Peer*, TxPipeline::Task* = NULL); // Task is specified if the context-free validation is already done
+	bool ValidateAndLogTx(Transaction::Context&, const Transaction&, const Transaction::KeyType&, const Peer*, const TxPipeline::Task*);
 
 	struct Bbs
 	{
@@ -407,8 +593,9 @@ private:
 			static const uint8_t Owner			= 0x04;
 			static const uint8_t ProvenWorkReq	= 0x08;
 			static const uint8_t ProvenWork		= 0x10;
-			static const uint8_t SyncPending	= 0x20;
+			static const uint8_t SyncDetect		= 0x20; // MacroblockGet of the 1st sync phase is pending
 			static const uint8_t DontSync		= 0x40;
+			static const uint8_t HdrPackEx		= 0x80; // serves GetHdrRange and the larger header packs
 		};
 
 		uint8_t m_Flags;
@@ -419,10 +606,35 @@ private:
 		proto::Config m_Config;
 
 		TaskList m_lstTasks;
+		std::deque<FirstTimeSync::Range> m_dqSync; // macroblock portions requested, the peer responds in order
 		std::set<Task::Key> m_setRejected; // data that shouldn't be requested from this peer. Reset after reconnection or on receiving NewTip
 
+		struct BlockWindow
+		{
+			// The peer responds in order. If a block was requested before the previous response arrived - the interval between the responses is its transfer time.
+			// Otherwise the whole time since the request is the round-trip (plus the transfer time).
+			uint32_t m_Rtt_ms = 0;
+			uint32_t m_Transfer_ms = 0;
+			bool m_bRtt = false;
+			bool m_bTransfer = false;
+
+			uint32_t m_LastRcv_ms; // the last response (of any kind)
+			bool m_bRcv = false;
+
+			void OnBlock(uint32_t nSent_ms);
+			uint32_t get_Size(const Config::BlockDownload&) const;
+
+		} m_BlockWindow;
+
+		uint32_t get_BlocksInFlight() const;
+		uint32_t get_HdrPacksInFlight() const;
+		uint32_t get_HdrPackSize() const; // negotiated
+		void SendHdrPack(uint64_t rowid, uint32_t nCount);
+
 		Bbs::Subscription::PeerSet m_Subscriptions;
 
+		uint32_t m_TxPending = 0; // passed to the TxPipeline, not processed yet
+
 		io::Timer::Ptr m_pTimer;
 		io::Timer::Ptr m_pTimerPeers;
 
@@ -460,6 +672,7 @@ private:
 		virtual void OnMsg(proto::GetHdr&&) override;
 		virtual void OnMsg(proto::GetHdrPack&&) override;
 		virtual void OnMsg(proto::Hdr&&) override;
+		virtual void OnMsg(proto::GetHdrRange&&) override;
 		virtual void OnMsg(proto::HdrPack&&) override;
 		virtual void OnMsg(proto::GetBody&&) override;
 		virtual void OnMsg(proto::Body&&) override;
@@ -14,6 +14,12 @@
 
 #include "node_db.h"
 
+#ifdef WIN32
+#	include <io.h>
+#else // WIN32
+#	include <unistd.h>
+#endif // WIN32
+
 namespace beam {
 
 
@@ -35,7 +41,9 @@ namespace beam {
 #define TblStates_CountNextF	"CountNextFunctional"
 #define TblStates_PoW			"PoW"
 #define TblStates_Mmr			"Mmr"
-#define TblStates_Body			"Body"
+#define TblStates_BodySegment	"BodySegment"
+#define TblStates_BodyOffset	"BodyOffset"
+#define TblStates_BodySize		"BodySize"
 #define TblStates_Rollback		"Rollback"
 #define TblStates_Peer			"Peer"
 #define TblStates_ChainWork		"ChainWork"
@@ -57,6 +65,10 @@ namespace beam {
 #define TblMined_State			"State"
 #define TblMined_Comission		"Comission"
 
+#define TblSegments				"BodySegments"
+#define TblSegments_ID			"ID"
+#define TblSegments_Refs		"Refs"
+
 #define TblCompressed			"Macroblocks"
 #define TblCompressed_Row1		"RowLast"
 
@@ -73,7 +85,14 @@ namespace beam {
 #define TblBbs_Msg				"Message"
 
 NodeDB::NodeDB()
-	:m_pDb(NULL)
+	:m_BodySegmentSize(64 << 20)
+	,m_pDb(NULL)
+	,m_bStateCacheDirty(false)
+	,m_bBodyUnsynced(false)
+	,m_Profile(Profile::Default)
+	,m_bGroup(false)
+	,m_bGroupMember(false)
+	,m_nBodySegmentsDeadMember(0)
 {
 	ZeroObject(m_pPrep);
 }
@@ -123,6 +142,16 @@ void NodeDB::Close()
 		verify(SQLITE_OK == sqlite3_close(m_pDb));
 		m_pDb = NULL;
 	}
+
+	m_BodyWriter.Close();
+	m_BodyReader.Close();
+	m_bBodyUnsynced = false;
+	m_vBodySegmentsDead.clear();
+	m_bGroup = false; // if was open - it's rolled back
+	m_bGroupMember = false;
+	m_SpendableCache.clear();
+	m_vSpendableUndo.clear();
+	ResetStateCache();
 }
 
 NodeDB::Recordset::Recordset(NodeDB& db)
@@ -264,7 +293,7 @@ void NodeDB::Open(const char* szPath)
 		bCreate = !rs.Step();
 	}
 
-	const uint64_t nVersion = 8;
+	const uint64_t nVersion = 9;
 
 	if (bCreate)
 	{
@@ -279,6 +308,77 @@ void NodeDB::Open(const char* szPath)
 		if (nVersion != ParamIntGetDef(ParamID::DbVer))
 			ThrowError("wrong version");
 	}
+
+	m_sBodyPath = szPath;
+	m_sBodyPath += ".body.";
+	OpenBodyWriter();
+
+	if (Profile::Default != m_Profile)
+		ApplyProfile();
+}
+
+const char* NodeDB::Profile::get_Name(Enum e)
+{
+	switch (e)
+	{
+	case Safe: return "safe";
+	case Sync: return "sync";
+	default: return "default";
+	}
+}
+
+bool NodeDB::Profile::FromName(Enum& e, const char* sz)
+{
+	for (int i = 0; i < count; i++)
+		if (!strcmp(sz, get_Name((Enum) i)))
+		{
+			e = (Enum) i;
+			return true;
+		}
+
+	return false;
+}
+
+void NodeDB::set_Profile(Profile::Enum e)
+{
+	Profile::Enum ePrev = m_Profile;
+	m_Profile = e;
+
+	if (m_pDb)
+	{
+		ApplyProfile();
+
+		if ((Profile::Sync == ePrev) && (Profile::Sync != e))
+			ExecQuick("PRAGMA wal_checkpoint(FULL)"); // flush and sync whatever was written unsynced. The bodies are synced with the next commit
+	}
+}
+
+void NodeDB::ApplyProfile()
+{
+	assert(sqlite3_get_autocommit(m_pDb)); // journal mode can't be changed within a transaction
+
+	switch (m_Profile)
+	{
+	case Profile::Safe:
+		ExecQuick("PRAGMA synchronous=FULL");
+		ExecQuick("PRAGMA journal_mode=WAL");
+		ExecQuick("PRAGMA cache_size=-65536"); // 64MB
+		ExecQuick("PRAGMA mmap_size=0");
+		break;
+
+	case Profile::Sync:
+		ExecQuick("PRAGMA synchronous=OFF");
+		ExecQuick("PRAGMA journal_mode=WAL");
+		ExecQuick("PRAGMA cache_size=-524288"); // 512MB
+		ExecQuick("PRAGMA mmap_size=1073741824"); // 1GB
+		break;
+
+	default:
+		ExecQuick("PRAGMA synchronous=FULL");
+		ExecQuick("PRAGMA journal_mode=DELETE"); // checkpoints the WAL, if was used
+		ExecQuick("PRAGMA cache_size=-2000"); // SQLite default
+		ExecQuick("PRAGMA mmap_size=0");
+	}
 }
 
 void NodeDB::Create()
@@ -303,7 +403,9 @@ void NodeDB::Create()
 		"[" TblStates_CountNextF	"] INTEGER NOT NULL,"
 		"[" TblStates_PoW			"] BLOB,"
 		"[" TblStates_Mmr			"] BLOB,"
-		"[" TblStates_Body			"] BLOB,"
+		"[" TblStates_BodySegment	"] INTEGER,"
+		"[" TblStates_BodyOffset	"] INTEGER,"
+		"[" TblStates_BodySize		"] INTEGER,"
 		"[" TblStates_Rollback		"] BLOB,"
 		"[" TblStates_Peer			"] BLOB,"
 		"[" TblStates_ChainWork		"] BLOB,"
@@ -341,6 +443,10 @@ void NodeDB::Create()
 		"[" TblSpendable_Unspent	"] INTEGER NOT NULL,"
 		"PRIMARY KEY (" TblSpendable_Key "))");
 
+	ExecQuick("CREATE TABLE [" TblSegments "] ("
+		"[" TblSegments_ID		"] INTEGER NOT NULL PRIMARY KEY,"
+		"[" TblSegments_Refs	"] INTEGER NOT NULL)");
+
 	ExecQuick("CREATE TABLE [" TblCompressed "] ("
 		"[" TblCompressed_Row1	"] INTEGER NOT NULL,"
 		"PRIMARY KEY (" TblCompressed_Row1 "),"
@@ -496,14 +602,29 @@ NodeDB::Transaction::~Transaction()
 void NodeDB::Transaction::Start(NodeDB& db)
 {
 	assert(!m_pDB);
-	db.ExecStep(Query::Begin, "BEGIN");
+	db.m_bStateCacheDirty = false;
+	if (db.m_bGroup)
+	{
+		db.ExecStep(Query::GroupMemberBegin, "SAVEPOINT GroupMember");
+		db.m_nBodySegmentsDeadMember = db.m_vBodySegmentsDead.size();
+		db.m_bGroupMember = true;
+	}
+	else
+		db.ExecStep(Query::Begin, "BEGIN");
 	m_pDB = &db;
 }
 
 void NodeDB::Transaction::Commit()
 {
 	assert(m_pDB);
-	m_pDB->ExecStep(Query::Commit, "COMMIT");
+	if (m_pDB->m_bGroup)
+	{
+		m_pDB->ExecStep(Query::GroupMemberRelease, "RELEASE GroupMember");
+		m_pDB->m_bGroupMember = false;
+		m_pDB->m_vSpendableUndo.clear();
+	}
+	else
+		m_pDB->CommitInternal();
 	m_pDB = NULL;
 }
 
@@ -511,15 +632,60 @@ void NodeDB::Transaction::Rollback()
 {
 	if (m_pDB)
 	{
-		try {
-			m_pDB->ExecStep(Query::Rollback, "ROLLBACK");
-		} catch (std::exception&) {
-			// TODO: DB is compromised!
-		}
+		m_pDB->RollbackInternal();
 		m_pDB = NULL;
 	}
 }
 
+void NodeDB::CommitInternal()
+{
+	FlushSpendable();
+	SyncBodies(); // the bodies must be durable before the DB references them
+	ExecStep(Query::Commit, "COMMIT");
+	OnBodiesCommitted();
+}
+
+void NodeDB::RollbackInternal()
+{
+	OnSpendableRolledBack();
+	m_bGroupMember = false;
+
+	if (m_bStateCacheDirty)
+		ResetStateCache(); // rowids of the inserted states may be reused, the active chain may differ
+
+	try {
+		if (m_bGroup)
+		{
+			ExecStep(Query::GroupMemberRollback, "ROLLBACK TO GroupMember");
+			ExecStep(Query::GroupMemberRelease, "RELEASE GroupMember");
+			OnBodiesRolledBack(m_nBodySegmentsDeadMember);
+		}
+		else
+		{
+			ExecStep(Query::Rollback, "ROLLBACK");
+			OnBodiesRolledBack(0);
+		}
+	} catch (std::exception&) {
+		// TODO: DB is compromised!
+	}
+}
+
+void NodeDB::BeginGroup()
+{
+	assert(!m_bGroup);
+	ExecStep(Query::Begin, "BEGIN");
+	m_bGroup = true;
+}
+
+void NodeDB::CommitGroup()
+{
+	if (m_bGroup)
+	{
+		CommitInternal();
+		m_bGroup = false;
+	}
+}
+
 #define StateCvt_Fields(macro, sep) \
 	macro(Height,		m_Height) sep \
 	macro(HashPrev,		m_Prev) sep \
@@ -529,12 +695,26 @@ void NodeDB::Transaction::Rollback()
 	macro(Definition,	m_Definition)
 
 #define THE_MACRO_NOP0
-#define THE_MACRO_COMMA_S ","
 
 void NodeDB::get_State(uint64_t rowid, Block::SystemState::Full& out)
 {
-#define THE_MACRO_1(dbname, extname) TblStates_##dbname
-	Recordset rs(*this, Query::StateGet, "SELECT " StateCvt_Fields(THE_MACRO_1, THE_MACRO_COMMA_S) " FROM " TblStates " WHERE rowid=?");
+	out = get_StateCached(rowid).m_State;
+}
+
+NodeDB::StateCacheEntry& NodeDB::get_StateCached(uint64_t rowid)
+{
+	assert(rowid);
+	if (m_vStateCache.empty())
+		m_vStateCache.resize(s_StateCacheSize);
+
+	StateCacheEntry& x = m_vStateCache[rowid % s_StateCacheSize];
+	if (x.m_Row == rowid)
+		return x;
+
+	x.m_Row = 0; // in case of exc
+
+#define THE_MACRO_1(dbname, extname) TblStates_##dbname ","
+	Recordset rs(*this, Query::StateGet, "SELECT " StateCvt_Fields(THE_MACRO_1, THE_MACRO_NOP0) TblStates_RowPrev " FROM " TblStates " WHERE rowid=?");
 #undef THE_MACRO_1
 
 	rs.put(0, rowid);
@@ -543,9 +723,26 @@ void NodeDB::get_State(uint64_t rowid, Block::SystemState::Full& out)
 
 	int iCol = 0;
 
-#define THE_MACRO_1(dbname, extname) rs.get(iCol++, out.extname);
+#define THE_MACRO_1(dbname, extname) rs.get(iCol++, x.m_State.extname);
 	StateCvt_Fields(THE_MACRO_1, THE_MACRO_NOP0)
 #undef THE_MACRO_1
+
+	if (rs.IsNull(iCol))
+		x.m_RowPrev = 0; // may be set later
+	else
+		rs.get(iCol, x.m_RowPrev);
+
+	x.m_Row = rowid;
+	return x;
+}
+
+void NodeDB::ResetStateCache()
+{
+	for (size_t i = 0; i < m_vStateCache.size(); i++)
+		m_vStateCache[i].m_Row = 0;
+
+	m_vActive.clear();
+	m_bStateCacheDirty = false;
 }
 
 uint64_t NodeDB::InsertState(const Block::SystemState::Full& s)
@@ -607,6 +804,7 @@ uint64_t NodeDB::InsertState(const Block::SystemState::Full& s)
 
 	uint64_t rowid = get_LastInsertRowID();
 	assert(rowid);
+	m_bStateCacheDirty = true;
 
 	if (rowPrev)
 	{
@@ -719,6 +917,16 @@ bool NodeDB::DeleteState(uint64_t rowid, uint64_t& rowPrev)
 	sid.m_Row = rowid;
 	DeleteMinedSafe(sid);
 
+	rs.Reset();
+	ReleaseStateBody(rowid);
+
+	if (!m_vStateCache.empty())
+	{
+		StateCacheEntry& x = m_vStateCache[rowid % s_StateCacheSize];
+		if (x.m_Row == rowid)
+			x.m_Row = 0; // the rowid may be reused
+	}
+
 	rs.Reset(Query::StateDel, "DELETE FROM " TblStates " WHERE rowid=?");
 	rs.put(0, rowid);
 
@@ -993,10 +1201,20 @@ bool NodeDB::get_Peer(uint64_t rowid, PeerID& peer)
 
 void NodeDB::SetStateBlock(uint64_t rowid, const Blob& body)
 {
-	Recordset rs(*this, Query::StateSetBlock, "UPDATE " TblStates " SET " TblStates_Body "=? WHERE rowid=?");
+	ReleaseStateBody(rowid); // if there was one
+
+	Recordset rs(*this, Query::StateSetBlock, "UPDATE " TblStates " SET " TblStates_BodySegment "=?," TblStates_BodyOffset "=?," TblStates_BodySize "=? WHERE rowid=?");
 	if (body.n)
-		rs.put(0, body);
-	rs.put(1, rowid);
+	{
+		uint64_t nSeg, nOffset;
+		BodyAppend(body, nSeg, nOffset);
+		BodySegmentAddRefs(nSeg, 1);
+
+		rs.put(0, nSeg);
+		rs.put(1, nOffset);
+		rs.put(2, body.n);
+	}
+	rs.put(3, rowid);
 
 	rs.Step();
 	TestChanged1Row();
@@ -1004,18 +1222,249 @@ void NodeDB::SetStateBlock(uint64_t rowid, const Blob& body)
 
 void NodeDB::GetStateBlock(uint64_t rowid, ByteBuffer& body, ByteBuffer& rollback)
 {
-	Recordset rs(*this, Query::StateGetBlock, "SELECT " TblStates_Body "," TblStates_Rollback " FROM " TblStates " WHERE rowid=?");
+	Recordset rs(*this, Query::StateGetBlock, "SELECT " TblStates_BodySegment "," TblStates_BodyOffset "," TblStates_BodySize "," TblStates_Rollback " FROM " TblStates " WHERE rowid=?");
 	rs.put(0, rowid);
 	rs.StepStrict();
 
 	if (!rs.IsNull(0))
 	{
-		rs.get(0, body);
-		if (!rs.IsNull(1))
-			rs.get(1, rollback);
+		uint64_t nSeg, nOffset;
+		uint32_t nSize;
+		rs.get(0, nSeg);
+		rs.get(1, nOffset);
+		rs.get(2, nSize);
+
+		BodyRead(nSeg, nOffset, nSize, body); // straight into the buffer, no intermediate copy
+
+		if (!rs.IsNull(3))
+			rs.get(3, rollback);
 	}
 }
 
+void NodeDB::ReleaseStateBody(uint64_t rowid)
+{
+	Recordset rs(*this, Query::StateGetBodySegment, "SELECT " TblStates_BodySegment " FROM " TblStates " WHERE rowid=?");
+	rs.put(0, rowid);
+	rs.StepStrict();
+
+	if (!rs.IsNull(0))
+	{
+		uint64_t nSeg;
+		rs.get(0, nSeg);
+		rs.Reset();
+
+		BodySegmentAddRefs(nSeg, -1);
+		BodySegmentTestDead(nSeg);
+	}
+}
+
+void NodeDB::BodyFile::Close()
+{
+	if (m_pF)
+	{
+		fclose(m_pF);
+		m_pF = NULL;
+	}
+	m_ID = 0;
+}
+
+void NodeDB::get_BodySegmentPath(std::string& s, uint64_t nSeg) const
+{
+	s = m_sBodyPath + std::to_string(nSeg);
+}
+
+static FILE* OpenBodySegment(const std::string& sPath, const char* szMode)
+{
+#ifdef WIN32
+	return _wfopen(Utf8toUtf16(sPath.c_str()).c_str(), Utf8toUtf16(szMode).c_str());
+#else // WIN32
+	return fopen(sPath.c_str(), szMode);
+#endif // WIN32
+}
+
+void NodeDB::OpenBodyWriter()
+{
+	m_BodyWriter.Close();
+
+	Recordset rs(*this, Query::SegmentGetLast, "SELECT MAX(" TblSegments_ID ") FROM " TblSegments);
+	rs.StepStrict();
+
+	if (rs.IsNull(0))
+		return; // will be created on demand
+
+	uint64_t nSeg;
+	rs.get(0, nSeg);
+
+	std::string sPath;
+	get_BodySegmentPath(sPath, nSeg);
+
+	m_BodyWriter.m_pF = OpenBodySegment(sPath, "r+b");
+	if (!m_BodyWriter.m_pF)
+		ThrowError("body segment missing");
+
+	m_BodyWriter.m_ID = nSeg;
+}
+
+void NodeDB::BodyAppend(const Blob& body, uint64_t& nSeg, uint64_t& nOffset)
+{
+	if (m_BodyWriter.m_pF)
+	{
+		if (fseek(m_BodyWriter.m_pF, 0, SEEK_END))
+			ThrowError("body seek");
+
+		nOffset = ftell(m_BodyWriter.m_pF);
+
+		if (nOffset >= m_BodySegmentSize)
+		{
+			// start a new one. The current one is synced regardless of the profile, it won't be touched anymore
+			SyncBodyWriter();
+
+			nSeg = m_BodyWriter.m_ID;
+			m_BodyWriter.Close();
+			BodySegmentTestDead(nSeg);
+		}
+	}
+
+	if (!m_BodyWriter.m_pF)
+	{
+		Recordset rs(*this, Query::SegmentIns, "INSERT INTO " TblSegments " (" TblSegments_Refs ") VALUES(0)");
+		rs.Step();
+		TestChanged1Row();
+
+		nSeg = get_LastInsertRowID();
+
+		std::string sPath;
+		get_BodySegmentPath(sPath, nSeg);
+
+		m_BodyWriter.m_pF = OpenBodySegment(sPath, "w+b"); // if there's a leftover (from rolled-back transaction) - it's truncated
+		if (!m_BodyWriter.m_pF)
+			ThrowError("body segment create");
+
+		m_BodyWriter.m_ID = nSeg;
+		nOffset = 0;
+	}
+
+	m_bBodyUnsynced = true;
+
+	if ((fwrite(body.p, 1, body.n, m_BodyWriter.m_pF) != body.n) || fflush(m_BodyWriter.m_pF))
+		ThrowError("body write");
+
+	if (sqlite3_get_autocommit(m_pDb))
+		SyncBodies(); // no transaction, the DB is updated immediately
+
+	nSeg = m_BodyWriter.m_ID;
+}
+
+void NodeDB::BodyRead(uint64_t nSeg, uint64_t nOffset, uint32_t nSize, ByteBuffer& body)
+{
+	BodyFile* pFile = &m_BodyWriter;
+	if (m_BodyWriter.m_ID != nSeg)
+	{
+		pFile = &m_BodyReader;
+		if (m_BodyReader.m_ID != nSeg)
+		{
+			m_BodyReader.Close();
+
+			std::string sPath;
+			get_BodySegmentPath(sPath, nSeg);
+
+			m_BodyReader.m_pF = OpenBodySegment(sPath, "rb");
+			if (!m_BodyReader.m_pF)
+				ThrowError("body segment missing");
+
+			m_BodyReader.m_ID = nSeg;
+		}
+	}
+
+	body.resize(nSize);
+
+	if (nSize && (fseek(pFile->m_pF, (long) nOffset, SEEK_SET) || (fread(&body.front(), 1, nSize, pFile->m_pF) != nSize)))
+		ThrowError("body read");
+}
+
+void NodeDB::BodySegmentAddRefs(uint64_t nSeg, int32_t nDelta)
+{
+	Recordset rs(*this, Query::SegmentAddRefs, "UPDATE " TblSegments " SET " TblSegments_Refs "=" TblSegments_Refs "+? WHERE " TblSegments_ID "=?");
+	rs.put(0, (uint32_t) nDelta);
+	rs.put(1, nSeg);
+	rs.Step();
+	TestChanged1Row();
+}
+
+void NodeDB::BodySegmentTestDead(uint64_t nSeg)
+{
+	if (m_BodyWriter.m_ID == nSeg)
+		return; // still appended
+
+	Recordset rs(*this, Query::SegmentGetRefs, "SELECT " TblSegments_Refs " FROM " TblSegments " WHERE " TblSegments_ID "=?");
+	rs.put(0, nSeg);
+	rs.StepStrict();
+
+	uint32_t nRefs;
+	rs.get(0, nRefs);
+	if (nRefs)
+		return;
+
+	rs.Reset(Query::SegmentDel, "DELETE FROM " TblSegments " WHERE " TblSegments_ID "=?");
+	rs.put(0, nSeg);
+	rs.Step();
+	TestChanged1Row();
+
+	if (m_BodyReader.m_ID == nSeg)
+		m_BodyReader.Close();
+
+	if (sqlite3_get_autocommit(m_pDb))
+		DeleteBodySegment(nSeg);
+	else
+		m_vBodySegmentsDead.push_back(nSeg); // not before the commit
+}
+
+void NodeDB::DeleteBodySegment(uint64_t nSeg)
+{
+	std::string sPath;
+	get_BodySegmentPath(sPath, nSeg);
+	DeleteFile(sPath.c_str());
+}
+
+void NodeDB::SyncBodies()
+{
+	if (!m_bBodyUnsynced || (Profile::Sync == m_Profile))
+		return;
+
+	SyncBodyWriter();
+}
+
+void NodeDB::SyncBodyWriter()
+{
+	if (m_BodyWriter.m_pF)
+	{
+#ifdef WIN32
+		int nRet = _commit(_fileno(m_BodyWriter.m_pF));
+#else // WIN32
+		int nRet = fsync(fileno(m_BodyWriter.m_pF));
+#endif // WIN32
+		if (nRet)
+			ThrowError("body sync");
+	}
+
+	m_bBodyUnsynced = false;
+}
+
+void NodeDB::OnBodiesCommitted()
+{
+	for (size_t i = 0; i < m_vBodySegmentsDead.size(); i++)
+		DeleteBodySegment(m_vBodySegmentsDead[i]);
+
+	m_vBodySegmentsDead.clear();
+}
+
+void NodeDB::OnBodiesRolledBack(size_t nBodySegmentsDead)
+{
+	m_vBodySegmentsDead.resize(nBodySegmentsDead);
+	m_BodyReader.Close();
+	OpenBodyWriter(); // the segment might have been created within the transaction
+}
+
 void NodeDB::SetStateRollback(uint64_t rowid, const Blob& rollback)
 {
 	Recordset rs(*this, Query::StateSetRollback, "UPDATE " TblStates " SET " TblStates_Rollback "=? WHERE rowid=?");
@@ -1243,7 +1692,14 @@ bool NodeDB::WalkerState::MoveNext()
 
 bool NodeDB::get_Prev(uint64_t& rowid)
 {
-	assert(rowid);
+	StateCacheEntry& x = get_StateCached(rowid);
+	if (x.m_RowPrev)
+	{
+		rowid = x.m_RowPrev;
+		return true;
+	}
+
+	// the prev could have been inserted after the state was cached
 	Recordset rs(*this, Query::StateGetPrev, "SELECT " TblStates_RowPrev " FROM " TblStates " WHERE rowid=?");
 	rs.put(0, rowid);
 
@@ -1253,9 +1709,34 @@ bool NodeDB::get_Prev(uint64_t& rowid)
 		return false;
 
 	rs.get(0, rowid);
+	x.m_RowPrev = rowid;
 	return true;
 }
 
+uint64_t NodeDB::FindActiveStateStrict(Height h)
+{
+	assert(h >= Rules::HeightGenesis);
+	size_t i = h - Rules::HeightGenesis;
+	if ((i < m_vActive.size()) && m_vActive[i])
+		return m_vActive[i];
+
+	Recordset rs(*this, Query::StateFindActive, "SELECT rowid FROM " TblStates " WHERE " TblStates_Height "=? AND (" TblStates_Flags " & ?)");
+	rs.put(0, h);
+	rs.put(1, StateFlags::Active);
+
+	rs.StepStrict();
+
+	uint64_t rowid;
+	rs.get(0, rowid);
+
+	// the found state is at or below the cursor, hence the array may be extended
+	if (i >= m_vActive.size())
+		m_vActive.resize(i + 1);
+	m_vActive[i] = rowid;
+
+	return rowid;
+}
+
 bool NodeDB::get_Prev(StateID& sid)
 {
 	if (!get_Prev(sid.m_Row))
@@ -1278,6 +1759,17 @@ bool NodeDB::get_Cursor(StateID& sid)
 	return true;
 }
 
+Height NodeDB::get_HeightMax()
+{
+	Recordset rs(*this, Query::StateGetHeightMax, "SELECT MAX(" TblStates_Height ") FROM " TblStates);
+	rs.StepStrict();
+
+	Height h = 0;
+	if (!rs.IsNull(0))
+		rs.get(0, h);
+	return h;
+}
+
 void NodeDB::put_Cursor(const StateID& sid)
 {
 	ParamSet(ParamID::CursorRow, &sid.m_Row, NULL);
@@ -1298,6 +1790,9 @@ void NodeDB::MoveBack(StateID& sid)
 	rs.Step();
 	TestChanged1Row();
 
+	m_bStateCacheDirty = true;
+	m_vActive.resize(std::min(m_vActive.size(), size_t(sid.m_Height - Rules::HeightGenesis)));
+
 	if (!get_Prev(sid))
 		sid.SetNull();
 
@@ -1312,6 +1807,10 @@ void NodeDB::MoveFwd(const StateID& sid)
 	rs.Step();
 	TestChanged1Row();
 
+	m_bStateCacheDirty = true;
+	m_vActive.resize(sid.m_Height - Rules::HeightGenesis + 1);
+	m_vActive.back() = sid.m_Row;
+
 	put_Cursor(sid);
 }
 
@@ -1439,6 +1938,7 @@ void NodeDB::get_PredictedStatesHash(Merkle::Hash& hv, const StateID& sid)
 
 void NodeDB::EnumUnpsent(WalkerSpendable& x)
 {
+	FlushSpendable();
 	x.m_Rs.Reset(Query::SpendableEnum, "SELECT " TblSpendable_Key "," TblSpendable_Unspent " FROM " TblSpendable " WHERE " TblSpendable_Unspent "!=0");
 }
 
@@ -1455,19 +1955,119 @@ bool NodeDB::WalkerSpendable::MoveNext()
 void NodeDB::AddSpendable(const Blob& key, const Blob* pBody, uint32_t nRefs, uint32_t nUnspentCount)
 {
 	assert(nRefs > 0);
+	CacheSpendable(key, pBody, true, nRefs, nUnspentCount);
+}
 
-	ModifySpendableSafe(key, nRefs, nUnspentCount);
+void NodeDB::CacheSpendable(const Blob& key, const Blob* pBody, bool bAdd, int32_t nRefsDelta, int32_t nUnspentDelta)
+{
+	ByteBuffer bbKey;
+	key.Export(bbKey);
 
-	if (!get_RowsChanged())
+	SpendableCache::iterator it = m_SpendableCache.lower_bound(bbKey);
+	if ((m_SpendableCache.end() == it) || (it->first != bbKey))
+		it = m_SpendableCache.emplace_hint(it, std::move(bbKey), SpendableDelta());
+
+	SpendableDelta& d = it->second;
+	d.m_Refs += nRefsDelta;
+	d.m_Unspent += nUnspentDelta;
+
+	if (m_bGroupMember)
 	{
-		Recordset rs(*this, Query::SpendableAdd, "INSERT INTO " TblSpendable "(" TblSpendable_Key "," TblSpendable_Body "," TblSpendable_Refs "," TblSpendable_Unspent ") VALUES(?,?,?,?)");
-		rs.put(0, key);
-		if (pBody)
-			rs.put(1, *pBody);
-		rs.put(2, nRefs);
-		rs.put(3, nUnspentCount);
-		rs.Step();
+		m_vSpendableUndo.emplace_back();
+		SpendableUndo& u = m_vSpendableUndo.back();
+
+		u.m_it = it;
+		u.m_Refs = nRefsDelta;
+		u.m_Unspent = nUnspentDelta;
+		u.m_bAdd = bAdd && !d.m_bAdd;
+		u.m_bBody = pBody && !d.m_bBody;
+	}
+
+	if (bAdd)
+		d.m_bAdd = true;
+
+	if (pBody && !d.m_bBody)
+	{
+		d.m_bBody = true;
+		pBody->Export(d.m_Body);
 	}
+
+	if (sqlite3_get_autocommit(m_pDb))
+		FlushSpendable(); // no transaction
+	else
+		if (!m_bGroupMember && (m_SpendableCache.size() > s_SpendableCacheMax))
+			FlushSpendable();
+}
+
+void NodeDB::FlushSpendable()
+{
+	assert(!m_bGroupMember); // otherwise the savepoint would include the changes of the previous members
+
+	for (SpendableCache::iterator it = m_SpendableCache.begin(); m_SpendableCache.end() != it; it++)
+	{
+		const SpendableDelta& d = it->second;
+		if (!d.m_Refs && !d.m_Unspent)
+			continue; // cancelled out
+
+		Blob key(it->first);
+		ModifySpendableSafe(key, d.m_Refs, d.m_Unspent);
+
+		if (get_RowsChanged())
+		{
+			if (d.m_Refs < 0)
+			{
+				Recordset rs(*this, Query::SpendableDel, "DELETE FROM " TblSpendable " WHERE " TblSpendable_Key "=? AND " TblSpendable_Refs "=0");
+				rs.put(0, key);
+				rs.Step();
+			}
+		}
+		else
+		{
+			if (!d.m_bAdd || (d.m_Refs <= 0))
+				ThrowInconsistent();
+
+			Recordset rs(*this, Query::SpendableAdd, "INSERT INTO " TblSpendable "(" TblSpendable_Key "," TblSpendable_Body "," TblSpendable_Refs "," TblSpendable_Unspent ") VALUES(?,?,?,?)");
+			rs.put(0, key);
+			if (d.m_bBody)
+				rs.put(1, Blob(d.m_Body));
+			rs.put(2, (uint32_t) d.m_Refs);
+			rs.put(3, (uint32_t) d.m_Unspent);
+			rs.Step();
+		}
+	}
+
+	m_SpendableCache.clear();
+	m_vSpendableUndo.clear();
+}
+
+void NodeDB::OnSpendableRolledBack()
+{
+	if (!m_bGroupMember)
+	{
+		m_SpendableCache.clear(); // the whole transaction is rolled back
+		m_vSpendableUndo.clear();
+		return;
+	}
+
+	for (size_t i = m_vSpendableUndo.size(); i--; )
+	{
+		const SpendableUndo& u = m_vSpendableUndo[i];
+		SpendableDelta& d = u.m_it->second;
+
+		d.m_Refs -= u.m_Refs;
+		d.m_Unspent -= u.m_Unspent;
+
+		if (u.m_bAdd)
+			d.m_bAdd = false;
+
+		if (u.m_bBody)
+		{
+			d.m_bBody = false;
+			d.m_Body.clear();
+		}
+	}
+
+	m_vSpendableUndo.clear();
 }
 
 void NodeDB::ModifySpendableSafe(const Blob& key, int32_t nRefsDelta, int32_t nUnspentDelta)
@@ -1483,23 +2083,37 @@ void NodeDB::ModifySpendableSafe(const Blob& key, int32_t nRefsDelta, int32_t nU
 
 void NodeDB::ModifySpendable(const Blob& key, int32_t nRefsDelta, int32_t nUnspentDelta)
 {
-	ModifySpendableSafe(key, nRefsDelta, nUnspentDelta);
-	TestChanged1Row();
-
-	if (nRefsDelta < 0)
-	{
-		Recordset rs(*this, Query::SpendableDel, "DELETE FROM " TblSpendable " WHERE " TblSpendable_Key "=? AND " TblSpendable_Refs "=0");
-		rs.put(0, key);
-		rs.Step();
-	}
+	CacheSpendable(key, NULL, false, nRefsDelta, nUnspentDelta);
 }
 
 bool NodeDB::GetSpendableBody(const Blob& key, Blob& out)
 {
+	ByteBuffer bbKey;
+	key.Export(bbKey);
+
+	SpendableCache::const_iterator it = m_SpendableCache.find(bbKey);
+	if ((m_SpendableCache.end() != it) && it->second.m_bAdd && (it->second.m_Refs > 0) && it->second.m_bBody)
+	{
+		// pending insertion with the body. If the element is already in the DB - it has the same body anyway
+		const SpendableDelta& d = it->second;
+
+		if (d.m_Body.size() != out.n)
+			ThrowInconsistent();
+
+		memcpy((void*) out.p, &d.m_Body.front(), out.n);
+		return true;
+	}
+
 	Recordset rs(*this, Query::SpendableGetBody, "SELECT " TblSpendable_Body " FROM " TblSpendable " WHERE " TblSpendable_Key "=?");
 	rs.put(0, key);
 
-	rs.StepStrict();
+	if (!rs.Step())
+	{
+		// not in the DB yet, unless it's a pending insertion (without the body)
+		if ((m_SpendableCache.end() == it) || !it->second.m_bAdd || (it->second.m_Refs <= 0))
+			ThrowError("not found");
+		return false;
+	}
 
 	if (rs.IsNull(0))
 		return false;
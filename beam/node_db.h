@@ -53,6 +53,9 @@ public:
 			Begin,
 			Commit,
 			Rollback,
+			GroupMemberBegin,
+			GroupMemberRelease,
+			GroupMemberRollback,
 			Scheme,
 			ParamGet,
 			ParamIns,
@@ -101,6 +104,14 @@ public:
 			StateSetBlock,
 			StateDelBlock,
 			StateSetRollback,
+			StateGetBodySegment,
+			SegmentIns,
+			SegmentDel,
+			SegmentAddRefs,
+			SegmentGetRefs,
+			SegmentGetLast,
+			StateGetHeightMax,
+			StateFindActive,
 			MinedIns,
 			MinedUpd,
 			MinedDel,
@@ -134,6 +145,29 @@ public:
 	void Close();
 	void Open(const char* szPath);
 
+	// Block bodies are appended to the segment files (next to the DB file), the DB keeps only their positions.
+	// A new segment is started once the current one exceeds this size. Can be changed before Open().
+	uint32_t m_BodySegmentSize;
+
+	// Durability vs performance of the storage
+	struct Profile
+	{
+		enum Enum {
+			Default, // SQLite defaults: rollback journal, full sync on each commit
+			Safe, // WAL, full sync on each commit, moderate cache. Survives power loss
+			Sync, // WAL, no sync, large cache and mmap. Survives process crash, but not power loss. For the initial sync
+
+			count
+		};
+
+		static const char* get_Name(Enum);
+		static bool FromName(Enum&, const char*);
+	};
+
+	// Can be set before Open(), or switched at any time outside of a transaction
+	void set_Profile(Profile::Enum);
+	Profile::Enum get_Profile() const { return m_Profile; }
+
 	struct Blob {
 		const void* p;
 		uint32_t n;
@@ -206,6 +240,12 @@ public:
 		void Rollback();
 	};
 
+	// Group commit. While the group is open, transactions are savepoints within the DB transaction, all of them are committed at once by CommitGroup().
+	// Rollback of a transaction within the group affects only its own changes.
+	void BeginGroup();
+	void CommitGroup(); // no-op if there's no group
+	bool IsGroupOpen() const { return m_bGroup; }
+
 	// Hi-level functions
 
 	void ParamSet(uint32_t ID, const uint64_t*, const Blob*);
@@ -216,7 +256,7 @@ public:
 	uint64_t InsertState(const Block::SystemState::Full&); // Fails if state already exists
 
 	uint64_t StateFindSafe(const Block::SystemState::ID&);
-	void get_State(uint64_t rowid, Block::SystemState::Full&);
+	void get_State(uint64_t rowid, Block::SystemState::Full&); // cached
 	void get_StateHash(uint64_t rowid, Merkle::Hash&);
 
 	bool DeleteState(uint64_t rowid, uint64_t& rowPrev); // State must exist. Returns false if there are ancestors.
@@ -258,9 +298,11 @@ public:
 	void EnumStatesAt(WalkerState&, Height);
 	void EnumAncestors(WalkerState&, const StateID&);
 	bool get_Prev(StateID&);
-	bool get_Prev(uint64_t&);
+	bool get_Prev(uint64_t&); // cached
 
 	bool get_Cursor(StateID& sid);
+	Height get_HeightMax(); // of all the known states, 0 if none
+	uint64_t FindActiveStateStrict(Height); // cached
 
     void get_Proof(Merkle::IProofBuilder&, const StateID& sid, Height hPrev);
     void get_PredictedStatesHash(Merkle::Hash&, const StateID& sid); // For the next block.
@@ -284,6 +326,7 @@ public:
 
 	void EnumUnpsent(WalkerSpendable&);
 
+	// Within a transaction the changes are cached (merged per key, the opposite ones cancel out), and written in key order on commit.
 	void AddSpendable(const Blob& key, const Blob* pBody, uint32_t nRefs, uint32_t nUnspentCount);
 	void ModifySpendable(const Blob& key, int32_t nRefsDelta, int32_t nUnspentDelta); // will delete iff refs=0
 	bool GetSpendableBody(const Blob& key, Blob&);
@@ -379,9 +422,95 @@ private:
 	void put_Cursor(const StateID& sid); // jump
 	void ModifySpendableSafe(const Blob& key, int32_t nRefsDelta, int32_t nUnspentDelta);
 
+	struct SpendableDelta
+	{
+		int32_t m_Refs = 0;
+		int32_t m_Unspent = 0;
+		bool m_bAdd = false; // should be inserted if not exists
+		bool m_bBody = false;
+		ByteBuffer m_Body;
+	};
+
+	typedef std::map<ByteBuffer, SpendableDelta> SpendableCache; // same order as the DB index
+	SpendableCache m_SpendableCache;
+
+	// changes within the current group member, to undo them on its rollback
+	struct SpendableUndo
+	{
+		SpendableCache::iterator m_it;
+		int32_t m_Refs;
+		int32_t m_Unspent;
+		bool m_bAdd; // was set by this change
+		bool m_bBody; // was set by this change
+	};
+
+	std::vector<SpendableUndo> m_vSpendableUndo;
+
+	static const size_t s_SpendableCacheMax = 0x10000; // flushed earlier if possible, to limit the memory consumption
+
+	// Headers cache. The headers are immutable, cached by rowid (direct-mapped), along with the prev row once it's known.
+	struct StateCacheEntry
+	{
+		uint64_t m_Row = 0;
+		uint64_t m_RowPrev;
+		Block::SystemState::Full m_State;
+	};
+
+	static const uint32_t s_StateCacheSize = 0x1000;
+	std::vector<StateCacheEntry> m_vStateCache;
+
+	std::vector<uint64_t> m_vActive; // active states by height (starting from genesis), up to the cursor. 0 - not cached yet
+	bool m_bStateCacheDirty; // states were inserted or the cursor moved within the current transaction. On rollback the caches are reset
+
+	StateCacheEntry& get_StateCached(uint64_t rowid);
+	void ResetStateCache();
+
+	void CacheSpendable(const Blob& key, const Blob* pBody, bool bAdd, int32_t nRefsDelta, int32_t nUnspentDelta);
+	void FlushSpendable(); // not within a group member
+	void OnSpendableRolledBack();
+
 	void TestChanged1Row();
 
 	struct Dmmr;
+
+	// Block body segments. A segment is deleted (after the commit) once all its bodies are deleted, except the last one, which is being appended.
+	struct BodyFile
+	{
+		FILE* m_pF;
+		uint64_t m_ID;
+
+		BodyFile() :m_pF(NULL), m_ID(0) {}
+		~BodyFile() { Close(); }
+		void Close();
+	};
+
+	std::string m_sBodyPath; // segment file name prefix
+	BodyFile m_BodyWriter;
+	BodyFile m_BodyReader; // last read segment, if it's not the one being appended
+	bool m_bBodyUnsynced;
+	std::vector<uint64_t> m_vBodySegmentsDead;
+	Profile::Enum m_Profile;
+	bool m_bGroup;
+	bool m_bGroupMember;
+	size_t m_nBodySegmentsDeadMember; // at the beginning of the current group member
+
+	void CommitInternal();
+	void RollbackInternal();
+
+	void ApplyProfile();
+
+	void get_BodySegmentPath(std::string&, uint64_t nSeg) const;
+	void OpenBodyWriter();
+	void BodyAppend(const Blob&, uint64_t& nSeg, uint64_t& nOffset);
+	void BodyRead(uint64_t nSeg, uint64_t nOffset, uint32_t nSize, ByteBuffer&);
+	void BodySegmentAddRefs(uint64_t nSeg, int32_t nDelta);
+	void BodySegmentTestDead(uint64_t nSeg);
+	void ReleaseStateBody(uint64_t rowid);
+	void DeleteBodySegment(uint64_t nSeg);
+	void SyncBodies(); // before commit, unless the profile says otherwise
+	void SyncBodyWriter();
+	void OnBodiesCommitted();
+	void OnBodiesRolledBack(size_t nBodySegmentsDead);
 };
 
 
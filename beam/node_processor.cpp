@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <chrono>
 #include "node_processor.h"
 #include "../utility/serialize.h"
 #include "../core/serialization_adapters.h"
@@ -25,6 +26,25 @@ void NodeProcessor::OnCorrupted()
 	throw std::runtime_error("node data corrupted");
 }
 
+struct NodeProcessor::PerfScope
+{
+	uint64_t* m_pVal;
+	std::chrono::steady_clock::time_point m_Start;
+
+	PerfScope(PerfStats* p, uint64_t PerfStats::* pMember)
+		:m_pVal(p ? &(p->*pMember) : NULL)
+	{
+		if (m_pVal)
+			m_Start = std::chrono::steady_clock::now();
+	}
+
+	~PerfScope()
+	{
+		if (m_pVal)
+			*m_pVal += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_Start).count();
+	}
+};
+
 NodeProcessor::Horizon::Horizon()
 	:m_Branching(-1)
 	,m_Schwarzschild(-1)
@@ -93,6 +113,15 @@ bool NodeProcessor::UnspentWalker::Traverse()
 	return true;
 }
 
+NodeProcessor::~NodeProcessor()
+{
+	try {
+		FlushGroupCommit();
+	} catch (const std::exception& e) {
+		LOG_ERROR() << "Group commit failed: " << e.what();
+	}
+}
+
 void NodeProcessor::Initialize(const char* szPath)
 {
 	m_DB.Open(szPath);
@@ -115,11 +144,19 @@ void NodeProcessor::Initialize(const char* szPath)
 
 	InitCursor();
 
-	if (!m_Cursor.m_SubsidyOpen)
-		OnSubsidyOptionChanged(m_Cursor.m_SubsidyOpen);
+	if (m_Snapshot.m_sPath.empty())
+		m_Snapshot.m_sPath = std::string(szPath) + ".snapshot";
 
-	// Load all the 'live' data
+	if (LoadSnapshot())
 	{
+		LOG_INFO() << "Live data loaded from the snapshot";
+	}
+	else
+	{
+		if (!m_Cursor.m_SubsidyOpen)
+			OnSubsidyOptionChanged(m_Cursor.m_SubsidyOpen);
+
+		// Load all the 'live' data
 		struct Walker
 			:public UnspentWalker
 		{
@@ -158,6 +195,150 @@ void NodeProcessor::Initialize(const char* szPath)
 	NodeDB::Transaction t(m_DB);
 	TryGoUp();
 	t.Commit();
+
+	OnCommitted();
+}
+
+struct NodeProcessor::SnapshotStream
+	:public RadixHashTree::IStream
+{
+	std::FStream m_F;
+	ECC::Hash::Processor m_Hp; // all the data is hashed, the hash is appended
+
+	struct Header
+	{
+		static const uint32_t s_Version = 1;
+
+		char m_szSig[8];
+		uint32_t m_Version;
+		uint32_t m_Reserved;
+		Merkle::Hash m_hvRules;
+		Block::SystemState::ID m_ID; // cursor
+
+		void Init(const Block::SystemState::ID& id)
+		{
+			ZeroObject(*this);
+			strcpy(m_szSig, "BeamSnp");
+			m_Version = s_Version;
+			m_hvRules = Rules::get().Checksum;
+			m_ID = id;
+		}
+	};
+
+	virtual void Write(const void* p, uint32_t n) override
+	{
+		m_F.write(p, n);
+		m_Hp.Write(p, n);
+	}
+
+	virtual void Read(void* p, uint32_t n) override
+	{
+		m_F.read(p, n);
+		m_Hp.Write(p, n);
+	}
+};
+
+bool NodeProcessor::LoadSnapshot()
+{
+	if (!m_Cursor.m_Sid.m_Row)
+		return false;
+
+	SnapshotStream s;
+	if (!s.m_F.Open(m_Snapshot.m_sPath.c_str(), true))
+		return false;
+
+	try
+	{
+		SnapshotStream::Header hdr, hdrMy;
+		s.Read(&hdr, sizeof(hdr));
+
+		hdrMy.Init(m_Cursor.m_ID);
+		if (memcmp(&hdr, &hdrMy, sizeof(hdr)))
+		{
+			LOG_INFO() << "Snapshot is outdated";
+			return false;
+		}
+
+		m_Utxos.LoadSnapshot(s);
+		m_Kernels.LoadSnapshot(s);
+
+		Merkle::Hash hv, hvFile;
+		s.m_Hp >> hv;
+		s.m_F.read(hvFile.m_pData, hvFile.nBytes);
+
+		if ((hv == hvFile) && !s.m_F.get_Remaining())
+		{
+			// The joint hashes are trusted once the integrity check passes. Still, the result must match the state definition
+			get_Definition(hv, false);
+			if (hv == m_Cursor.m_Full.m_Definition)
+			{
+				m_Snapshot.m_hLast = m_Cursor.m_ID.m_Height;
+				return true;
+			}
+		}
+
+		LOG_WARNING() << "Snapshot is corrupted";
+	}
+	catch (const std::exception& e)
+	{
+		LOG_WARNING() << "Snapshot load failed: " << e.what();
+	}
+
+	m_Utxos.Clear();
+	m_Kernels.Clear();
+	return false;
+}
+
+void NodeProcessor::SaveSnapshot()
+{
+	if (!m_Cursor.m_Sid.m_Row)
+		return;
+
+	// Write to a temp file and rename, so that the previous snapshot is either replaced or left intact
+	std::string sTmp = m_Snapshot.m_sPath + ".tmp";
+
+	try
+	{
+		SnapshotStream s;
+		s.m_F.Open(sTmp.c_str(), false, true);
+
+		SnapshotStream::Header hdr;
+		hdr.Init(m_Cursor.m_ID);
+		s.Write(&hdr, sizeof(hdr));
+
+		m_Utxos.SaveSnapshot(s);
+		m_Kernels.SaveSnapshot(s);
+
+		Merkle::Hash hv;
+		s.m_Hp >> hv;
+		s.m_F.write(hv.m_pData, hv.nBytes);
+		s.m_F.Close();
+	}
+	catch (const std::exception& e)
+	{
+		LOG_WARNING() << "Snapshot save failed: " << e.what();
+		remove(sTmp.c_str());
+		return;
+	}
+
+#ifdef WIN32
+	remove(m_Snapshot.m_sPath.c_str()); // rename doesn't overwrite
+#endif // WIN32
+
+	if (rename(sTmp.c_str(), m_Snapshot.m_sPath.c_str()))
+	{
+		remove(sTmp.c_str());
+		return;
+	}
+
+	m_Snapshot.m_hLast = m_Cursor.m_ID.m_Height;
+	LOG_INFO() << "Snapshot saved at " << m_Cursor.m_ID;
+}
+
+void NodeProcessor::OnCommitted()
+{
+	if (m_Snapshot.m_Period && (m_Cursor.m_ID.m_Height >= m_Snapshot.m_hLast + m_Snapshot.m_Period))
+		SaveSnapshot();
 }
 
 void NodeProcessor::InitCursor()
@@ -186,6 +367,9 @@ void NodeProcessor::EnumCongestions()
 {
 	Height hThreshold = get_LoHorizon();
 
+	// the lowest unreachable states above the first missing block (cyclic)
+	std::vector<NodeDB::StateID> vAhead(m_RequestBlocksAhead ? (m_RequestBlocksAhead - 1) : 0);
+
 	// request all potentially missing data
 	NodeDB::WalkerState ws(m_DB);
 	for (m_DB.EnumTips(ws); ws.MoveNext(); )
@@ -201,6 +385,7 @@ void NodeProcessor::EnumCongestions()
 			continue; // not interested in tips behind the current cursor
 
 		bool bBlock = true;
+		size_t nAhead = 0;
 
 		while (sid.m_Height > Rules::HeightGenesis)
 		{
@@ -216,6 +401,9 @@ void NodeProcessor::EnumCongestions()
 				sid = sidThis;
 				break;
 			}
+
+			if (!vAhead.empty())
+				vAhead[nAhead++ % vAhead.size()] = sidThis;
 		}
 
 		Block::SystemState::ID id;
@@ -237,6 +425,23 @@ void NodeProcessor::EnumCongestions()
 			bool bPeer = m_DB.get_Peer(sid.m_Row, peer);
 
 			RequestData(id, bBlock, bPeer ? &peer : NULL);
+
+			if (bBlock)
+			{
+				// the following blocks, from the lowest (the most recently visited state), those not received yet
+				size_t n = std::min(nAhead, vAhead.size());
+				for (size_t i = 0; i < n; i++)
+				{
+					const NodeDB::StateID& sidNext = vAhead[(nAhead - i - 1) % vAhead.size()];
+					if (NodeDB::StateFlags::Functional & m_DB.GetStateFlags(sidNext.m_Row))
+						continue;
+
+					m_DB.get_StateID(sidNext, id);
+					bPeer = m_DB.get_Peer(sidNext.m_Row, peer);
+
+					RequestData(id, true, bPeer ? &peer : NULL);
+				}
+			}
 		}
 		else
 		{
@@ -449,6 +654,7 @@ bool NodeProcessor::HandleBlock(const NodeDB::StateID& sid, bool bFwd)
 
 	Block::Body block;
 	try {
+		PerfScope ps(m_pPerfStats, &PerfStats::m_Deserialize_us);
 
 		Deserializer der;
 		der.reset(bb.empty() ? NULL : &bb.at(0), bb.size());
@@ -496,7 +702,13 @@ bool NodeProcessor::HandleBlock(const NodeDB::StateID& sid, bool bFwd)
 				return false;
 			}
 
-			if (!VerifyBlock(block, block.get_Reader(), sid.m_Height))
+			bool bValid;
+			{
+				PerfScope ps(m_pPerfStats, &PerfStats::m_Verify_us);
+				bValid = VerifyBlock(block, block.get_Reader(), sid.m_Height);
+			}
+
+			if (!bValid)
 			{
 				LOG_WARNING() << id << " context-free verification failed";
 				return false;
@@ -506,7 +718,12 @@ bool NodeProcessor::HandleBlock(const NodeDB::StateID& sid, bool bFwd)
 		assert(!rbData.m_Buf.empty());
 
 
-	bool bOk = HandleValidatedTx(block.get_Reader(), sid.m_Height, bFwd, rbData);
+	bool bOk;
+	{
+		PerfScope ps(m_pPerfStats, &PerfStats::m_Apply_us);
+		bOk = HandleValidatedTx(block.get_Reader(), sid.m_Height, bFwd, rbData);
+	}
+
 	if (!bOk)
 		LOG_WARNING() << id << " invalid in its context";
 
@@ -748,7 +965,8 @@ bool NodeProcessor::HandleBlockElement(const Input& v, Height h, const Height* p
 		}
 	}
 
-	m_DB.ModifySpendable(NodeDB::Blob(&skey, sizeof(skey)), 0, bFwd ? -1 : 1);
+	if (!m_bSpeculative)
+		m_DB.ModifySpendable(NodeDB::Blob(&skey, sizeof(skey)), 0, bFwd ? -1 : 1);
 	return true;
 }
 
@@ -802,7 +1020,8 @@ bool NodeProcessor::HandleBlockElement(const Output& v, Height h, const Height*
 		if (bCreate)
 		{
 			p->m_Value.m_Count = 1;
-			m_DB.AddSpendable(blob, NULL, 1, 1);
+			if (!m_bSpeculative)
+				m_DB.AddSpendable(blob, NULL, 1, 1);
 		}
 		else
 		{
@@ -812,7 +1031,8 @@ bool NodeProcessor::HandleBlockElement(const Output& v, Height h, const Height*
 				return false;
 
 			p->m_Value.m_Count = nCountInc;
-			m_DB.ModifySpendable(blob, 1, 1);
+			if (!m_bSpeculative)
+				m_DB.ModifySpendable(blob, 1, 1);
 		}
 	} else
 	{
@@ -821,7 +1041,8 @@ bool NodeProcessor::HandleBlockElement(const Output& v, Height h, const Height*
 		else
 			p->m_Value.m_Count--;
 
-		m_DB.ModifySpendable(blob, -1, -1);
+		if (!m_bSpeculative)
+			m_DB.ModifySpendable(blob, -1, -1);
 	}
 
 	return true;
@@ -865,6 +1086,9 @@ bool NodeProcessor::HandleBlockElement(const TxKernel& v, bool bFwd, bool bIsInp
 		m_Kernels.Delete(cu);
 	}
 
+	if (m_bSpeculative)
+		return true;
+
 	NodeDB::Blob blob(&skey, sizeof(skey));
 
 	if (bIsInput)
@@ -975,20 +1199,32 @@ Height NodeProcessor::get_LoHorizon()
 	return hRet;
 }
 
-NodeProcessor::DataStatus::Enum NodeProcessor::OnStateInternal(const Block::SystemState::Full& s, Block::SystemState::ID& id)
+bool NodeProcessor::VerifyStates(const Block::SystemState::Full* pS, size_t nCount)
+{
+	for (size_t i = 0; i < nCount; i++)
+		if (!pS[i].IsSane() || !pS[i].IsValidPoW())
+			return false;
+
+	return true;
+}
+
+NodeProcessor::DataStatus::Enum NodeProcessor::OnStateInternal(const Block::SystemState::Full& s, Block::SystemState::ID& id, bool bVerified)
 {
 	s.get_ID(id);
 
-	if (!s.IsSane())
+	if (!bVerified)
 	{
-		LOG_WARNING() << id << " header insane!";
-		return DataStatus::Invalid;
-	}
+		if (!s.IsSane())
+		{
+			LOG_WARNING() << id << " header insane!";
+			return DataStatus::Invalid;
+		}
 
-	if (!s.IsValidPoW())
-	{
-		LOG_WARNING() << id << " PoW invalid";
-		return DataStatus::Invalid;
+		if (!s.IsValidPoW())
+		{
+			LOG_WARNING() << id << " PoW invalid";
+			return DataStatus::Invalid;
+		}
 	}
 
 	Timestamp ts = getTimestamp();
@@ -1017,11 +1253,11 @@ NodeProcessor::DataStatus::Enum NodeProcessor::OnStateInternal(const Block::Syst
 	return DataStatus::Accepted;
 }
 
-NodeProcessor::DataStatus::Enum NodeProcessor::OnState(const Block::SystemState::Full& s, const PeerID& peer)
+NodeProcessor::DataStatus::Enum NodeProcessor::OnState(const Block::SystemState::Full& s, const PeerID& peer, bool bVerified /* = false */)
 {
 	Block::SystemState::ID id;
 
-	DataStatus::Enum ret = OnStateInternal(s, id);
+	DataStatus::Enum ret = OnStateInternal(s, id, bVerified);
 	if (DataStatus::Accepted == ret)
 	{
 		NodeDB::Transaction t(m_DB);
@@ -1062,6 +1298,18 @@ NodeProcessor::DataStatus::Enum NodeProcessor::OnBlock(const Block::SystemState:
 
 	LOG_INFO() << id << " Block received";
 
+	if ((m_GroupCommit.m_MaxBlocks > 1) && (m_DB.get_HeightMax() >= m_Cursor.m_ID.m_Height + m_GroupCommit.m_MinLag))
+	{
+		if (!m_DB.IsGroupOpen())
+		{
+			m_DB.BeginGroup();
+			m_GroupCommit.m_nBlocks = 0;
+			m_GroupCommit.m_Start_ms = GetTime_ms();
+		}
+	}
+	else
+		FlushGroupCommit(); // caught up
+
 	NodeDB::Transaction t(m_DB);
 
 	m_DB.SetStateBlock(rowid, block);
@@ -1071,11 +1319,37 @@ NodeProcessor::DataStatus::Enum NodeProcessor::OnBlock(const Block::SystemState:
 	if (NodeDB::StateFlags::Reachable & m_DB.GetStateFlags(rowid))
 		TryGoUp();
 
-	t.Commit();
+	{
+		PerfScope ps(m_pPerfStats, &PerfStats::m_Commit_us);
+		t.Commit();
+	}
+
+	if (m_DB.IsGroupOpen())
+	{
+		if ((++m_GroupCommit.m_nBlocks < m_GroupCommit.m_MaxBlocks) && (GetTime_ms() - m_GroupCommit.m_Start_ms < m_GroupCommit.m_MaxTime_ms))
+			OnGroupCommitPending();
+		else
+			FlushGroupCommit();
+	}
+	else
+		OnCommitted();
 
 	return DataStatus::Accepted;
 }
 
+void NodeProcessor::FlushGroupCommit()
+{
+	if (!m_DB.IsGroupOpen())
+		return;
+
+	{
+		PerfScope ps(m_pPerfStats, &PerfStats::m_Commit_us);
+		m_DB.CommitGroup();
+	}
+
+	OnCommitted();
+}
+
 bool NodeProcessor::IsRemoteTipNeeded(const Block::SystemState::Full& sTipRemote, const Block::SystemState::Full& sTipMy)
 {
 	int n = sTipMy.m_ChainWork.cmp(sTipRemote.m_ChainWork);
@@ -1089,25 +1363,20 @@ bool NodeProcessor::IsRemoteTipNeeded(const Block::SystemState::Full& sTipRemote
 
 uint64_t NodeProcessor::FindActiveAtStrict(Height h)
 {
-	NodeDB::WalkerState ws(m_DB);
-	m_DB.EnumStatesAt(ws, h);
-	while (true)
-	{
-		if (!ws.MoveNext())
-			OnCorrupted();
-
-		if (NodeDB::StateFlags::Active & m_DB.GetStateFlags(ws.m_Sid.m_Row))
-			return ws.m_Sid.m_Row;
-	}
+	return m_DB.FindActiveStateStrict(h);
 }
 
 /////////////////////////////
 // TxPool
 bool NodeProcessor::ValidateTx(const Transaction& tx, Transaction::Context& ctx)
 {
-	if (!tx.IsValid(ctx))
-		return false;
+	return
+		tx.IsValid(ctx) &&
+		ValidateTxWrtHeight(ctx);
+}
 
+bool NodeProcessor::ValidateTxWrtHeight(const Transaction::Context& ctx) const
+{
 	return ctx.m_Height.IsInRange(m_Cursor.m_Sid.m_Height + 1);
 }
 
@@ -1289,15 +1558,39 @@ bool NodeProcessor::GenerateNewBlock(TxPool& txp, Block::SystemState::Full& s, B
 	ECC::Scalar::Native kCoinbase, kFee, kKernel;
 	DeriveKeys(m_Kdf, h, fees, kCoinbase, kFee, kKernel, offset);
 
-	if (fees)
+	// create the range proofs in parallel
+	Output::Ptr pOutpCoinbase(new Output), pOutpFee;
+	pOutpCoinbase->m_Coinbase = true;
+
 	{
-		Output::Ptr pOutp(new Output);
-		pOutp->Create(kFee, fees);
+		std::vector<Output::CreateTask> vTasks(1);
+		vTasks[0].m_pOutput = pOutpCoinbase.get();
+		vTasks[0].m_Key = kCoinbase;
+		vTasks[0].m_Value = Rules::get().CoinbaseEmission;
+		vTasks[0].m_Public = true;
+
+		if (fees)
+		{
+			pOutpFee.reset(new Output);
+
+			vTasks.emplace_back();
+			vTasks[1].m_pOutput = pOutpFee.get();
+			vTasks[1].m_Key = kFee;
+			vTasks[1].m_Value = fees;
+		}
+
+		Output::CreateMulti(vTasks);
+
+		for (size_t i = 0; i < vTasks.size(); i++)
+			vTasks[i].m_Key = Zero;
+	}
 
-		if (!HandleBlockElement(*pOutp, h, NULL, true))
+	if (pOutpFee)
+	{
+		if (!HandleBlockElement(*pOutpFee, h, NULL, true))
 			return false; // though should not happen!
 
-		res.m_vOutputs.push_back(std::move(pOutp));
+		res.m_vOutputs.push_back(std::move(pOutpFee));
 	}
 
 	{
@@ -1314,16 +1607,10 @@ bool NodeProcessor::GenerateNewBlock(TxPool& txp, Block::SystemState::Full& s, B
 		res.m_vKernelsOutput.push_back(std::move(pKrn));
 	}
 
-	{
-		Output::Ptr pOutp(new Output);
-		pOutp->m_Coinbase = true;
-		pOutp->Create(kCoinbase, Rules::get().CoinbaseEmission, true);
-
-		if (!HandleBlockElement(*pOutp, h, NULL, true))
-			return false;
+	if (!HandleBlockElement(*pOutpCoinbase, h, NULL, true))
+		return false;
 
-		res.m_vOutputs.push_back(std::move(pOutp));
-	}
+	res.m_vOutputs.push_back(std::move(pOutpCoinbase));
 
 	res.m_Subsidy += Rules::get().CoinbaseEmission;
 
@@ -1359,6 +1646,19 @@ bool NodeProcessor::GenerateNewBlock(TxPool& txp, Block::SystemState::Full& s, B
 	return true;
 }
 
+struct NodeProcessor::SpeculativeScope
+{
+	NodeProcessor& m_This;
+
+	SpeculativeScope(NodeProcessor& x) :m_This(x)
+	{
+		assert(!m_This.m_bSpeculative);
+		m_This.m_bSpeculative = true;
+	}
+
+	~SpeculativeScope() { m_This.m_bSpeculative = false; }
+};
+
 bool NodeProcessor::GenerateNewBlock(TxPool& txp, Block::SystemState::Full& s, ByteBuffer& bbBlock, Amount& fees)
 {
 	Block::Body block;
@@ -1380,7 +1680,7 @@ bool NodeProcessor::GenerateNewBlock(TxPool& txp, Block::SystemState::Full& s, B
 		return false;
 
 	{
-		NodeDB::Transaction t(m_DB);
+		SpeculativeScope scope(*this); // no DB transaction, everything is undone in-memory
 
 		RollbackData rbData;
 
@@ -1550,43 +1850,75 @@ bool NodeProcessor::ImportMacroBlock(Block::BodyBase::IMacroReader& r)
 
 	LOG_INFO() << "Verifying headers...";
 
-	for (bool bFirstTime = true ; r.get_NextHdr(s); s.NextPrefix())
+	// headers are read in batches, the PoW of each batch is verified at once (in parallel, if supported), the rest is sequential
+	const size_t nHdrBatch = 1024;
+	std::vector<Block::SystemState::Full> vHdrs;
+	vHdrs.reserve(nHdrBatch);
+
+	for (bool bFirstTime = true, bMore = true; bMore; )
 	{
-		if (bFirstTime)
-		{
-			bFirstTime = false;
+		vHdrs.clear();
 
-			Difficulty::Raw wrk;
-			s.m_PoW.m_Difficulty.Inc(wrk, m_Cursor.m_Full.m_ChainWork);
+		for ( ; vHdrs.size() < nHdrBatch; s.NextPrefix())
+		{
+			if (!r.get_NextHdr(s))
+			{
+				bMore = false;
+				break;
+			}
 
-			if (wrk != s.m_ChainWork)
+			if (bFirstTime)
 			{
-				LOG_WARNING() << id << " Chainwork expected=" << wrk << ", actual=" << s.m_ChainWork;
-				return false;
+				bFirstTime = false;
+
+				Difficulty::Raw wrk;
+				s.m_PoW.m_Difficulty.Inc(wrk, m_Cursor.m_Full.m_ChainWork);
+
+				if (wrk != s.m_ChainWork)
+				{
+					LOG_WARNING() << id << " Chainwork expected=" << wrk << ", actual=" << s.m_ChainWork;
+					return false;
+				}
 			}
+			else
+				s.m_PoW.m_Difficulty.Inc(s.m_ChainWork);
+
+			vHdrs.push_back(s);
 		}
-		else
-			s.m_PoW.m_Difficulty.Inc(s.m_ChainWork);
 
-		switch (OnStateInternal(s, id))
-		{
-		case DataStatus::Invalid:
+		if (vHdrs.empty())
+			break;
+
+		bool bVerified = VerifyMacroBlockStates(&vHdrs.front(), vHdrs.size()); // if failed - re-check one-by-one to find and report the invalid one
+
+		for (size_t i = 0; i < vHdrs.size(); i++)
 		{
-			LOG_WARNING() << "Invald header encountered: " << id;
-			return false;
-		}
+			switch (OnStateInternal(vHdrs[i], id, bVerified))
+			{
+			case DataStatus::Invalid:
+			{
+				LOG_WARNING() << "Invald header encountered: " << id;
+				return false;
+			}
 
-		case DataStatus::Accepted:
-			m_DB.InsertState(s);
+			case DataStatus::Accepted:
+				m_DB.InsertState(vHdrs[i]);
 
-		default: // suppress the warning of not handling all the enum values
-			break;
+			default: // suppress the warning of not handling all the enum values
+				break;
+			}
 		}
 	}
 
 	LOG_INFO() << "Context-free validation...";
 
-	if (!VerifyBlock(body, std::move(r), HeightRange(cu.m_ID.m_Height + 1, id.m_Height)))
+	bool bValid;
+	{
+		PerfScope ps(m_pPerfStats, &PerfStats::m_Verify_us);
+		bValid = VerifyMacroBlock(body, std::move(r), HeightRange(cu.m_ID.m_Height + 1, id.m_Height));
+	}
+
+	if (!bValid)
 	{
 		LOG_WARNING() << "Context-free verification failed";
 		return false;
@@ -1595,7 +1927,12 @@ bool NodeProcessor::ImportMacroBlock(Block::BodyBase::IMacroReader& r)
 	LOG_INFO() << "Applying macroblock...";
 
 	RollbackData rbData;
-	if (!HandleValidatedTx(std::move(r), cu.m_ID.m_Height + 1, true, rbData, &id.m_Height))
+	{
+		PerfScope ps(m_pPerfStats, &PerfStats::m_Apply_us);
+		bValid = HandleValidatedTx(std::move(r), cu.m_ID.m_Height + 1, true, rbData, &id.m_Height);
+	}
+
+	if (!bValid)
 	{
 		LOG_WARNING() << "Invalid in its context";
 		return false;
@@ -1661,11 +1998,16 @@ bool NodeProcessor::ImportMacroBlock(Block::BodyBase::IMacroReader& r)
 
 	// everything's fine
 	m_DB.ParamSet(NodeDB::ParamID::FossilHeight, &id.m_Height, NULL);
-	t.Commit();
+
+	{
+		PerfScope ps(m_pPerfStats, &PerfStats::m_Commit_us);
+		t.Commit();
+	}
 
 	LOG_INFO() << "Macroblock import succeeded";
 
 	TryGoUp();
+	OnCommitted();
 
 	return true;
 }
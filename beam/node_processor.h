@@ -31,6 +31,10 @@ class NodeProcessor
 		static const uint8_t Kernel	= 1;
 	};
 
+	// Speculative mode (block template assembly): the changes are applied to the in-memory trees only, and undone afterwards. The DB isn't touched.
+	bool m_bSpeculative = false;
+	struct SpeculativeScope;
+
 	void TryGoUp();
 
 	bool GoForward(uint64_t);
@@ -60,10 +64,16 @@ class NodeProcessor
 
 	struct UtxoSig;
 	struct UnspentWalker;
+	struct PerfScope;
+	struct SnapshotStream;
+
+	bool LoadSnapshot();
+	void OnCommitted();
 
 public:
 
 	void Initialize(const char* szPath);
+	virtual ~NodeProcessor();
 
 	struct Horizon {
 
@@ -74,6 +84,33 @@ public:
 
 	} m_Horizon;
 
+	// The live data (UTXO and kernel trees) is saved periodically, and on startup it's loaded instead of being rebuilt from the DB (if matches the cursor).
+	struct Snapshot
+	{
+		std::string m_sPath; // if empty - the DB path with ".snapshot" suffix
+		Height m_Period = 0; // save after this number of blocks since the last one. 0 - disabled
+		Height m_hLast = 0; // height of the last saved or loaded snapshot
+	} m_Snapshot;
+
+	void SaveSnapshot(); // best effort
+
+	// Catch-up: while the cursor is far behind the known headers, several blocks are committed in a single DB transaction, to save on syncs.
+	// If the node is terminated abnormally - the whole pending group is lost (the blocks are requested again).
+	struct GroupCommit
+	{
+		uint32_t m_MaxBlocks = 0; // commit after this number of blocks. 0 or 1 - disabled
+		uint32_t m_MaxTime_ms = 1000; // or after this time since the group was opened
+		Height m_MinLag = 100; // engage only if the cursor is at least this much behind the highest known header
+
+		uint32_t m_nBlocks = 0;
+		uint32_t m_Start_ms = 0;
+	} m_GroupCommit;
+
+	void FlushGroupCommit(); // commit the pending group, if any
+
+	// Max number of missing blocks requested at once per branch, starting from the lowest one. More than 1 allows pipelined download from several peers
+	uint32_t m_RequestBlocksAhead = 1;
+
 	struct Cursor
 	{
 		// frequently used data
@@ -104,7 +141,7 @@ public:
 		};
 	};
 
-	DataStatus::Enum OnState(const Block::SystemState::Full&, const PeerID&);
+	DataStatus::Enum OnState(const Block::SystemState::Full&, const PeerID&, bool bVerified = false); // bVerified - VerifyStates() already passed
 	DataStatus::Enum OnBlock(const Block::SystemState::ID&, const NodeDB::Blob& block, const PeerID&);
 
 	// use only for data retrieval for peers
@@ -112,8 +149,21 @@ public:
 	UtxoTree& get_Utxos() { return m_Utxos; }
 	RadixHashOnlyTree& get_Kernels() { return m_Kernels; }
 
+	void set_RehashThreads(uint32_t n) { m_Utxos.m_nRehashThreads = m_Kernels.m_nRehashThreads = n; }
+
 	bool get_KernelHashPreimage(const Merkle::Hash& id, ECC::uintBig&);
 
+	struct PerfStats
+	{
+		// cumulative durations of the block processing phases, in microseconds
+		uint64_t m_Deserialize_us = 0;
+		uint64_t m_Verify_us = 0; // context-free
+		uint64_t m_Apply_us = 0; // HandleValidatedTx
+		uint64_t m_Commit_us = 0;
+	};
+
+	PerfStats* m_pPerfStats = NULL; // optional, for benchmarks
+
 	void EnumCongestions();
 	static bool IsRemoteTipNeeded(const Block::SystemState::Full& sTipRemote, const Block::SystemState::Full& sTipMy);
 
@@ -122,10 +172,15 @@ public:
 	virtual void OnNewState() {}
 	virtual void OnRolledBack() {}
 	virtual bool VerifyBlock(const Block::BodyBase&, TxBase::IReader&&, const HeightRange&);
+	virtual bool VerifyStates(const Block::SystemState::Full*, size_t nCount); // context-free: sanity and PoW. Sequential by default
+	// Macroblock import (only for its own headers and body). May be overridden if some parts are already verified
+	virtual bool VerifyMacroBlockStates(const Block::SystemState::Full* pS, size_t nCount) { return VerifyStates(pS, nCount); }
+	virtual bool VerifyMacroBlock(const Block::BodyBase& block, TxBase::IReader&& r, const HeightRange& hr) { return VerifyBlock(block, std::move(r), hr); }
 	virtual bool ApproveState(const Block::SystemState::ID&) { return true; }
 	virtual void AdjustFossilEnd(Height&) {}
 	virtual void OnStateData() {}
 	virtual void OnBlockData() {}
+	virtual void OnGroupCommitPending() {} // a block was processed, but the group is left open. FlushGroupCommit() should be called if no more blocks are expected soon
 
 	uint64_t FindActiveAtStrict(Height);
 
@@ -190,6 +245,7 @@ public:
 	};
 
 	bool ValidateTx(const Transaction&, Transaction::Context&); // wrt height of the next block
+	bool ValidateTxWrtHeight(const Transaction::Context&) const; // context-free part is assumed to be already verified
 
 	bool GenerateNewBlock(TxPool&, Block::SystemState::Full&, ByteBuffer&, Amount& fees, Block::Body& blockInOut);
 	bool GenerateNewBlock(TxPool&, Block::SystemState::Full&, ByteBuffer&, Amount& fees);
@@ -197,7 +253,7 @@ public:
 private:
 	bool GenerateNewBlock(TxPool&, Block::SystemState::Full&, Block::Body& block, Amount& fees, Height, RollbackData&);
 	bool GenerateNewBlock(TxPool&, Block::SystemState::Full&, ByteBuffer&, Amount& fees, Block::Body&, bool bInitiallyEmpty);
-	DataStatus::Enum OnStateInternal(const Block::SystemState::Full&, Block::SystemState::ID&);
+	DataStatus::Enum OnStateInternal(const Block::SystemState::Full&, Block::SystemState::ID&, bool bVerified);
 };
 
 
@@ -94,9 +94,21 @@ namespace beam
 		return nTips;
 	}
 
+	bool IsBodySegmentPresent(const char* sz, uint32_t nSeg)
+	{
+		std::string sPath = std::string(sz) + ".body." + std::to_string(nSeg);
+		FILE* pFile = fopen(sPath.c_str(), "rb");
+		if (!pFile)
+			return false;
+
+		fclose(pFile);
+		return true;
+	}
+
 	void TestNodeDB(const char* sz)
 	{
 		NodeDB db;
+		db.m_BodySegmentSize = 10; // a new segment every 3 bodies
 		db.Open(sz);
 
 		NodeDB::Transaction tr(db);
@@ -177,6 +189,57 @@ namespace beam
 		tr.Commit();
 		tr.Start(db);
 
+		// body segments
+		for (uint32_t i = 0; i < 7; i++)
+		{
+			uint8_t pBody[4] = { 'b', 'o', 'd', uint8_t(i) };
+			db.SetStateBlock(pRows[i], NodeDB::Blob(pBody, sizeof(pBody)));
+		}
+
+		db.SetStateBlock(pRows[6], bBody); // overwrite
+
+		tr.Commit();
+		tr.Start(db);
+
+		for (uint32_t i = 0; i < 6; i++)
+		{
+			bbBody.clear();
+			db.GetStateBlock(pRows[i], bbBody, bbRollback);
+			verify_test((bbBody.size() == 4) && (bbBody[3] == i));
+		}
+
+		db.GetStateBlock(pRows[6], bbBody, bbRollback);
+		verify_test(NodeDB::Blob(bbBody).n == bBody.n && !memcmp(&bbBody.front(), bBody.p, bBody.n));
+
+		// segments: 1 = {released, 0, 1}, 2 = {2, 3, 4}, 3 = {5, 6, 6}
+		verify_test(IsBodySegmentPresent(sz, 1) && IsBodySegmentPresent(sz, 2) && IsBodySegmentPresent(sz, 3));
+
+		for (uint32_t i = 0; i < 2; i++)
+			db.DelStateBlock(pRows[i]);
+
+		tr.Rollback(); // must not delete anything
+		tr.Start(db);
+
+		verify_test(IsBodySegmentPresent(sz, 1));
+
+		for (uint32_t i = 0; i < 2; i++)
+			db.DelStateBlock(pRows[i]);
+
+		tr.Commit();
+		tr.Start(db);
+
+		verify_test(!IsBodySegmentPresent(sz, 1));
+		verify_test(IsBodySegmentPresent(sz, 2));
+
+		for (uint32_t i = 2; i < 7; i++)
+			db.DelStateBlock(pRows[i]);
+
+		tr.Commit();
+		tr.Start(db);
+
+		verify_test(!IsBodySegmentPresent(sz, 2));
+		verify_test(IsBodySegmentPresent(sz, 3)); // the last one remains
+
 		verify_test(CountTips(db, false) == 1);
 		verify_test(CountTips(db, true) == 0);
 
@@ -293,6 +356,22 @@ namespace beam
 		tr.Commit();
 		tr.Start(db);
 
+		sid.m_Height = hMax;
+
+		for (Height h = Rules::HeightGenesis; h <= hMax; h++)
+			verify_test(db.FindActiveStateStrict(h) == pRows[h - Rules::HeightGenesis]);
+
+		// rolled-back changes must not remain in the cached active chain
+		NodeDB::StateID sid3 = sid;
+		db.MoveBack(sid3);
+		db.MoveBack(sid3);
+		verify_test(sid3.m_Row == pRows[hMax - 3]);
+		tr.Rollback();
+		tr.Start(db);
+
+		verify_test(db.FindActiveStateStrict(hMax) == pRows[hMax - 1]);
+		verify_test(db.FindActiveStateStrict(hMax - 1) == pRows[hMax - 2]);
+
 		while (sid.m_Row)
 			db.MoveBack(sid);
 
@@ -345,6 +424,47 @@ namespace beam
 		for (db.EnumUnpsent(wsp); wsp.MoveNext(); )
 			;
 
+		// cached changes: merged, cancelled, visible to the reads
+		NodeDB::Blob b1(vStates[1].m_Prev);
+		uint8_t pBody[] = { 1, 2, 3 };
+		uint8_t pBodyOut[sizeof(pBody)];
+		NodeDB::Blob bBody1(pBody, sizeof(pBody)), bBodyOut(pBodyOut, sizeof(pBodyOut));
+
+		db.AddSpendable(b0, NULL, 1, 1);
+		db.AddSpendable(b1, &bBody1, 1, 1);
+		verify_test(db.GetSpendableBody(b1, bBodyOut) && !memcmp(pBody, pBodyOut, sizeof(pBody)));
+		verify_test(!db.GetSpendableBody(b0, bBodyOut));
+
+		db.AddSpendable(b1, &bBody1, 1, 1);
+		db.ModifySpendable(b1, 0, -2);
+		db.ModifySpendable(b0, -1, -1); // cancelled out
+
+		uint32_t nUnspent = 0;
+		for (db.EnumUnpsent(wsp); wsp.MoveNext(); )
+			nUnspent++;
+		verify_test(!nUnspent); // b1 remains, but spent
+
+		verify_test(db.GetSpendableBody(b1, bBodyOut) && !memcmp(pBody, pBodyOut, sizeof(pBody)));
+
+		tr.Commit();
+		tr.Start(db);
+
+		db.AddSpendable(b1, NULL, 1, 1); // pending insertion without the body, it's already in the DB
+		verify_test(db.GetSpendableBody(b1, bBodyOut) && !memcmp(pBody, pBodyOut, sizeof(pBody)));
+		db.ModifySpendable(b1, -1, -1);
+
+		db.ModifySpendable(b1, -2, 0);
+
+		tr.Commit();
+		tr.Start(db);
+
+		db.AddSpendable(b0, NULL, 1, 1);
+		tr.Rollback(); // discards the cached change
+		tr.Start(db);
+
+		for (db.EnumUnpsent(wsp); wsp.MoveNext(); )
+			verify_test(false);
+
 		for (int i = 0; i < 20; i++)
 		{
 			NodeDB::WalkerPeer::Data d;
@@ -413,10 +533,12 @@ namespace beam
 		const char* g_sz = "mytest.db";
 		const char* g_sz2 = "mytest2.db";
 		const char* g_sz3 = "macroblock_";
+		const char* g_sz4 = "mytest3.db";
 #else // WIN32
 		const char* g_sz = "/tmp/mytest.db";
 		const char* g_sz2 = "/tmp/mytest2.db";
 		const char* g_sz3 = "/tmp/macroblock_";
+		const char* g_sz4 = "/tmp/mytest3.db";
 #endif // WIN32
 
 	void TestNodeDB()
@@ -621,9 +743,15 @@ namespace beam
 
 			BlockPlus::Ptr pBlock(new BlockPlus);
 
+			Merkle::Hash hvLive0, hvLive1;
+			np.get_CurrentLive(hvLive0);
+
 			Amount fees = 0;
 			verify_test(np.GenerateNewBlock(np.m_TxPool, pBlock->m_Hdr, pBlock->m_Body, fees));
 
+			np.get_CurrentLive(hvLive1);
+			verify_test(hvLive0 == hvLive1); // the template changes are undone
+
 			np.OnState(pBlock->m_Hdr, PeerID());
 
 			Block::SystemState::ID id;
@@ -642,6 +770,9 @@ namespace beam
 
 		Height hMid = blockChain.size() / 2 + Rules::HeightGenesis;
 
+		Merkle::Hash hvLive;
+		std::string sSnapshot;
+
 		{
 			DeleteFile(g_sz2);
 
@@ -665,6 +796,100 @@ namespace beam
 			rwData.Close();
 
 			rwData.Delete();
+
+			np2.get_CurrentLive(hvLive);
+
+			sSnapshot = np2.m_Snapshot.m_sPath;
+			np2.SaveSnapshot();
+			verify_test(np2.m_Snapshot.m_hLast == np2.m_Cursor.m_ID.m_Height);
+		}
+
+		for (int i = 0; i < 2; i++)
+		{
+			if (i)
+			{
+				// corrupt the snapshot, should fall back to the full rebuild
+				FILE* pFile = fopen(sSnapshot.c_str(), "r+b");
+				verify_test(pFile);
+				fseek(pFile, 100, SEEK_SET);
+				int nByte = fgetc(pFile);
+				fseek(pFile, 100, SEEK_SET);
+				fputc(nByte ^ 1, pFile);
+				fclose(pFile);
+			}
+
+			NodeProcessor np2;
+			np2.Initialize(g_sz2);
+
+			verify_test(np2.m_Snapshot.m_hLast == (i ? 0 : np2.m_Cursor.m_ID.m_Height));
+
+			Merkle::Hash hv;
+			np2.get_CurrentLive(hv);
+			verify_test(hv == hvLive);
+		}
+
+		DeleteFile(sSnapshot.c_str());
+
+		// group commit: all the headers first, then the blocks
+		DeleteFile(g_sz2);
+
+		const uint32_t nGroup = 10;
+		size_t iBlock = 0;
+
+		for (int i = 0; i < 2; i++)
+		{
+			NodeProcessor np2;
+			np2.m_GroupCommit.m_MaxBlocks = nGroup;
+			np2.m_GroupCommit.m_MaxTime_ms = 1000000;
+			np2.m_GroupCommit.m_MinLag = 5;
+			np2.Initialize(g_sz2);
+
+			if (i)
+				verify_test(np2.m_Cursor.m_ID.m_Height == Rules::HeightGenesis + nGroup - 1); // only the 1st group survived
+			else
+			{
+				for (size_t j = 0; j < blockChain.size(); j++)
+					verify_test(NodeProcessor::DataStatus::Accepted == np2.OnState(blockChain[j]->m_Hdr, PeerID()));
+			}
+
+			for (; iBlock < blockChain.size(); iBlock++)
+			{
+				if (!i && (iBlock == nGroup + 5))
+				{
+					// the 2nd group is pending
+					verify_test(np2.get_DB().IsGroupOpen());
+
+					// rollback within the group is local
+					Block::SystemState::Full s;
+					ByteBuffer bb;
+					Amount fees;
+					NodeProcessor::TxPool txPool;
+					verify_test(np2.GenerateNewBlock(txPool, s, bb, fees));
+					verify_test(np2.get_DB().IsGroupOpen());
+
+					// Simulate a crash
+					np2.get_DB().Close();
+					verify_test(!np2.get_DB().IsGroupOpen());
+
+					iBlock = nGroup;
+					break;
+				}
+
+				Block::SystemState::ID id;
+				blockChain[iBlock]->m_Hdr.get_ID(id);
+				verify_test(NodeProcessor::DataStatus::Accepted == np2.OnBlock(id, blockChain[iBlock]->m_Body, PeerID()));
+				verify_test(np2.m_Cursor.m_ID == id);
+			}
+		}
+
+		{
+			NodeProcessor np2;
+			np2.Initialize(g_sz2);
+			verify_test(np2.m_Cursor.m_ID.m_Height == Rules::HeightGenesis + blockChain.size() - 1);
+
+			Merkle::Hash hv;
+			np2.get_CurrentLive(hv);
+			verify_test(hv == hvLive);
 		}
 	}
 
@@ -893,6 +1118,341 @@ namespace beam
 
 
 
+	// Offline nodes for the network tests: the 1st one mines, the rest receive the same blocks
+	void PrepareTestNode(Node& node, const char* szPath, uint16_t nPort)
+	{
+		node.m_Cfg.m_sPathLocal = szPath;
+		node.m_Cfg.m_Sync.m_SrcPeers = 0;
+
+		if (nPort)
+		{
+			node.m_Cfg.m_Listen.port(nPort);
+			node.m_Cfg.m_Listen.ip(INADDR_ANY);
+		}
+
+		ECC::SetRandom(node.m_Cfg.m_WalletKey.V);
+	}
+
+	void AddTestConnect(Node& node, uint16_t nPort)
+	{
+		io::Address addr;
+		addr.resolve("127.0.0.1");
+		addr.port(nPort);
+		node.m_Cfg.m_Connect.push_back(addr);
+	}
+
+	void MineTestBlocks(Node* const* ppNodes, size_t nNodes, Height hTrg, std::vector<Block::SystemState::Full>* pvStates = NULL)
+	{
+		for (Height h = ppNodes[0]->get_Processor().m_Cursor.m_ID.m_Height + 1; h <= hTrg; h++)
+		{
+			Block::SystemState::Full s;
+			ByteBuffer body;
+			NodeProcessor::TxPool txPool; // empty, no transactions
+
+			Amount fees = 0;
+			verify_test(ppNodes[0]->get_Processor().GenerateNewBlock(txPool, s, body, fees));
+
+			if (pvStates)
+				pvStates->push_back(s);
+
+			Block::SystemState::ID id;
+			s.get_ID(id);
+
+			for (size_t i = 0; i < nNodes; i++)
+			{
+				NodeProcessor& np = ppNodes[i]->get_Processor();
+				verify_test(NodeProcessor::DataStatus::Accepted == np.OnState(s, PeerID()));
+				verify_test(NodeProcessor::DataStatus::Accepted == np.OnBlock(id, body, PeerID()));
+			}
+		}
+	}
+
+	// runs the reactor until the node reaches the given height, or fails after 30 seconds
+	void RunUntilHeight(io::Reactor::Ptr& pReactor, Node& node, Height hTrg, const char* szFailMsg)
+	{
+		struct MyTimer
+		{
+			Node* m_pNode;
+			Height m_hTrg;
+			const char* m_szFailMsg;
+			uint32_t m_Cycles = 0;
+			io::Timer::Ptr m_pTimer;
+
+			void OnTimer()
+			{
+				if (m_pNode->get_Processor().m_Cursor.m_ID.m_Height == m_hTrg)
+					io::Reactor::get_Current().stop();
+				else
+					if (++m_Cycles > 300)
+					{
+						fail_test(m_szFailMsg);
+						io::Reactor::get_Current().stop();
+					}
+			}
+		} t;
+
+		t.m_pNode = &node;
+		t.m_hTrg = hTrg;
+		t.m_szFailMsg = szFailMsg;
+		t.m_pTimer = io::Timer::create(pReactor);
+		t.m_pTimer->start(100, true, [&t]() { t.OnTimer(); });
+
+		pReactor->run();
+	}
+
+	void TestNodeCatchUp()
+	{
+		// Node1 is far behind Node0. It should fetch the headers (several ranges at once) and the blocks (pipelined)
+
+		io::Reactor::Ptr pReactor(io::Reactor::create());
+		io::Reactor::Scope scope(*pReactor);
+
+		Node node, node2;
+		PrepareTestNode(node, g_sz, g_Port);
+		node.m_Cfg.m_VerificationThreads = 2;
+
+		PrepareTestNode(node2, g_sz2, g_Port + 1);
+		node2.m_Cfg.m_BlockDownload.m_WindowInitial = 1; // should open wrt the measured RTT
+		node2.m_Cfg.m_BlockDownload.m_WindowMax = 6;
+		node2.m_Cfg.m_HdrDownload.m_PackSize = 32; // header ranges are requested concurrently
+		node2.m_Cfg.m_VerificationThreads = 2; // header packs are verified in parallel
+		AddTestConnect(node2, g_Port);
+
+		node.Initialize();
+
+		const Height hTrg = 300;
+		std::vector<Block::SystemState::Full> vStates;
+
+		Node* pNode = &node;
+		MineTestBlocks(&pNode, 1, hTrg, &vStates);
+
+		verify_test(node.get_Processor().m_Cursor.m_ID.m_Height == hTrg);
+
+		verify_test(node.get_Processor().VerifyStates(&vStates.front(), vStates.size()));
+		vStates[hTrg / 2].m_Height = 0; // insane
+		verify_test(!node.get_Processor().VerifyStates(&vStates.front(), vStates.size()));
+
+		node2.Initialize();
+
+		// the blocks must be pipelined, within the window limit
+		uint32_t nInFlightMax = 0;
+
+		io::Timer::Ptr pTimer = io::Timer::create(pReactor);
+		pTimer->start(1, true, [&node2, &nInFlightMax]() {
+			nInFlightMax = std::max(nInFlightMax, node2.get_BlocksInFlightMax());
+		});
+
+		RunUntilHeight(pReactor, node2, hTrg, "Catch-up didn't finish");
+
+		verify_test(node2.get_Processor().m_Cursor.m_ID == node.get_Processor().m_Cursor.m_ID);
+		verify_test(nInFlightMax > 1);
+		verify_test(nInFlightMax <= node2.m_Cfg.m_BlockDownload.m_WindowMax);
+	}
+
+	void TestNodeSync(bool bLiar)
+	{
+		// Node2 is a fresh node, it should download the macroblock from both Node0 and Node1 in parallel (by portions of different sizes), and import it.
+		// The next block is already in its DB, it should be verified and applied as usual right after the import.
+		// If bLiar - Node1 pretends the streams end early. Node0 should contradict it, and the sync should complete anyway
+
+		io::Reactor::Ptr pReactor(io::Reactor::create());
+		io::Reactor::Scope scope(*pReactor);
+
+		Node node, node1, node2;
+		PrepareTestNode(node, g_sz, g_Port);
+		node.m_Cfg.m_HistoryCompression.m_sPathOutput = g_sz3;
+		node.m_Cfg.m_HistoryCompression.m_UploadPortion = 3000;
+
+		PrepareTestNode(node1, g_sz2, g_Port + 1);
+		node1.m_Cfg.m_HistoryCompression.m_sPathOutput = g_sz3; // same files
+		node1.m_Cfg.m_HistoryCompression.m_UploadPortion = 2000; // smaller than requested
+		if (bLiar)
+			node1.m_Cfg.m_TestMode.m_FakeMacroblockEnd = 3000;
+
+		PrepareTestNode(node2, g_sz4, 0);
+		node2.m_Cfg.m_Sync.m_SrcPeers = 2;
+		node2.m_Cfg.m_Sync.m_Portion = 3000;
+		node2.m_Cfg.m_VerificationThreads = 2; // the downloaded streams are verified in parallel
+		node2.m_Cfg.m_HistoryCompression.m_sPathOutput = std::string(g_sz3) + "dl_";
+		AddTestConnect(node2, g_Port);
+		AddTestConnect(node2, g_Port + 1);
+
+		node.Initialize();
+		node1.Initialize();
+
+		const Height hTrg = 50;
+
+		Node* ppSrc[] = { &node, &node1 };
+		MineTestBlocks(ppSrc, _countof(ppSrc), hTrg);
+
+		Block::BodyBase::RW rw;
+		rw.m_sPath = std::string(g_sz3) + "mb_" + std::to_string(hTrg);
+
+		rw.Open(false);
+		node.get_Processor().ExportMacroBlock(rw, HeightRange(Rules::HeightGenesis, hTrg));
+		rw.Close();
+
+		node.get_Processor().get_DB().MacroblockIns(node.get_Processor().FindActiveAtStrict(hTrg));
+		node1.get_Processor().get_DB().MacroblockIns(node1.get_Processor().FindActiveAtStrict(hTrg));
+
+		node2.Initialize();
+
+		Node* ppAll[] = { &node, &node1, &node2 };
+		MineTestBlocks(ppAll, _countof(ppAll), hTrg + 1);
+
+		RunUntilHeight(pReactor, node2, hTrg + 1, "Sync didn't finish");
+
+		verify_test(node2.get_Processor().m_Cursor.m_ID == node.get_Processor().m_Cursor.m_ID);
+
+		// imported, rather than synced by blocks
+		NodeDB::WalkerState ws(node2.get_Processor().get_DB());
+		node2.get_Processor().get_DB().EnumMacroblocks(ws);
+		verify_test(ws.MoveNext() && (ws.m_Sid.m_Height == hTrg));
+
+		if (bLiar)
+		{
+			verify_test(node2.get_SyncEndsRevoked());
+
+			io::Address addr;
+			addr.resolve("127.0.0.1");
+			addr.port(g_Port + 1);
+			verify_test(node2.IsSyncExcluded(addr));
+		}
+		else
+			verify_test(!node2.get_SyncEndsRevoked());
+
+		rw.Delete();
+		rw.m_sPath = node2.m_Cfg.m_HistoryCompression.m_sPathOutput + "mb_" + std::to_string(hTrg);
+		rw.Delete();
+	}
+
+	void TestNodeTxPipeline()
+	{
+		// Client1 floods the node with txs, way over the per-peer limit. The node should pause reading from it, and resume once the txs are processed.
+		// The txs are verified in batches by the verification threads, but must be admitted (and announced to Client2) in the order of arrival.
+
+		io::Reactor::Ptr pReactor(io::Reactor::create());
+		io::Reactor::Scope scope(*pReactor);
+
+		Node node;
+		PrepareTestNode(node, g_sz, g_Port);
+		node.m_Cfg.m_VerificationThreads = 2;
+		node.m_Cfg.m_TxValidation.m_BatchSize = 3;
+		node.m_Cfg.m_TxValidation.m_MaxPendingPerPeer = 4;
+
+		node.Initialize();
+
+		io::Address addr;
+		addr.resolve("127.0.0.1");
+		addr.port(g_Port);
+
+		const uint32_t nTxs = 40;
+
+		struct MyClient
+			:public proto::NodeConnection
+		{
+			std::vector<Transaction::KeyType> m_vKeys; // sent
+			std::vector<Transaction::KeyType> m_vAnnounced; // received by the observer
+			uint32_t m_nResponses = 0;
+			uint32_t m_nTxs = 0;
+
+			io::Address m_Addr;
+			MyClient* m_pOther = NULL;
+			bool m_bObserver = false;
+
+			virtual void OnConnectedSecure() override
+			{
+				proto::Config msgCfg;
+				msgCfg.m_CfgChecksum = Rules::get().Checksum;
+				msgCfg.m_SpreadingTransactions = m_bObserver;
+				Send(msgCfg);
+
+				Send(proto::GetTime(Zero)); // the response means the config is processed
+			}
+
+			virtual void OnMsg(proto::Time&&) override
+			{
+				if (m_bObserver)
+					m_pOther->Flood();
+				else
+					m_pOther->Connect(m_Addr);
+			}
+
+			void Flood()
+			{
+				MiniWallet wallet;
+				ECC::SetRandom(wallet.m_Kdf.m_Secret.V);
+
+				proto::NewTransaction msgTx;
+				msgTx.m_Fluff = true;
+
+				for (uint32_t i = 0; i < m_nTxs; i++)
+				{
+					// the inputs needn't exist, the node doesn't check them before admitting the tx to the pool
+					wallet.AddMyUtxo(Rules::Coin * 10, i, KeyType::Regular);
+					if (!wallet.MakeTx(msgTx.m_Transaction, 1000 + i, 0))
+						break;
+
+					m_vKeys.emplace_back();
+					msgTx.m_Transaction->get_Key(m_vKeys.back());
+
+					Send(msgTx);
+				}
+			}
+
+			virtual void OnMsg(proto::Boolean&& msg) override
+			{
+				verify_test(msg.m_Value);
+				m_nResponses++;
+				CheckDone();
+			}
+
+			virtual void OnMsg(proto::HaveTransaction&& msg) override
+			{
+				verify_test(m_bObserver);
+				m_pOther->m_vAnnounced.push_back(msg.m_ID);
+				m_pOther->CheckDone();
+			}
+
+			void CheckDone()
+			{
+				if ((m_nResponses == m_nTxs) && (m_vAnnounced.size() == m_nTxs))
+					io::Reactor::get_Current().stop();
+			}
+
+			virtual void OnDisconnect(const DisconnectReason&) override {
+				fail_test("OnDisconnect");
+				io::Reactor::get_Current().stop();
+			}
+		};
+
+		MyClient cl, cl2;
+		cl.m_nTxs = nTxs;
+		cl.m_Addr = addr;
+		cl.m_pOther = &cl2;
+		cl2.m_pOther = &cl;
+		cl2.m_bObserver = true;
+
+		cl.Connect(addr);
+
+		io::Timer::Ptr pTimer = io::Timer::create(pReactor);
+		pTimer->start(30 * 1000, false, []() {
+			fail_test("Tx pipeline test timeout");
+			io::Reactor::get_Current().stop();
+		});
+
+		pReactor->run();
+
+		verify_test(cl.m_vKeys.size() == nTxs);
+		verify_test(cl.m_nResponses == nTxs);
+		verify_test(cl.m_vAnnounced == cl.m_vKeys); // admitted in the order of arrival
+
+		uint32_t nPaused, nResumed;
+		node.get_TxPauseStats(nPaused, nResumed);
+		verify_test(nPaused > 0);
+		verify_test(nResumed == nPaused);
+	}
+
 	void TestNodeClientProto()
 	{
 		// Testing configuration: Node <-> Client. Node is a miner
@@ -928,6 +1488,7 @@ namespace beam
 			std::list<uint32_t> m_queProofsKrnExpected;
 			uint32_t m_nChainWorkProofsPending = 0;
 			uint32_t m_nBbsMsgsPending = 0;
+			uint32_t m_nTxsPending = 0;
 
 
 			MyClient() {
@@ -992,6 +1553,11 @@ namespace beam
 				return !m_nBbsMsgsPending;
 			}
 
+			bool IsAllTxsProcessed() const
+			{
+				return !m_nTxsPending;
+			}
+
 			void OnTimer() {
 
 				io::Reactor::get_Current().stop();
@@ -1006,7 +1572,7 @@ namespace beam
 
 				if (IsHeightReached())
 				{
-					if (IsAllProofsReceived() && IsAllBbsReceived())
+					if (IsAllProofsReceived() && IsAllBbsReceived() && IsAllTxsProcessed())
 						io::Reactor::get_Current().stop();
 					return;
 				}
@@ -1075,9 +1641,19 @@ namespace beam
 
 					assert(msgTx.m_Transaction);
 					Send(msgTx);
+
+					m_nTxsPending++;
 				}
 			}
 
+			virtual void OnMsg(proto::Boolean&& msg) override
+			{
+				// tx response. Those are sent in the order of arrival, after the verification (possibly asynchronous)
+				verify_test(m_nTxsPending);
+				verify_test(msg.m_Value);
+				m_nTxsPending--;
+			}
+
 			virtual void OnMsg(proto::ProofState&& msg) override
 			{
 				if (!m_queProofsStateExpected.empty())
@@ -1259,6 +1835,8 @@ namespace beam
 			fail_test("some proofs missing");
 		if (!cl.IsAllBbsReceived())
 			fail_test("some BBS messages missing");
+		if (!cl.IsAllTxsProcessed())
+			fail_test("some txs not processed");
 	}
 
 
@@ -1454,6 +2032,36 @@ int main()
 	beam::DeleteFile(beam::g_sz);
 	beam::DeleteFile(beam::g_sz2);
 
+	printf("NodeX2 catch-up test...\n");
+	fflush(stdout);
+
+	beam::TestNodeCatchUp();
+	beam::DeleteFile(beam::g_sz);
+	beam::DeleteFile(beam::g_sz2);
+
+	printf("NodeX3 sync test...\n");
+	fflush(stdout);
+
+	beam::DeleteFile(beam::g_sz4);
+	beam::TestNodeSync(false);
+	beam::DeleteFile(beam::g_sz);
+	beam::DeleteFile(beam::g_sz2);
+	beam::DeleteFile(beam::g_sz4);
+
+	printf("NodeX3 sync test, with a lying peer...\n");
+	fflush(stdout);
+
+	beam::TestNodeSync(true);
+	beam::DeleteFile(beam::g_sz);
+	beam::DeleteFile(beam::g_sz2);
+	beam::DeleteFile(beam::g_sz4);
+
+	printf("Node tx pipeline test...\n");
+	fflush(stdout);
+
+	beam::TestNodeTxPipeline();
+	beam::DeleteFile(beam::g_sz);
+
 	printf("Node <---> Client test (with proofs)...\n");
 	fflush(stdout);
 
@@ -1,6 +1,18 @@
 #include <assert.h>
 #include "aes.h"
 
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#	define AES_NI_SUPPORTED
+#	include <wmmintrin.h>
+#	ifdef _MSC_VER
+#		include <intrin.h>
+#		define AES_NI_TARGET
+#	else
+#		include <cpuid.h>
+#		define AES_NI_TARGET __attribute__((target("aes,sse2")))
+#	endif
+#endif
+
 /*
 *  FIPS-197 compliant AES implementation
 *
@@ -479,6 +491,11 @@ void AES::Encoder::Init(const uint8_t* pKey)
 		RK[14] = RK[6] ^ RK[13];
 		RK[15] = RK[7] ^ RK[14];
 	}
+
+	for (i = 0; i < (Nr + 1) * 4; i++)
+	{
+		PUT_UINT32(m_erk[i], m_pRk, i * 4);
+	}
 }
 
 void AES::Decoder::Init(const Encoder& enc)
@@ -543,8 +560,93 @@ void AES::Decoder::Init(const Encoder& enc)
 
 /* AES 128-bit block encryption routine */
 
+#ifdef AES_NI_SUPPORTED
+
+bool AES::IsHwSupported()
+{
+#ifdef _MSC_VER
+	int pInfo[4];
+	__cpuid(pInfo, 1);
+	return 0 != (pInfo[2] & (1 << 25));
+#else
+	unsigned int a, b, c, d;
+	return __get_cpuid(1, &a, &b, &c, &d) && (c & bit_AES);
+#endif
+}
+
+AES_NI_TARGET
+static void AesNiEncode(const uint8_t* pRk, uint8_t* pDst, const uint8_t* pSrc)
+{
+	const __m128i* pK = (const __m128i*) pRk;
+
+	__m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i*) pSrc), _mm_loadu_si128(pK));
+
+	for (int i = 1; i < AES::Nr; i++)
+		x = _mm_aesenc_si128(x, _mm_loadu_si128(pK + i));
+
+	x = _mm_aesenclast_si128(x, _mm_loadu_si128(pK + AES::Nr));
+	_mm_storeu_si128((__m128i*) pDst, x);
+}
+
+AES_NI_TARGET
+static void AesNiXCryptBlocks(const uint8_t* pRk, beam::uintBig_t<(AES::s_BlockSize << 3)>& ctr, uint8_t* pBuf, uint32_t nBlocks)
+{
+	// CTR blocks are independent, encode up to 8 at once to hide the aesenc latency
+	const uint32_t nParallel = 8;
+
+	__m128i pK[AES::Nr + 1];
+	for (int i = 0; i <= AES::Nr; i++)
+		pK[i] = _mm_loadu_si128(((const __m128i*) pRk) + i);
+
+	__m128i pX[nParallel];
+
+	while (nBlocks)
+	{
+		uint32_t n = (nBlocks < nParallel) ? nBlocks : nParallel;
+
+		for (uint32_t j = 0; j < n; j++)
+		{
+			pX[j] = _mm_xor_si128(_mm_loadu_si128((const __m128i*) ctr.m_pData), pK[0]);
+			ctr.Inc();
+		}
+
+		for (int i = 1; i < AES::Nr; i++)
+			for (uint32_t j = 0; j < n; j++)
+				pX[j] = _mm_aesenc_si128(pX[j], pK[i]);
+
+		for (uint32_t j = 0; j < n; j++)
+		{
+			__m128i* pDst = ((__m128i*) pBuf) + j;
+			pX[j] = _mm_aesenclast_si128(pX[j], pK[AES::Nr]);
+			_mm_storeu_si128(pDst, _mm_xor_si128(pX[j], _mm_loadu_si128(pDst)));
+		}
+
+		pBuf += n * AES::s_BlockSize;
+		nBlocks -= n;
+	}
+}
+
+#else // AES_NI_SUPPORTED
+
+bool AES::IsHwSupported()
+{
+	return false;
+}
+
+#endif // AES_NI_SUPPORTED
+
+bool AES::s_bUseHw = AES::IsHwSupported();
+
 void AES::Encoder::Proceed(uint8_t* pDst, const uint8_t* pSrc) const
 {
+#ifdef AES_NI_SUPPORTED
+	if (s_bUseHw)
+	{
+		AesNiEncode(m_pRk, pDst, pSrc);
+		return;
+	}
+#endif // AES_NI_SUPPORTED
+
 	uint32_t X0, X1, X2, X3, Y0, Y1, Y2, Y3;
 
 	const uint32_t* RK = m_erk;
@@ -824,12 +926,47 @@ void AES::StreamCipher::PerfXor(uint8_t* pBuf, uint32_t nSize)
 		pBuf[i] ^= pXor[i];
 }
 
+void AES::StreamCipher::XCryptBlocks(const Encoder& enc, uint8_t* pBuf, uint32_t nBlocks)
+{
+	assert(!m_nBuf);
+
+#ifdef AES_NI_SUPPORTED
+	if (s_bUseHw)
+	{
+		AesNiXCryptBlocks(enc.m_pRk, m_Counter, pBuf, nBlocks);
+		return;
+	}
+#endif // AES_NI_SUPPORTED
+
+	for (; nBlocks--; pBuf += s_BlockSize)
+	{
+		enc.Proceed(m_pBuf, m_Counter.m_pData);
+		m_Counter.Inc();
+
+		for (uint32_t i = 0; i < s_BlockSize; i++)
+			pBuf[i] ^= m_pBuf[i];
+	}
+}
+
 void AES::StreamCipher::XCrypt(const Encoder& enc, uint8_t* pBuf, uint32_t nSize)
 {
 	while (true)
 	{
 		if (!m_nBuf)
 		{
+			uint32_t nBlocks = nSize / s_BlockSize;
+			if (nBlocks)
+			{
+				XCryptBlocks(enc, pBuf, nBlocks);
+
+				nBlocks *= s_BlockSize;
+				pBuf += nBlocks;
+				nSize -= nBlocks;
+
+				if (!nSize)
+					break;
+			}
+
 			enc.Proceed(m_pBuf, m_Counter.m_pData);
 			m_nBuf = _countof(m_pBuf);
 			m_Counter.Inc();
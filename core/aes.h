@@ -8,9 +8,14 @@ struct AES
 	static const int Nr = 14; // num-rounds
 	static const int s_BlockSize = 16;
 
+	// AES-NI is used if supported by the CPU (detected at startup). Can be turned off to use the table-driven implementation
+	static bool s_bUseHw;
+	static bool IsHwSupported();
+
 	struct Encoder
 	{
 		uint32_t m_erk[64]; // encryption round keys. Actually needed 60, but during init extra space is used
+		uint8_t m_pRk[(Nr + 1) * s_BlockSize]; // same round keys in byte order, for AES-NI
 		void Init(const uint8_t* pKey);
 		void Proceed(uint8_t* pDst, const uint8_t* pSrc) const;
 	};
@@ -31,6 +36,7 @@ struct AES
 		uint8_t m_nBuf;
 
 		void PerfXor(uint8_t* pBuf, uint32_t nSize);
+		void XCryptBlocks(const Encoder&, uint8_t* pBuf, uint32_t nBlocks); // whole blocks, cached cipherstream must be consumed
 
 		void Reset();
 		void XCrypt(const Encoder&, uint8_t* pBuf, uint32_t nSize);
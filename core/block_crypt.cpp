@@ -14,6 +14,8 @@
 
 #include <ctime>
 #include <chrono>
+#include <thread>
+#include <atomic>
 #include "block_crypt.h"
 
 namespace beam
@@ -189,6 +191,35 @@ namespace beam
 		}
 	}
 
+	void Output::CreateMulti(const std::vector<CreateTask>& v, uint32_t nThreads /* = 0 */)
+	{
+		if (!nThreads)
+			nThreads = std::thread::hardware_concurrency();
+		if (nThreads > v.size())
+			nThreads = (uint32_t) v.size();
+
+		// the generators are shared (read-only), each proof is independent and deterministic
+		std::atomic<size_t> nNext(0);
+
+		auto fnWork = [&v, &nNext]()
+		{
+			for (size_t i; (i = nNext++) < v.size(); )
+			{
+				const CreateTask& t = v[i];
+				t.m_pOutput->Create(t.m_Key, t.m_Value, t.m_Public);
+			}
+		};
+
+		std::vector<std::thread> vThreads;
+		for (uint32_t i = 1; i < nThreads; i++)
+			vThreads.emplace_back(fnWork);
+
+		fnWork();
+
+		for (size_t i = 0; i < vThreads.size(); i++)
+			vThreads[i].join();
+	}
+
 	void HeightAdd(Height& trg, Height val)
 	{
 		trg += val;
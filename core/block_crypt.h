@@ -213,6 +213,18 @@ namespace beam
 		std::unique_ptr<ECC::RangeProof::Public>		m_pPublic;
 
 		void Create(const ECC::Scalar::Native&, Amount, bool bPublic = false);
+
+		struct CreateTask
+		{
+			Output* m_pOutput; // m_Coinbase and m_Incubation should already be set
+			ECC::Scalar::Native m_Key;
+			Amount m_Value;
+			bool m_Public = false;
+		};
+
+		// Same as Create for each task (the result is identical), the work is spread over nThreads (0 = hardware concurrency) including the caller thread
+		static void CreateMulti(const std::vector<CreateTask>&, uint32_t nThreads = 0);
+
 		bool IsValid(ECC::Point::Native& comm) const;
 		Height get_MinMaturity(Height h) const; // regardless to the explicitly-overridden
 
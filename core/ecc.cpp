@@ -14,6 +14,7 @@
 
 #include "common.h"
 #include "ecc_native.h"
+#include "sha256.h"
 
 #define ENABLE_MODULE_GENERATOR
 #define ENABLE_MODULE_RANGEPROOF
@@ -36,6 +37,8 @@
 #ifndef WIN32
 #    include <unistd.h>
 #    include <fcntl.h>
+#    include <sys/stat.h>
+#    include <sys/mman.h>
 #endif // WIN32
 
 namespace ECC {
@@ -254,15 +257,141 @@ namespace ECC {
 
 	void Hash::Processor::Write(const void* p, uint32_t n)
 	{
-		secp256k1_sha256_write(this, (const uint8_t*) p, n);
+		if (!Sha256::s_bUseShaNi)
+		{
+			secp256k1_sha256_write(this, (const uint8_t*) p, n);
+			return;
+		}
+
+		// same as secp256k1_sha256_write, but the whole blocks are processed directly from the source
+		const uint8_t* pSrc = (const uint8_t*) p;
+		uint8_t* pBuf = (uint8_t*) buf;
+		uint32_t nBuf = bytes % Sha256::s_BlockSize;
+		bytes += n;
+
+		if (nBuf)
+		{
+			uint32_t nPortion = Sha256::s_BlockSize - nBuf;
+			if (n < nPortion)
+			{
+				memcpy(pBuf + nBuf, pSrc, n);
+				return;
+			}
+
+			memcpy(pBuf + nBuf, pSrc, nPortion);
+			Sha256::TransformShaNi(s, pBuf, 1);
+
+			pSrc += nPortion;
+			n -= nPortion;
+		}
+
+		uint32_t nBlocks = n / Sha256::s_BlockSize;
+		if (nBlocks)
+		{
+			Sha256::TransformShaNi(s, pSrc, nBlocks);
+
+			nBlocks *= Sha256::s_BlockSize;
+			pSrc += nBlocks;
+			n -= nBlocks;
+		}
+
+		memcpy(pBuf, pSrc, n);
 	}
 
 	void Hash::Processor::Finalize(Value& v)
 	{
-		secp256k1_sha256_finalize(this, v.m_pData);
+		// same as secp256k1_sha256_finalize, but goes through our Write
+		static const uint8_t pPad[Sha256::s_BlockSize] = { 0x80 };
+
+		uint32_t pSizeDesc[2];
+		pSizeDesc[0] = BE32((uint32_t) (bytes >> 29));
+		pSizeDesc[1] = BE32((uint32_t) (bytes << 3));
+
+		Write(pPad, 1 + ((119 - (bytes % Sha256::s_BlockSize)) % Sha256::s_BlockSize));
+		Write(pSizeDesc, sizeof(pSizeDesc));
+
+		for (size_t i = 0; i < _countof(s); i++)
+		{
+			uint32_t x = BE32(s[i]);
+			memcpy(v.m_pData + (i << 2), &x, sizeof(x));
+			s[i] = 0;
+		}
+
 		*this << v;
 	}
 
+	static void HashMultiAvx2(Hash::Value* pOut, const uint8_t* pSrc, uint32_t nSize)
+	{
+		const uint32_t nLanes = Sha256::s_Lanes;
+		const uint32_t nBlocks = nSize / Sha256::s_BlockSize;
+		const uint32_t nTail = nSize % Sha256::s_BlockSize;
+		const uint32_t nTailBlocks = (nTail + 9 > Sha256::s_BlockSize) ? 2 : 1; // 0x80 and 8-byte size desc
+
+		secp256k1_sha256_t sha;
+		secp256k1_sha256_initialize(&sha);
+
+		uint32_t pS[nLanes * 8];
+		const uint8_t* ppData[nLanes];
+		uint8_t pTail[nLanes][Sha256::s_BlockSize * 2];
+
+		for (uint32_t i = 0; i < nLanes; i++)
+		{
+			memcpy(pS + (i << 3), sha.s, sizeof(sha.s));
+			ppData[i] = pSrc + i * nSize;
+		}
+
+		if (nBlocks)
+			Sha256::TransformAvx2(pS, ppData, nBlocks);
+
+		const uint32_t nTailSize = nTailBlocks * Sha256::s_BlockSize;
+		uint32_t pSizeDesc[2];
+		pSizeDesc[0] = BE32(nSize >> 29);
+		pSizeDesc[1] = BE32(nSize << 3);
+
+		for (uint32_t i = 0; i < nLanes; i++)
+		{
+			uint8_t* pDst = pTail[i];
+			memcpy(pDst, ppData[i] + nBlocks * Sha256::s_BlockSize, nTail);
+			pDst[nTail] = 0x80;
+			memset(pDst + nTail + 1, 0, nTailSize - sizeof(pSizeDesc) - nTail - 1);
+			memcpy(pDst + nTailSize - sizeof(pSizeDesc), pSizeDesc, sizeof(pSizeDesc));
+
+			ppData[i] = pDst;
+		}
+
+		Sha256::TransformAvx2(pS, ppData, nTailBlocks);
+
+		for (uint32_t i = 0; i < nLanes; i++)
+			for (uint32_t j = 0; j < 8; j++)
+			{
+				uint32_t x = BE32(pS[(i << 3) + j]);
+				memcpy(pOut[i].m_pData + (j << 2), &x, sizeof(x));
+			}
+	}
+
+	void Hash::Processor::Multi(Value* pOut, const void* pIn, uint32_t nSize, uint32_t nCount)
+	{
+		const uint8_t* pSrc = (const uint8_t*) pIn;
+
+		// SHA-NI single-stream is faster than 8-lane AVX2, the latter is used only when SHA-NI is absent
+		if (Sha256::s_bUseAvx2 && !Sha256::s_bUseShaNi)
+		{
+			for (; nCount >= Sha256::s_Lanes; nCount -= Sha256::s_Lanes)
+			{
+				HashMultiAvx2(pOut, pSrc, nSize);
+				pOut += Sha256::s_Lanes;
+				pSrc += nSize * Sha256::s_Lanes;
+			}
+		}
+
+		for (; nCount--; pOut++, pSrc += nSize)
+		{
+			Processor hp;
+			hp.Write(pSrc, nSize);
+			hp >> *pOut;
+		}
+	}
+
 	void Hash::Processor::Write(const char* sz)
 	{
 		Write(sz, (uint32_t) (strlen(sz) + 1));
@@ -304,17 +433,50 @@ namespace ECC {
 
 	void Hash::Mac::Reset(const void* pSecret, uint32_t nSecret)
 	{
-		secp256k1_hmac_sha256_initialize(this, (uint8_t*)pSecret, nSecret);
+		// same as secp256k1_hmac_sha256_initialize, but via our Processor
+		static_assert(sizeof(Processor) == sizeof(inner) && sizeof(Processor) == sizeof(outer), "");
+		Processor& hpInner = (Processor&) inner;
+		Processor& hpOuter = (Processor&) outer;
+
+		NoLeak<uint8_t[Sha256::s_BlockSize]> key;
+
+		if (nSecret <= sizeof(key.V))
+		{
+			memcpy(key.V, pSecret, nSecret);
+			memset(key.V + nSecret, 0, sizeof(key.V) - nSecret);
+		}
+		else
+		{
+			NoLeak<Value> hv;
+			hpOuter.Reset();
+			hpOuter.Write(pSecret, nSecret);
+			hpOuter >> hv.V;
+
+			memcpy(key.V, hv.V.m_pData, hv.V.nBytes);
+			memset(key.V + hv.V.nBytes, 0, sizeof(key.V) - hv.V.nBytes);
+		}
+
+		for (uint32_t i = 0; i < sizeof(key.V); i++)
+			key.V[i] ^= 0x5c;
+		hpOuter.Reset();
+		hpOuter.Write(key.V, sizeof(key.V));
+
+		for (uint32_t i = 0; i < sizeof(key.V); i++)
+			key.V[i] ^= 0x5c ^ 0x36;
+		hpInner.Reset();
+		hpInner.Write(key.V, sizeof(key.V));
 	}
 
 	void Hash::Mac::Write(const void* p, uint32_t n)
 	{
-		secp256k1_hmac_sha256_write(this, (uint8_t*)p, n);
+		((Processor&) inner).Write(p, n);
 	}
 
 	void Hash::Mac::Finalize(Value& hv)
 	{
-		secp256k1_hmac_sha256_finalize(this, hv.m_pData);
+		NoLeak<Value> hvInner;
+		((Processor&) inner) >> hvInner.V;
+		((Processor&) outer) << hvInner.V >> hv;
 	}
 
 	/////////////////////
@@ -793,6 +955,29 @@ namespace ECC {
 		m_K = k;
 	}
 
+	void MultiMac::Casual::Glv::Split(const Scalar::Native& k)
+	{
+		secp256k1_scalar_split_lambda(&m_pK[0].get_Raw(), &m_pK[1].get_Raw(), &k.get());
+
+		for (int j = 0; j < 2; j++)
+		{
+			m_pNeg[j] = (secp256k1_scalar_is_high(&m_pK[j].get()) != 0);
+			if (m_pNeg[j])
+				m_pK[j] = -m_pK[j];
+		}
+	}
+
+	void MulLambda(secp256k1_gej& p)
+	{
+		// lambda*(x,y) = (beta*x,y). Valid for jacobian coordinates as well (x is scaled by z^2, which is unaffected)
+		static const secp256k1_fe beta = SECP256K1_FE_CONST(
+			0x7ae96a2bul, 0x657c0710ul, 0x6e64479eul, 0xac3434e9ul,
+			0x9cf04975ul, 0x12f58995ul, 0xc1396c28ul, 0x719501eeul
+		);
+
+		secp256k1_fe_mul(&p.x, &p.x, &beta);
+	}
+
 	void MultiMac::Reset()
 	{
 		m_Casual = 0;
@@ -834,8 +1019,125 @@ namespace ECC {
 		return nVal > 0;
 	}
 
+	unsigned int MultiMac::Pippenger::get_WndBits(uint32_t nPts, unsigned int nBitsUsed)
+	{
+		// minimize the number of additions: nWindows * (nPts + 2*nBuckets)
+		unsigned int nRes = 1;
+		uint64_t nCostMin = uint64_t(-1);
+
+		for (unsigned int nWndBits = 1; nWndBits <= nMaxWndBits; nWndBits++)
+		{
+			uint64_t nWnds = (nBitsUsed + nWndBits - 1) / nWndBits;
+			uint64_t nCost = nWnds * (nPts + (uint64_t(2) << nWndBits));
+
+			if (nCost < nCostMin)
+			{
+				nCostMin = nCost;
+				nRes = nWndBits;
+			}
+		}
+
+		return nRes;
+	}
+
+	void MultiMac::CalculatePippenger(Point::Native& res) const
+	{
+		assert(Mode::Fast == g_Mode);
+
+		// each casual point contributes 2 half-size points (endomorphism split)
+		const uint32_t nPts = uint32_t(m_Casual) << 1;
+
+		std::vector<secp256k1_gej> vPtJ(nPts);
+		Scalar::Native::uint pBitsOr[_countof(m_pCasual->m_K.get().d)] = { 0 };
+
+		for (int iEntry = 0; iEntry < m_Casual; iEntry++)
+		{
+			Casual& x = m_pCasual[iEntry];
+			x.m_Glv.Split(x.m_K);
+
+			for (unsigned int j = 0; j < 2; j++)
+			{
+				secp256k1_gej& pt = vPtJ[(iEntry << 1) + j];
+				pt = x.m_pPt[1].get_Raw();
+
+				if (j)
+					MulLambda(pt);
+				if (x.m_Glv.m_pNeg[j])
+					secp256k1_gej_neg(&pt, &pt);
+
+				const Scalar::Native::uint* pK = x.m_Glv.m_pK[j].get().d;
+				for (size_t i = 0; i < _countof(pBitsOr); i++)
+					pBitsOr[i] |= pK[i];
+			}
+		}
+
+		// normalize all the points at once (single inversion), so that the bucket additions are mixed (cheaper)
+		std::vector<secp256k1_ge> vPt(nPts);
+		if (nPts)
+			secp256k1_ge_set_all_gej_var(&vPt.front(), &vPtJ.front(), nPts, &default_error_callback);
+
+		const unsigned int nBitsPerWord = sizeof(Scalar::Native::uint) << 3;
+		unsigned int nBitsUsed = 0;
+		for (unsigned int i = _countof(pBitsOr); i--; )
+			if (pBitsOr[i])
+			{
+				nBitsUsed = i * nBitsPerWord;
+				for (Scalar::Native::uint n = pBitsOr[i]; n; n >>= 1)
+					nBitsUsed++;
+				break;
+			}
+
+		const unsigned int nWndBits = Pippenger::get_WndBits(nPts, nBitsUsed);
+		std::vector<secp256k1_gej> vBuckets(size_t(1) << nWndBits); // bucket 0 is unused
+
+		res = Zero;
+
+		for (unsigned int iWnd = (nBitsUsed + nWndBits - 1) / nWndBits; iWnd--; )
+		{
+			if (!(res == Zero))
+				for (unsigned int i = 0; i < nWndBits; i++)
+					res = res * Two;
+
+			unsigned int iBit = iWnd * nWndBits;
+			unsigned int nWndBitsCur = std::min(nWndBits, ECC::nBits - iBit);
+
+			for (size_t i = 1; i < vBuckets.size(); i++)
+				secp256k1_gej_set_infinity(&vBuckets[i]);
+
+			for (uint32_t iPt = 0; iPt < nPts; iPt++)
+			{
+				const Casual& x = m_pCasual[iPt >> 1];
+				unsigned int nVal = secp256k1_scalar_get_bits_var(&x.m_Glv.m_pK[iPt & 1].get(), iBit, nWndBitsCur);
+				if (nVal)
+					secp256k1_gej_add_ge_var(&vBuckets[nVal], &vBuckets[nVal], &vPt[iPt], NULL);
+			}
+
+			// sum(i * bucket[i]) via running sums
+			Point::Native ptRunning(Zero), ptSum(Zero);
+			for (size_t i = vBuckets.size(); --i; )
+			{
+				secp256k1_gej_add_var(&ptRunning.get_Raw(), &ptRunning.get_Raw(), &vBuckets[i], NULL);
+				ptSum += ptRunning;
+			}
+
+			res += ptSum;
+		}
+	}
+
 	void MultiMac::Calculate(Point::Native& res) const
 	{
+		if ((Mode::Fast == g_Mode) && (m_Casual >= Pippenger::nMinCasual))
+		{
+			MultiMac mm = *this; // prepared points by the windowed method
+			mm.m_Casual = 0;
+			mm.Calculate(res);
+
+			Point::Native pt;
+			CalculatePippenger(pt);
+			res += pt;
+			return;
+		}
+
 		const unsigned int nBitsPerWord = sizeof(Scalar::Native::uint) << 3;
 
 		static_assert(!(nBitsPerWord % Casual::Secure::nBits), "");
@@ -865,11 +1167,17 @@ namespace ECC {
 			for (int iEntry = 0; iEntry < m_Casual; iEntry++)
 			{
 				Casual& x = m_pCasual[iEntry];
-				unsigned int iBit;
-				if (GetOddAndShift(x.m_K, nBits, Casual::Fast::nMaxOdd, x.m_Aux.m_nOdd, iBit))
+				x.m_Glv.Split(x.m_K);
+
+				for (unsigned int j = 0; j < 2; j++)
 				{
-					x.m_Aux.m_nNextItem = pTblCasual[iBit];
-					pTblCasual[iBit] = iEntry + 1;
+					FastAux& aux = x.m_Glv.m_pAux[j];
+					unsigned int iBit;
+					if (GetOddAndShift(x.m_Glv.m_pK[j], nBits, Casual::Fast::nMaxOdd, aux.m_nOdd, iBit))
+					{
+						aux.m_nNextItem = pTblCasual[iBit];
+						pTblCasual[iBit] = (iEntry << 1) + j + 1;
+					}
 				}
 			}
 
@@ -894,12 +1202,14 @@ namespace ECC {
 			{
 				while (pTblCasual[iBit])
 				{
-					unsigned int iEntry = pTblCasual[iBit];
-					Casual& x = m_pCasual[iEntry - 1];
-					pTblCasual[iBit] = x.m_Aux.m_nNextItem;
-
-					assert(1 & x.m_Aux.m_nOdd);
-					unsigned int nElem = (x.m_Aux.m_nOdd >> 1) + 1;
+					unsigned int iItem = pTblCasual[iBit];
+					Casual& x = m_pCasual[(iItem - 1) >> 1];
+					unsigned int j = (iItem - 1) & 1;
+					FastAux& aux = x.m_Glv.m_pAux[j];
+					pTblCasual[iBit] = aux.m_nNextItem;
+
+					assert(1 & aux.m_nOdd);
+					unsigned int nElem = (aux.m_nOdd >> 1) + 1;
 					assert(nElem < Casual::Fast::nCount);
 
 					for (; x.m_nPrepared < nElem; x.m_nPrepared++)
@@ -910,15 +1220,27 @@ namespace ECC {
 						x.m_pPt[x.m_nPrepared + 1] = x.m_pPt[x.m_nPrepared] + x.m_pPt[0];
 					}
 
-					res += x.m_pPt[nElem];
+					if (j || x.m_Glv.m_pNeg[j])
+					{
+						// not secret (fast mode)
+						secp256k1_gej pt = x.m_pPt[nElem].get_Raw();
+						if (j)
+							MulLambda(pt);
+						if (x.m_Glv.m_pNeg[j])
+							secp256k1_gej_neg(&pt, &pt);
+
+						secp256k1_gej_add_var(&res.get_Raw(), &res.get_Raw(), &pt, NULL);
+					}
+					else
+						res += x.m_pPt[nElem];
 
 					unsigned int iBit2;
-					if (GetOddAndShift(x.m_K, iBit, Casual::Fast::nMaxOdd, x.m_Aux.m_nOdd, iBit2))
+					if (GetOddAndShift(x.m_Glv.m_pK[j], iBit, Casual::Fast::nMaxOdd, aux.m_nOdd, iBit2))
 					{
 						assert(iBit2 < iBit);
 
-						x.m_Aux.m_nNextItem = pTblCasual[iBit2];
-						pTblCasual[iBit2] = iEntry;
+						aux.m_nNextItem = pTblCasual[iBit2];
+						pTblCasual[iBit2] = iItem;
 					}
 				}
 
@@ -995,6 +1317,7 @@ namespace ECC {
 	/////////////////////
 	// Context
 	uint64_t g_pContextBuf[(sizeof(Context) + sizeof(uint64_t) - 1) / sizeof(uint64_t)];
+	const Context* g_pContext = (const Context*) g_pContextBuf; // either the above, or the mapped cache file
 
 	// Currently - auto-init in global obj c'tor
 	Initializer g_Initializer;
@@ -1006,10 +1329,245 @@ namespace ECC {
 	const Context& Context::get()
 	{
 		assert(g_bContextInitialized);
-		return *(Context*) g_pContextBuf;
+		return *g_pContext;
+	}
+
+	void BuildContext();
+
+	struct ContextFile
+	{
+		// The context is a plain struct without pointers, stored as-is after the header.
+		// Any difference in the build config (generator layout, native word size, endian-ness) is detected by the header.
+		// m_hvBody alone only detects the accidental corruption: it's keyed by m_hvChecksum from the same file, which is just a hash of the seeds.
+		// Hence it must also match the value compiled in for this layout (s_pKnown), i.e. the file must contain exactly what BuildContext() produces.
+		// Otherwise whoever can write the file could plant bogus generators, and break the soundness of the range proofs.
+		// Layouts not listed don't use the file. After changing the generators (or their layout) - update the list, TestContextFile fails otherwise.
+		struct Header
+		{
+			static const uint32_t s_Version = 1;
+
+			char m_szSig[8];
+			uint32_t m_Version;
+			uint32_t m_SizeContext;
+			uint32_t m_SizeWord;
+			uint32_t m_Flags;
+			Hash::Value m_hvChecksum; // Context::m_hvChecksum
+			Hash::Value m_hvBody; // integrity, keyed by m_hvChecksum
+
+			void Init(const Context&);
+		};
+
+		static const uint32_t s_Size = sizeof(Header) + sizeof(Context);
+		static_assert(!(sizeof(Header) % sizeof(uint64_t)), "context alignment");
+
+		struct Known
+		{
+			uint32_t m_SizeContext;
+			uint32_t m_SizeWord;
+			uint32_t m_Flags;
+			uint8_t m_pBody[Hash::Value::nBytes];
+		};
+
+		static const Known s_pKnown[];
+		static const uint8_t* s_pMapped;
+
+		static bool IsTrusted(const Header&);
+		static bool Load(const char*);
+		static void Save(const char*, const Context&);
+		static void Unmap();
+	};
+
+	const uint8_t* ContextFile::s_pMapped = NULL;
+
+	const ContextFile::Known ContextFile::s_pKnown[] = {
+		{
+			// 64-bit secp256k1 backend, ECC_COMPACT_GEN
+			1381088, 8, 1,
+			{
+				0x76, 0xd6, 0xdf, 0x69, 0xe6, 0xb7, 0xc0, 0x78, 0x9b, 0xac, 0xf4, 0x66, 0xfa, 0x59, 0xef, 0x8c,
+				0x50, 0xf4, 0x91, 0xe0, 0x6d, 0x80, 0x61, 0x40, 0x80, 0x67, 0xa9, 0xc9, 0xc4, 0x1a, 0xa4, 0x3e
+			}
+		},
+	};
+
+	bool ContextFile::IsTrusted(const Header& hdr)
+	{
+		for (size_t i = 0; i < _countof(s_pKnown); i++)
+		{
+			const Known& x = s_pKnown[i];
+			if ((x.m_SizeContext == hdr.m_SizeContext) &&
+				(x.m_SizeWord == hdr.m_SizeWord) &&
+				(x.m_Flags == hdr.m_Flags) &&
+				!memcmp(x.m_pBody, hdr.m_hvBody.m_pData, sizeof(x.m_pBody)))
+				return true;
+		}
+
+		return false;
+	}
+
+	void ContextFile::Header::Init(const Context& ctx)
+	{
+		static const char szSig[] = "BeamEcc";
+		static_assert(sizeof(szSig) == sizeof(m_szSig), "");
+		memcpy(m_szSig, szSig, sizeof(m_szSig));
+
+		m_Version = s_Version;
+		m_SizeContext = sizeof(Context);
+		m_SizeWord = sizeof(Scalar::Native::uint); // depends on the secp256k1 field/scalar backend
+		m_Flags = 0;
+#ifdef ECC_COMPACT_GEN
+		m_Flags |= 1;
+#endif // ECC_COMPACT_GEN
+
+		m_hvChecksum = ctx.m_hvChecksum;
+
+		Hash::Processor hp;
+		hp << m_hvChecksum;
+		hp.Write(&ctx, sizeof(ctx));
+		hp >> m_hvBody;
+	}
+
+	bool ContextFile::Load(const char* szPath)
+	{
+		const uint8_t* pPtr = NULL;
+
+#ifdef WIN32
+		HANDLE hFile = CreateFileA(szPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+		if (INVALID_HANDLE_VALUE == hFile)
+			return false;
+
+		LARGE_INTEGER nSize;
+		if (GetFileSizeEx(hFile, &nSize) && (s_Size == nSize.QuadPart))
+		{
+			HANDLE hMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (hMapping)
+			{
+				pPtr = (const uint8_t*) MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, s_Size);
+				CloseHandle(hMapping); // the view keeps it alive
+			}
+		}
+
+		CloseHandle(hFile);
+#else // WIN32
+		int hFile = open(szPath, O_RDONLY);
+		if (hFile < 0)
+			return false;
+
+		struct stat stats;
+		if (!fstat(hFile, &stats) && (s_Size == stats.st_size))
+		{
+			void* p = mmap(NULL, s_Size, PROT_READ, MAP_SHARED, hFile, 0);
+			if (MAP_FAILED != p)
+				pPtr = (const uint8_t*) p;
+		}
+
+		close(hFile); // the mapping keeps it alive
+#endif // WIN32
+
+		if (!pPtr)
+			return false;
+
+		const Context& ctx = *(const Context*) (pPtr + sizeof(Header));
+
+		Header hdr;
+		hdr.Init(ctx);
+
+		if (memcmp(&hdr, pPtr, sizeof(hdr)) || !IsTrusted(hdr))
+		{
+#ifdef WIN32
+			UnmapViewOfFile(pPtr);
+#else // WIN32
+			munmap((void*) pPtr, s_Size);
+#endif // WIN32
+			return false;
+		}
+
+		s_pMapped = pPtr;
+		g_pContext = &ctx;
+		return true;
+	}
+
+	void ContextFile::Unmap()
+	{
+		g_pContext = (const Context*) g_pContextBuf;
+
+		if (s_pMapped)
+		{
+#ifdef WIN32
+			UnmapViewOfFile(s_pMapped);
+#else // WIN32
+			munmap((void*) s_pMapped, s_Size);
+#endif // WIN32
+			s_pMapped = NULL;
+		}
+	}
+
+	void ContextFile::Save(const char* szPath, const Context& ctx)
+	{
+		// best effort. Write to a temp file and rename, so that others never map a partially-written file
+		std::string sTmp = szPath;
+		sTmp += ".tmp";
+
+		Header hdr;
+		hdr.Init(ctx);
+
+		if (!IsTrusted(hdr))
+			return; // would be rejected anyway
+
+		try
+		{
+			std::FStream fs;
+			if (!fs.Open(sTmp.c_str(), false))
+				return;
+
+			fs.write(&hdr, sizeof(hdr));
+			fs.write(&ctx, sizeof(ctx));
+			fs.Close();
+		}
+		catch (const std::exception&)
+		{
+			remove(sTmp.c_str());
+			return;
+		}
+
+#ifdef WIN32
+		remove(szPath); // rename doesn't overwrite
+#endif // WIN32
+
+		if (rename(sTmp.c_str(), szPath))
+			remove(sTmp.c_str());
 	}
 
 	void InitializeContext()
+	{
+		const char* szPath = getenv("BEAM_ECC_CONTEXT");
+		if (szPath && *szPath)
+			InitializeContext(szPath);
+		else
+		{
+			ContextFile::Unmap();
+			BuildContext();
+		}
+	}
+
+	bool InitializeContext(const char* szPath)
+	{
+		ContextFile::Unmap();
+
+		if (ContextFile::Load(szPath))
+		{
+#ifndef NDEBUG
+			g_bContextInitialized = true;
+#endif // NDEBUG
+			return true;
+		}
+
+		BuildContext();
+		ContextFile::Save(szPath, Context::get());
+		return false;
+	}
+
+	void BuildContext()
 	{
 		Context& ctx = *(Context*) g_pContextBuf;
 
@@ -20,6 +20,12 @@ namespace ECC
 {
 	void InitializeContext(); // builds various generators. Necessary for commitments and signatures.
 	// Not necessary for hashes, scalar and 'casual' point arithmetics
+	// If BEAM_ECC_CONTEXT environment variable is set - it's used as the cache file path (see below)
+
+	// Maps the previously built context from the cache file, if it's exactly what would be built (verified vs the hash compiled in for this build layout).
+	// Otherwise builds it and (re)creates the file. If the build layout isn't known - the file isn't used.
+	// Returns true if mapped. The mapped pages are read-only, and shared among the processes.
+	bool InitializeContext(const char* szCachePath);
 
 	void GenRandom(void*, uint32_t nSize); // with OS support
 
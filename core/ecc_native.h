@@ -16,7 +16,25 @@
 #include "ecc.h"
 #include <assert.h>
 
-#define USE_BASIC_CONFIG
+#ifdef BEAM_ECC_64BIT
+	// 64-bit field/scalar representation (5x52 / 4x64), x86_64 asm where available. Needs __int128.
+	// Must be the same in all the translation units, hence it's set globally by the build (see CMakeLists.txt)
+#	ifndef __SIZEOF_INT128__
+#		error BEAM_ECC_64BIT requires __int128 support
+#	endif // __SIZEOF_INT128__
+
+#	define USE_NUM_NONE 1
+#	define USE_FIELD_INV_BUILTIN 1
+#	define USE_SCALAR_INV_BUILTIN 1
+#	define USE_FIELD_5X52 1
+#	define USE_SCALAR_4X64 1
+#	define HAVE___INT128 1
+#	if defined(__x86_64__) || defined(__amd64__)
+#		define USE_ASM_X86_64 1
+#	endif
+#else // BEAM_ECC_64BIT
+#	define USE_BASIC_CONFIG
+#endif // BEAM_ECC_64BIT
 
 #if defined(__clang__) || defined(__GNUC__) || defined(__GNUG__)
     #pragma GCC diagnostic push
@@ -26,6 +44,9 @@
 #endif
 
 #include "../secp256k1-zkp/src/basic-config.h"
+
+#define USE_ENDOMORPHISM 1 // needed for the GLV split in MultiMac (fast mode)
+
 #include "../secp256k1-zkp/include/secp256k1.h"
 #include "../secp256k1-zkp/src/scalar.h"
 #include "../secp256k1-zkp/src/group.h"
@@ -61,6 +82,7 @@ namespace ECC
 	public:
 
 		const secp256k1_scalar& get() const { return *this; }
+		secp256k1_scalar& get_Raw() { return *this; } // use with care
 
 #ifdef USE_SCALAR_4X64
 		typedef uint64_t uint;
@@ -191,7 +213,18 @@ namespace ECC
 
 			// used in fast mode
 			unsigned int m_nPrepared;
-			FastAux m_Aux;
+
+			struct Glv
+			{
+				// In fast mode the scalar is split via the secp256k1 endomorphism: k = k0 + k1 * lambda, where lambda*(x,y) = (beta*x,y).
+				// Both halves are up to 128 bits (after the sign normalization), hence the number of doublings is halved.
+				// Both halves use the same table of odd multiples, the 2nd one is mapped by beta on-the-fly.
+				Scalar::Native m_pK[2];
+				FastAux m_pAux[2];
+				bool m_pNeg[2];
+
+				void Split(const Scalar::Native&);
+			} m_Glv;
 
 			void Init(const Point::Native&);
 			void Init(const Point::Native&, const Scalar::Native&);
@@ -229,10 +262,24 @@ namespace ECC
 		int m_Casual;
 		int m_Prepared;
 
+		struct Pippenger
+		{
+			// Bucket method for the casual points (fast mode only). Each window costs a single addition per point plus 2 additions per bucket,
+			// i.e. the cost per point decreases as the number of points grows (unlike the above, where it's flat).
+			// Chosen automatically for large batches. The prepared points are still handled by the above method.
+			static const int nMinCasual = 96; // below this the windowed method is faster (measured crossover ~64-96)
+			static const unsigned int nMaxWndBits = 12;
+
+			static unsigned int get_WndBits(uint32_t nPts, unsigned int nBitsUsed);
+		};
+
 		MultiMac() { Reset(); }
 
 		void Reset();
 		void Calculate(Point::Native&) const;
+
+	private:
+		void CalculatePippenger(Point::Native&) const;
 	};
 
 	template <int nMaxCasual, int nMaxPrepared>
@@ -402,6 +449,10 @@ namespace ECC
 		Processor& operator << (const T& t) { Write(t); return *this; }
 
 		void operator >> (Value& hv) { Finalize(hv); }
+
+		// Hash nCount independent messages, nSize bytes each, stored consequently. Same as Processor().Write(p, nSize) >> hv for each.
+		// Uses the multi-buffer SHA-256 where it's faster than single-stream.
+		static void Multi(Value* pOut, const void* pIn, uint32_t nSize, uint32_t nCount);
 	};
 
 	class Hash::Mac
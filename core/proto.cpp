@@ -547,6 +547,17 @@ void NodeConnection::ProveID(ECC::Scalar::Native& sk, uint8_t nIDType)
 	Send(msgOut);
 }
 
+void NodeConnection::PauseRead(bool bPause)
+{
+	if (!m_Connection)
+		return;
+
+	if (bPause)
+		m_Connection->pause_read();
+	else
+		TestIoResultAsync(m_Connection->resume_read());
+}
+
 bool NodeConnection::IsSecureIn() const
 {
 	return ProtocolPlus::Mode::Duplex == m_Protocol.m_Mode;
@@ -41,6 +41,10 @@ namespace proto {
 	macro(Block::SystemState::ID, Top) \
 	macro(uint32_t, Count)
 
+#define BeamNodeMsg_GetHdrRange(macro) \
+	macro(Height, Top) /* of the active chain */ \
+	macro(uint32_t, Count)
+
 #define BeamNodeMsg_HdrPack(macro) \
 	macro(Block::SystemState::Sequence::Prefix, Prefix) \
 	macro(std::vector<Block::SystemState::Sequence::Element>, vElements)
@@ -174,6 +178,7 @@ namespace proto {
 	macro(3, Hdr) \
 	macro(14, GetHdrPack) \
 	macro(19, HdrPack) \
+	macro(26, GetHdrRange) \
 	macro(4, DataMissing) \
 	macro(5, Boolean) \
 	macro(6, GetBody) \
@@ -236,9 +241,11 @@ namespace proto {
 	{
 		static const uint8_t Node		= 'N';
 		static const uint8_t Owner		= 'O';
+		static const uint8_t HdrPackEx	= 'H'; // not an identity. Advertises GetHdrRange and packs of up to g_HdrPackMaxSizeEx. Ignored by the nodes that don't support it
 	};
 
-	static const uint32_t g_HdrPackMaxSize = 128;
+	static const uint32_t g_HdrPackMaxSize = 128; // unless the peer advertised IDType::HdrPackEx
+	static const uint32_t g_HdrPackMaxSizeEx = 1024;
 
 	enum Unused_ { Unused };
 	enum Uninitialized_ { Uninitialized };
@@ -396,6 +403,8 @@ namespace proto {
 
 		const Connection* get_Connection() { return m_Connection.get(); }
 
+		void PauseRead(bool); // backpressure. Messages that are already received will still be dispatched
+
 		virtual void OnConnectedSecure() {}
 
 		struct ByeReason
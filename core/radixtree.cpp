@@ -12,6 +12,11 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
 #include "radixtree.h"
 #include "ecc_native.h"
 
@@ -26,41 +31,88 @@ uint16_t RadixTree::Node::get_Bits() const
 
 const uint8_t* RadixTree::get_NodeKey(const Node& n) const
 {
-	return (Node::s_Leaf & n.m_Bits) ? GetLeafKey((const Leaf&) n) : ((const Joint&) n).m_pKeyPtr;
+	return GetLeafKey((Node::s_Leaf & n.m_Bits) ? (const Leaf&) n : *get_Leaf(((const Joint&) n).m_KeyRef));
 }
 
-RadixTree::RadixTree()
-	:m_pRoot(NULL)
+RadixTree::RadixTree(uint32_t nLeafSize, uint32_t nJointSideSize)
+	:m_PoolLeaves(nLeafSize, 0)
+	,m_PoolJoints(sizeof(Joint), nJointSideSize)
+	,m_Root(0)
 {
 }
 
 RadixTree::~RadixTree()
 {
-	assert(!m_pRoot);
+	assert(!m_Root);
 }
 
 void RadixTree::Clear()
 {
-	if (m_pRoot)
-	{
-		DeleteNode(m_pRoot);
-		m_pRoot = NULL;
-	}
+	m_PoolLeaves.Release();
+	m_PoolJoints.Release();
+	m_Root = 0;
 }
 
-void RadixTree::DeleteNode(Node* p)
+void RadixTree::DeleteNode(Ref r)
 {
-	if (Node::s_Leaf & p->m_Bits)
-		DeleteLeaf((Leaf*) p);
+	if (s_RefLeaf & r)
+		m_PoolLeaves.Free(r);
 	else
+		m_PoolJoints.Free(r);
+}
+
+RadixTree::Pool::Pool(uint32_t nSize, uint32_t nSizeSide)
+	:m_Free(0)
+	,m_Next(0)
+	,m_End(0)
+	,m_nSize((std::max<uint32_t>(nSize, sizeof(Ref)) + sizeof(Ref) - 1) & ~(sizeof(Ref) - 1)) // free objects hold the free list reference
+	,m_nSizeSide(nSizeSide)
+{
+}
+
+RadixTree::Ref RadixTree::Pool::Alloc()
+{
+	if (m_Free)
+	{
+		Ref r = m_Free;
+		m_Free = *(Ref*) get(r);
+		return r;
+	}
+
+	if (m_Next == m_End)
 	{
-		Joint* p1 = (Joint*) p;
+		size_t iSlab = m_vSlabs.size();
+		if (iSlab >= (s_RefLeaf >> s_SlabBits))
+			throw std::bad_alloc();
 
-		for (size_t i = 0; i < _countof(p1->m_ppC); i++)
-			DeleteNode(p1->m_ppC[i]);
+		uint32_t nCount = get_SlabCount(iSlab);
+		m_vSlabs.push_back(NULL);
+		m_vSlabs.back() = (uint8_t*) ::operator new((size_t) (m_nSize + m_nSizeSide) * nCount); // if throws - the empty slab is just skipped
 
-		DeleteJoint(p1);
+		m_Next = Ref(iSlab) << s_SlabBits;
+		m_End = m_Next + nCount;
+
+		if (!iSlab)
+			m_Next++; // 0 is reserved for null
 	}
+
+	return m_Next++;
+}
+
+void RadixTree::Pool::Free(Ref r)
+{
+	r &= ~s_RefLeaf;
+	*(Ref*) get(r) = m_Free;
+	m_Free = r;
+}
+
+void RadixTree::Pool::Release()
+{
+	for (size_t i = 0; i < m_vSlabs.size(); i++)
+		::operator delete(m_vSlabs[i]);
+
+	m_vSlabs.clear();
+	m_Free = m_Next = m_End = 0;
 }
 
 uint8_t RadixTree::CursorBase::get_BitRawStat(const uint8_t* p0, uint32_t nBit)
@@ -100,12 +152,14 @@ void RadixTree::CursorBase::Invalidate()
 	}
 }
 
-void RadixTree::ReplaceTip(CursorBase& cu, Node* pNew)
+RadixTree::Ref RadixTree::ReplaceTip(CursorBase& cu, Ref rNew)
 {
 	assert(cu.m_nPtrs);
 	Node* pOld = cu.m_pp[cu.m_nPtrs - 1];
 	assert(pOld);
 
+	Ref rOld;
+
 	if (cu.m_nPtrs > 1)
 	{
 		Joint* pPrev = (Joint*) cu.m_pp[cu.m_nPtrs - 2];
@@ -113,23 +167,27 @@ void RadixTree::ReplaceTip(CursorBase& cu, Node* pNew)
 
 		for (size_t i = 0; ; i++)
 		{
-			assert(i < _countof(pPrev->m_ppC));
-			if (pPrev->m_ppC[i] == pOld)
+			assert(i < _countof(pPrev->m_pC));
+			rOld = pPrev->m_pC[i];
+			if (rOld && (get_Node(rOld) == pOld))
 			{
-				pPrev->m_ppC[i] = pNew;
+				pPrev->m_pC[i] = rNew;
 				break;
 			}
 		}
 	} else
 	{
-		assert(m_pRoot == pOld);
-		m_pRoot = pNew;
+		rOld = m_Root;
+		assert(get_Node(rOld) == pOld);
+		m_Root = rNew;
 	}
+
+	return rOld;
 }
 
 bool RadixTree::Goto(CursorBase& cu, const uint8_t* pKey, uint32_t nBits) const
 {
-	Node* p = m_pRoot;
+	Node* p = m_Root ? get_Node(m_Root) : NULL;
 
 	if (p)
 	{
@@ -146,13 +204,16 @@ bool RadixTree::Goto(CursorBase& cu, const uint8_t* pKey, uint32_t nBits) const
 		if (!p)
 			return false;
 
-		const uint8_t* pKeyNode = get_NodeKey(*p);
-
 		uint32_t nThreshold = std::min(cu.m_nBits + p->get_Bits(), nBits);
+		if (cu.m_nBits < nThreshold)
+		{
+			// most of the joints have no extra bits, their key (which is in a leaf) isn't fetched
+			const uint8_t* pKeyNode = get_NodeKey(*p);
 
-		for ( ; cu.m_nBits < nThreshold; cu.m_nBits++, cu.m_nPosInLastNode++)
-			if (1 & (cu.get_BitRaw(pKey) ^ cu.get_BitRaw(pKeyNode)))
-				return false; // no match
+			for ( ; cu.m_nBits < nThreshold; cu.m_nBits++, cu.m_nPosInLastNode++)
+				if (1 & (cu.get_BitRaw(pKey) ^ cu.get_BitRaw(pKeyNode)))
+					return false; // no match
+		}
 
 		if (cu.m_nBits == nBits)
 			return true;
@@ -160,9 +221,10 @@ bool RadixTree::Goto(CursorBase& cu, const uint8_t* pKey, uint32_t nBits) const
 		assert(cu.m_nPosInLastNode == p->get_Bits());
 
 		Joint* pN = (Joint*) p;
-		p = pN->m_ppC[cu.get_Bit(pKey)];
+		Ref r = pN->m_pC[cu.get_Bit(pKey)];
 
-		assert(p); // joints should have both children!
+		assert(r); // joints should have both children!
+		p = get_Node(r);
 
 		cu.m_pp[cu.m_nPtrs++] = p;
 		cu.m_nBits++;
@@ -185,23 +247,24 @@ RadixTree::Leaf* RadixTree::Find(CursorBase& cu, const uint8_t* pKey, uint32_t n
 	if (!bCreate)
 		return NULL;
 
-	Leaf* pN = CreateLeaf();
+	Ref rN = CreateLeaf();
 
 	// Guard the allocated leaf. In case exc will be thrown (during possible allocation of a new joint)
 	struct Guard
 	{
-		Leaf* m_pLeaf;
+		Ref m_Leaf;
 		RadixTree* m_pTree;
 
 		~Guard() {
-			if (m_pLeaf)
-				m_pTree->DeleteLeaf(m_pLeaf);
+			if (m_Leaf)
+				m_pTree->DeleteNode(m_Leaf);
 		}
 	} g;
 
 	g.m_pTree = this;
-	g.m_pLeaf = pN;
+	g.m_Leaf = rN;
 
+	Leaf* pN = get_Leaf(rN);
 
 	memcpy(GetLeafKey(*pN), pKey, (nBits + 7) >> 3);
 
@@ -214,28 +277,29 @@ RadixTree::Leaf* RadixTree::Find(CursorBase& cu, const uint8_t* pKey, uint32_t n
 		Node* p = cu.m_pp[cu.m_nPtrs - 1];
 		assert(p);
 
-		const uint8_t* pKey1 = get_NodeKey(*p);
-		assert(cu.get_Bit(pKey1) != iC);
+		assert(cu.get_Bit(get_NodeKey(*p)) != iC);
 
 		// split
-		Joint* pJ = CreateJoint();
-		pJ->m_pKeyPtr = pKey1;
+		Ref rJ = CreateJoint();
+		Joint* pJ = get_Joint(rJ);
 		pJ->m_Bits = cu.m_nPosInLastNode;
 
-		ReplaceTip(cu, pJ);
+		Ref r = ReplaceTip(cu, rJ);
 		cu.m_pp[cu.m_nPtrs - 1] = pJ;
 
+		pJ->m_KeyRef = get_KeyRef(r);
+
 		pN->m_Bits = nBits - (cu.m_nBits + 1);
 		p->m_Bits -= cu.m_nPosInLastNode + 1;
 
-		pJ->m_ppC[iC] = pN;
-		pJ->m_ppC[!iC] = p;
+		pJ->m_pC[iC] = rN;
+		pJ->m_pC[!iC] = r;
 
 
 	} else
 	{
-		assert(!m_pRoot);
-		m_pRoot = pN;
+		assert(!m_Root);
+		m_Root = rN;
 		pN->m_Bits = nBits;
 	}
 
@@ -245,7 +309,7 @@ RadixTree::Leaf* RadixTree::Find(CursorBase& cu, const uint8_t* pKey, uint32_t n
 
 	pN->m_Bits |= Node::s_Leaf;
 
-	g.m_pLeaf = NULL; // dismissed
+	g.m_Leaf = 0; // dismissed
 
 	return pN;
 }
@@ -256,16 +320,14 @@ void RadixTree::Delete(CursorBase& cu)
 
 	cu.Invalidate();
 
-	Leaf* p = (Leaf*) cu.m_pp[cu.m_nPtrs - 1];
-	assert(Node::s_Leaf & p->m_Bits);
-
-	const uint8_t* pKeyDead = GetLeafKey(*p);
+	assert(Node::s_Leaf & cu.m_pp[cu.m_nPtrs - 1]->m_Bits);
 
-	ReplaceTip(cu, NULL);
-	DeleteLeaf(p);
+	Ref rDead = ReplaceTip(cu, 0);
+	assert(s_RefLeaf & rDead);
+	DeleteNode(rDead);
 
 	if (1 == cu.m_nPtrs)
-		assert(!m_pRoot);
+		assert(!m_Root);
 	else
 	{
 		cu.m_nPtrs--;
@@ -273,26 +335,24 @@ void RadixTree::Delete(CursorBase& cu)
 		Joint* pPrev = (Joint*) cu.m_pp[cu.m_nPtrs - 1];
 		for (size_t i = 0; ; i++)
 		{
-			assert(i < _countof(pPrev->m_ppC));
-			Node* p = pPrev->m_ppC[i];
-			if (p)
+			assert(i < _countof(pPrev->m_pC));
+			Ref r = pPrev->m_pC[i];
+			if (r)
 			{
-				const uint8_t* pKey1 = get_NodeKey(*p);
-				assert(pKey1 != pKeyDead);
+				Ref rKey1 = get_KeyRef(r);
+				assert(rKey1 != rDead);
 
 				for (uint32_t j = cu.m_nPtrs; j--; )
 				{
 					Joint* pPrev2 = (Joint*) cu.m_pp[j];
-					if (pPrev2->m_pKeyPtr != pKeyDead)
+					if (pPrev2->m_KeyRef != rDead)
 						break;
 
-					pPrev2->m_pKeyPtr = pKey1;
+					pPrev2->m_KeyRef = rKey1;
 				}
 
-				p->m_Bits += pPrev->m_Bits + 1;
-				ReplaceTip(cu, p);
-
-				DeleteJoint(pPrev);
+				get_Node(r)->m_Bits += pPrev->m_Bits + 1;
+				DeleteNode(ReplaceTip(cu, r));
 
 				break;
 			}
@@ -340,7 +400,7 @@ bool RadixTree::Traverse(const Node& n, ITraveler& t) const
 	memcpy(pBound, t.m_pBound, sizeof(t.m_pBound));
 
 	const Joint& x = (const Joint&) n;
-	for (uint8_t i = 0; i < _countof(x.m_ppC); i++)
+	for (uint8_t i = 0; i < _countof(x.m_pC); i++)
 	{
 		bool bSkip = false;
 
@@ -375,7 +435,7 @@ bool RadixTree::Traverse(const Node& n, ITraveler& t) const
 			continue;
 
 		t.m_pCu->m_nBits++;
-		if (!Traverse(*x.m_ppC[i], t))
+		if (!Traverse(*get_Node(x.m_pC[i]), t))
 			return false;
 	}
 
@@ -410,7 +470,7 @@ int RadixTree::Cmp1(uint8_t n, const uint8_t* pThreshold, uint32_t n0)
 
 bool RadixTree::Traverse(ITraveler& t) const
 {
-	if (!m_pRoot)
+	if (!m_Root)
 		return true;
 
 	CursorBase cuDummy(NULL);
@@ -421,7 +481,7 @@ bool RadixTree::Traverse(ITraveler& t) const
 	t.m_pCu->m_nPtrs = 0;
 	t.m_pCu->m_nPosInLastNode = 0;
 
-	return Traverse(*m_pRoot, t);
+	return Traverse(*get_Node(m_Root), t);
 }
 
 size_t RadixTree::Count() const
@@ -445,38 +505,257 @@ size_t RadixTree::Count() const
 // RadixHashTree
 void RadixHashTree::get_Hash(Merkle::Hash& hv)
 {
-	Node* p = get_Root();
-	if (p)
-		hv = get_Hash(*p, hv);
+	Ref r = get_Root();
+	if (r)
+	{
+		RehashDirty(r);
+		hv = get_Hash(r, hv);
+	}
 	else
 		hv = Zero;
 }
 
-const Merkle::Hash& RadixHashTree::get_Hash(Node& n, Merkle::Hash& hv)
+uint32_t RadixHashTree::CollectDirty(Ref r, DirtyLevels& v) const
 {
-	if (Node::s_Leaf & n.m_Bits)
+	// returns the height of the dirty subtree. Leaves are not collected, their hashes are evaluated on-demand
+	if (s_RefLeaf & r)
+		return 0;
+
+	const Joint& x = *get_Joint(r);
+	if (Node::s_Clean & x.m_Bits)
+		return 0;
+
+	uint32_t nHeight = 0;
+	for (size_t i = 0; i < _countof(x.m_pC); i++)
+		nHeight = std::max(nHeight, CollectDirty(x.m_pC[i], v));
+
+	if (v.size() <= nHeight)
+		v.resize(nHeight + 1);
+	v[nHeight].push_back(r);
+
+	return nHeight + 1;
+}
+
+size_t RadixHashTree::CountDirty(Ref r) const
+{
+	if (s_RefLeaf & r)
+		return 0;
+
+	const Joint& x = *get_Joint(r);
+	if (Node::s_Clean & x.m_Bits)
+		return 0;
+
+	return 1 + CountDirty(x.m_pC[0]) + CountDirty(x.m_pC[1]);
+}
+
+struct RadixHashTree::Workers
+{
+	std::mutex m_Mutex;
+	std::condition_variable m_TaskNew;
+	std::condition_variable m_TaskFinished;
+	std::vector<std::thread> m_vThreads;
+
+	const std::function<void()>* m_pTask = NULL;
+	uint32_t m_iTask = 1; // 0 = stop
+	uint32_t m_Remaining = 0;
+
+	Workers(uint32_t nThreads)
+	{
+		m_vThreads.resize(nThreads);
+		for (uint32_t i = 0; i < nThreads; i++)
+			m_vThreads[i] = std::thread(&Workers::Thread, this);
+	}
+
+	~Workers()
+	{
+		{
+			std::unique_lock<std::mutex> scope(m_Mutex);
+			m_iTask = 0;
+			m_TaskNew.notify_all();
+		}
+
+		for (size_t i = 0; i < m_vThreads.size(); i++)
+			m_vThreads[i].join();
+	}
+
+	void Thread()
+	{
+		for (uint32_t iTask = 1; ; )
+		{
+			{
+				std::unique_lock<std::mutex> scope(m_Mutex);
+
+				while (m_iTask == iTask)
+					m_TaskNew.wait(scope);
+
+				if (!m_iTask)
+					return;
+
+				iTask = m_iTask;
+			}
+
+			(*m_pTask)();
+
+			std::unique_lock<std::mutex> scope(m_Mutex);
+			if (!--m_Remaining)
+				m_TaskFinished.notify_one();
+		}
+	}
+
+	// runs the task on all the workers and the caller thread, returns when all of them are done
+	void Run(const std::function<void()>& fn)
+	{
+		{
+			std::unique_lock<std::mutex> scope(m_Mutex);
+			m_pTask = &fn;
+			m_iTask ^= 2;
+			m_Remaining = (uint32_t) m_vThreads.size();
+			m_TaskNew.notify_all();
+		}
+
+		fn();
+
+		std::unique_lock<std::mutex> scope(m_Mutex);
+		while (m_Remaining)
+			m_TaskFinished.wait(scope);
+	}
+};
+
+RadixHashTree::~RadixHashTree()
+{
+	delete m_pWorkers;
+}
+
+void RadixHashTree::RehashDirty(Ref r)
+{
+	if (m_nRehashThreads > 1)
+		RehashDirtyParallel(r); // leaves only the top part dirty
+
+	RehashDirtyLevels(r);
+}
+
+void RadixHashTree::RehashDirtyParallel(Ref r)
+{
+	const size_t nMinDirty = 2048; // below this the threads aren't worth it
+
+	if (CountDirty(r) < nMinDirty)
+		return;
+
+	// Descend breadth-first until there are enough independent dirty subtrees. The nodes above them are left for the caller
+	const size_t nTarget = m_nRehashThreads * 8;
+
+	std::vector<Ref> vFront(1, r), vNext;
+
+	while (vFront.size() < nTarget)
+	{
+		vNext.clear();
+
+		for (size_t i = 0; i < vFront.size(); i++)
+		{
+			const Joint& x = *get_Joint(vFront[i]);
+			for (size_t j = 0; j < _countof(x.m_pC); j++)
+			{
+				Ref rC = x.m_pC[j];
+				if (!(s_RefLeaf & rC) && !(Node::s_Clean & get_Joint(rC)->m_Bits))
+					vNext.push_back(rC);
+			}
+		}
+
+		if (vNext.empty())
+			break;
+
+		vFront.swap(vNext);
+	}
+
+	// The subtrees don't overlap, and each node (including the leaves, which are marked clean as well) is modified by a single thread only.
+	// The result doesn't depend on the split.
+	std::atomic<size_t> nNext(0);
+
+	auto fnWork = [this, &vFront, &nNext]()
+	{
+		for (size_t i; (i = nNext++) < vFront.size(); )
+			RehashDirtyLevels(vFront[i]);
+	};
+
+	if (m_pWorkers && (m_pWorkers->m_vThreads.size() + 1 != m_nRehashThreads))
+	{
+		delete m_pWorkers;
+		m_pWorkers = NULL;
+	}
+
+	if (!m_pWorkers)
+		m_pWorkers = new Workers(m_nRehashThreads - 1);
+
+	m_pWorkers->Run(fnWork);
+}
+
+void RadixHashTree::RehashDirtyLevels(Ref r)
+{
+	// Rehash the dirty joints level-by-level (bottom-up), so that the hashes within each level are computed in a batch
+	DirtyLevels vLevels;
+	CollectDirty(r, vLevels);
+
+	std::vector<uint8_t> vBuf;
+	std::vector<Merkle::Hash> vRes;
+
+	for (size_t iLevel = 0; iLevel < vLevels.size(); iLevel++)
+	{
+		const std::vector<Ref>& v = vLevels[iLevel];
+		const uint32_t nMsg = Merkle::Hash::nBytes * _countof(get_Joint(v.front())->m_pC);
+
+		vBuf.resize(v.size() * nMsg);
+		vRes.resize(v.size());
+
+		for (size_t i = 0; i < v.size(); i++)
+		{
+			const Joint& x = *get_Joint(v[i]);
+			for (size_t j = 0; j < _countof(x.m_pC); j++)
+			{
+				Merkle::Hash hv;
+				const Merkle::Hash& hvChild = get_Hash(x.m_pC[j], hv);
+				memcpy(&vBuf[i * nMsg + j * Merkle::Hash::nBytes], hvChild.m_pData, Merkle::Hash::nBytes);
+			}
+		}
+
+		ECC::Hash::Processor::Multi(&vRes.front(), &vBuf.front(), nMsg, (uint32_t) v.size());
+
+		for (size_t i = 0; i < v.size(); i++)
+		{
+			get_JointHash(v[i]) = vRes[i];
+			get_Joint(v[i])->m_Bits |= Node::s_Clean;
+		}
+	}
+}
+
+const Merkle::Hash& RadixHashTree::get_Hash(Ref r, Merkle::Hash& hv)
+{
+	Node& n = *get_Node(r);
+
+	if (s_RefLeaf & r)
 	{
 		const Merkle::Hash& ret = get_LeafHash(n, hv);
 		n.m_Bits |= Node::s_Clean;
 		return ret;
 	}
 
-	MyJoint& x = (MyJoint&) n;
+	Joint& x = (Joint&) n;
+	Merkle::Hash& hvRet = get_JointHash(r);
+
 	if (!(Node::s_Clean & x.m_Bits))
 	{
 		ECC::Hash::Processor hp;
 
-		for (size_t i = 0; i < _countof(x.m_ppC); i++)
+		for (size_t i = 0; i < _countof(x.m_pC); i++)
 		{
 			ECC::Hash::Value hv;
-			hp << get_Hash(*x.m_ppC[i], hv);
+			hp << get_Hash(x.m_pC[i], hv);
 		}
 
-		hp >> x.m_Hash;
+		hp >> hvRet;
 		x.m_Bits |= Node::s_Clean;
 	}
 
-	return x.m_Hash;
+	return hvRet;
 }
 
 void RadixHashTree::get_Proof(Merkle::Proof& proof, const CursorBase& cu)
@@ -494,9 +773,9 @@ void RadixHashTree::get_Proof(Merkle::Proof& proof, const CursorBase& cu)
 		const Joint& x = (const Joint&) *pp[n];
 
 		Merkle::Node& node = proof[nOut];
-		node.first = (x.m_ppC[0] == pPrev);
+		node.first = (get_Node(x.m_pC[0]) == pPrev);
 
-		node.second = get_Hash(*x.m_ppC[node.first != false], node.second);
+		node.second = get_Hash(x.m_pC[node.first != false], node.second);
 
 		pPrev = &x;
 	}
@@ -504,6 +783,88 @@ void RadixHashTree::get_Proof(Merkle::Proof& proof, const CursorBase& cu)
 	assert(proof.size() == nOut);
 }
 
+void RadixHashTree::SaveSnapshot(IStream& s)
+{
+	Ref r = get_Root();
+
+	uint8_t bRoot = (0 != r);
+	s.Write(&bRoot, sizeof(bRoot));
+
+	if (r)
+	{
+		RehashDirty(r);
+		SaveNode(s, r);
+	}
+}
+
+void RadixHashTree::SaveNode(IStream& s, Ref r)
+{
+	// pre-order. All the nodes are clean at this point, the flag is restored on load
+	const Node& n = *get_Node(r);
+	uint16_t nBits = n.m_Bits & ~Node::s_Clean;
+	s.Write(&nBits, sizeof(nBits));
+
+	if (Node::s_Leaf & n.m_Bits)
+		SaveLeaf(s, (const Leaf&) n);
+	else
+	{
+		const Joint& x = (const Joint&) n;
+		assert(Node::s_Clean & x.m_Bits);
+		s.Write(get_JointHash(r).m_pData, Merkle::Hash::nBytes);
+
+		for (size_t i = 0; i < _countof(x.m_pC); i++)
+			SaveNode(s, x.m_pC[i]);
+	}
+}
+
+void RadixHashTree::LoadSnapshot(IStream& s)
+{
+	Clear();
+
+	uint8_t bRoot;
+	s.Read(&bRoot, sizeof(bRoot));
+
+	if (bRoot)
+	{
+		try {
+			set_Root(LoadNode(s));
+		} catch (...) {
+			Clear(); // releases the partially loaded nodes as well
+			throw;
+		}
+	}
+}
+
+RadixTree::Ref RadixHashTree::LoadNode(IStream& s)
+{
+	uint16_t nBits;
+	s.Read(&nBits, sizeof(nBits));
+
+	if (Node::s_Leaf & nBits)
+	{
+		Ref r = CreateLeaf();
+		Leaf& x = *get_Leaf(r);
+		x.m_Bits = nBits | Node::s_Clean;
+
+		LoadLeaf(s, x);
+		return r;
+	}
+
+	Ref r = CreateJoint();
+	Joint& x = *get_Joint(r); // the pool objects are never moved
+	x.m_Bits = nBits | Node::s_Clean;
+
+	s.Read(get_JointHash(r).m_pData, Merkle::Hash::nBytes);
+
+	for (size_t i = 0; i < _countof(x.m_pC); i++)
+		x.m_pC[i] = LoadNode(s);
+
+	// any key from the subtree would do. Take the leftmost, so that the joints referencing the same key form a contiguous path (as RadixTree::Delete expects)
+	x.m_KeyRef = get_KeyRef(x.m_pC[0]);
+
+	return r;
+}
+
 /////////////////////////////
 // UtxoTree
 void UtxoTree::Value::get_Hash(Merkle::Hash& hv, const Key& key) const
@@ -536,6 +897,20 @@ const Merkle::Hash& UtxoTree::get_LeafHash(Node& n, Merkle::Hash& hv)
 	return hv;
 }
 
+void UtxoTree::SaveLeaf(IStream& s, const Leaf& n)
+{
+	const MyLeaf& x = (const MyLeaf&) n;
+	s.Write(x.m_Key.m_pArr, sizeof(x.m_Key.m_pArr));
+	s.Write(&x.m_Value.m_Count, sizeof(x.m_Value.m_Count));
+}
+
+void UtxoTree::LoadLeaf(IStream& s, Leaf& n)
+{
+	MyLeaf& x = (MyLeaf&) n;
+	s.Read(x.m_Key.m_pArr, sizeof(x.m_Key.m_pArr));
+	s.Read(&x.m_Value.m_Count, sizeof(x.m_Value.m_Count));
+}
+
 void UtxoTree::SaveIntenral(ISerializer& s) const
 {
 	uint32_t n = (uint32_t) Count();
@@ -32,9 +32,13 @@ protected:
 		uint16_t get_Bits() const;
 	};
 
+	// The nodes reference each other by 32-bit indexes in the tree pools, rather than pointers. The leaves are tagged by the highest bit, 0 is null.
+	typedef uint32_t Ref;
+	static const Ref s_RefLeaf = 1U << 31;
+
 	struct Joint :public Node {
-		Node* m_ppC[2];
-		const uint8_t* m_pKeyPtr; // should be equal to one of the ancestors
+		Ref m_pC[2];
+		Ref m_KeyRef; // the leaf whose key is used, should be in the subtree
 	};
 
 public:
@@ -44,18 +48,79 @@ public:
 
 
 protected:
-	Node* get_Root() const { return m_pRoot; }
+
+	// Allocator for fixed-size objects, which are addressed by Ref. Allocates them in slabs (growing in size), the freed ones are reused via the free list.
+	// Each object may have a "side" part, stored separately in the same slab, so that the main parts are packed denser.
+	// The memory is returned only by Release(), all at once. The objects are never moved.
+	class Pool
+	{
+		static const uint32_t s_SlabMin = 16; // objects
+		static const uint32_t s_SlabBits = 12;
+		static const uint32_t s_SlabMax = 1U << s_SlabBits;
+
+		std::vector<uint8_t*> m_vSlabs;
+		Ref m_Free;
+		Ref m_Next; // unused part of the last slab
+		Ref m_End;
+		const uint32_t m_nSize;
+		const uint32_t m_nSizeSide;
+
+		static uint32_t get_SlabCount(size_t iSlab)
+		{
+			static_assert(!(s_SlabMin & (s_SlabMin - 1)) && (s_SlabMin <= s_SlabMax), "");
+			return (iSlab < s_SlabBits) ? std::min(s_SlabMin << iSlab, uint32_t(s_SlabMax)) : s_SlabMax;
+		}
+
+	public:
+		Pool(uint32_t nSize, uint32_t nSizeSide);
+		~Pool() { Release(); }
+
+		Pool(const Pool&) = delete;
+		Pool& operator = (const Pool&) = delete;
+
+		Ref Alloc();
+		void Free(Ref);
+		void Release(); // the objects are not destroyed
+
+		uint8_t* get(Ref r, uint32_t nSize) const
+		{
+			assert(nSize == m_nSize);
+			r &= ~s_RefLeaf;
+			return m_vSlabs[r >> s_SlabBits] + (r & (s_SlabMax - 1)) * nSize;
+		}
+
+		uint8_t* get(Ref r) const { return get(r, m_nSize); }
+
+		uint8_t* get_Side(Ref r, uint32_t nSizeSide) const
+		{
+			assert(nSizeSide == m_nSizeSide);
+			r &= ~s_RefLeaf;
+			size_t iSlab = r >> s_SlabBits;
+			return m_vSlabs[iSlab] + (size_t) m_nSize * get_SlabCount(iSlab) + (r & (s_SlabMax - 1)) * nSizeSide;
+		}
+	};
+
+	Pool m_PoolLeaves;
+	Pool m_PoolJoints;
+
+	Node* get_Node(Ref r) const { return (s_RefLeaf & r) ? (Node*) m_PoolLeaves.get(r) : get_Joint(r); }
+	Joint* get_Joint(Ref r) const { assert(!(s_RefLeaf & r)); return (Joint*) m_PoolJoints.get(r, sizeof(Joint)); }
+	Leaf* get_Leaf(Ref r) const { assert(s_RefLeaf & r); return (Leaf*) m_PoolLeaves.get(r); }
+	Ref get_KeyRef(Ref r) const { return (s_RefLeaf & r) ? r : get_Joint(r)->m_KeyRef; }
+
+	Ref get_Root() const { return m_Root; }
+	void set_Root(Ref r) { assert(!m_Root); m_Root = r; }
 	const uint8_t* get_NodeKey(const Node&) const;
+	Ref CreateLeaf() { return m_PoolLeaves.Alloc() | s_RefLeaf; }
+	Ref CreateJoint() { return m_PoolJoints.Alloc(); }
+	void DeleteNode(Ref); // just this node, not the subtree
 
-	virtual Joint* CreateJoint() = 0;
-	virtual Leaf* CreateLeaf() = 0;
 	virtual uint8_t* GetLeafKey(const Leaf&) const = 0;
-	virtual void DeleteJoint(Joint*) = 0;
-	virtual void DeleteLeaf(Leaf*) = 0;
+
+	RadixTree(uint32_t nLeafSize, uint32_t nJointSideSize);
 
 public:
 
-	RadixTree();
 	~RadixTree();
 
 	void Clear();
@@ -122,10 +187,9 @@ public:
 	size_t Count() const; // implemented via the whole tree traversing, shouldn't use frequently.
 
 private:
-	Node* m_pRoot;
+	Ref m_Root;
 
-	void DeleteNode(Node*);
-	void ReplaceTip(CursorBase& cu, Node* pNew);
+	Ref ReplaceTip(CursorBase& cu, Ref rNew); // returns the replaced one
 	bool Traverse(const Node&, ITraveler&) const;
 
 	static int Cmp(const uint8_t* pKey, const uint8_t* pThreshold, uint32_t n0, uint32_t dn);
@@ -137,21 +201,49 @@ class RadixHashTree
 {
 public:
 
-	struct MyJoint :public Joint {
-		Merkle::Hash m_Hash;
-	};
-
 	void get_Hash(Merkle::Hash&);
 	void get_Proof(Merkle::Proof&, const CursorBase&);
 
+	// If set (more than 1) - large dirty parts are split into independent subtrees, which are rehashed concurrently.
+	// The worker threads are started on the first parallel rehash, and kept until the tree is destroyed
+	uint32_t m_nRehashThreads = 0;
+
+	// Snapshot of the whole tree, including the joint hashes. Restoring it involves no key lookups and no hashing.
+	// The format is native (not portable), and the data is trusted, the caller is responsible for the integrity check.
+	struct IStream
+	{
+		virtual void Write(const void*, uint32_t) = 0;
+		virtual void Read(void*, uint32_t) = 0;
+	};
+
+	void SaveSnapshot(IStream&);
+	void LoadSnapshot(IStream&);
+
 protected:
-	// RadixTree
-	virtual Joint* CreateJoint() override { return new MyJoint; }
-	virtual void DeleteJoint(Joint* p) override { delete (MyJoint*) p; }
+	// The joint hashes are kept aside, the routing (lookups) doesn't touch them
+	RadixHashTree(uint32_t nLeafSize) :RadixTree(nLeafSize, sizeof(Merkle::Hash)) {}
+	~RadixHashTree();
 
-	const Merkle::Hash& get_Hash(Node&, Merkle::Hash&);
+	Merkle::Hash& get_JointHash(Ref r) const { return *(Merkle::Hash*) m_PoolJoints.get_Side(r, sizeof(Merkle::Hash)); }
+	const Merkle::Hash& get_Hash(Ref, Merkle::Hash&);
+
+	typedef std::vector<std::vector<Ref> > DirtyLevels;
+	uint32_t CollectDirty(Ref, DirtyLevels&) const;
+	size_t CountDirty(Ref) const;
+	void RehashDirty(Ref);
+	void RehashDirtyParallel(Ref);
+	void RehashDirtyLevels(Ref);
 
 	virtual const Merkle::Hash& get_LeafHash(Node&, Merkle::Hash&) = 0;
+	virtual void SaveLeaf(IStream&, const Leaf&) = 0;
+	virtual void LoadLeaf(IStream&, Leaf&) = 0;
+
+private:
+	void SaveNode(IStream&, Ref);
+	Ref LoadNode(IStream&);
+
+	struct Workers;
+	Workers* m_pWorkers = NULL;
 };
 
 class RadixHashOnlyTree
@@ -174,13 +266,14 @@ public:
 		return (MyLeaf*) RadixTree::Find(cu, key.m_pData, ECC::nBits, bCreate);
 	}
 
+	RadixHashOnlyTree() :RadixHashTree(sizeof(MyLeaf)) { static_assert(alignof(MyLeaf) <= sizeof(Ref), ""); }
 	~RadixHashOnlyTree() { Clear(); }
 
 protected:
-	virtual Leaf* CreateLeaf() override { return new MyLeaf; }
 	virtual uint8_t* GetLeafKey(const Leaf& x) const override { return ((MyLeaf&) x).m_Hash.m_pData; }
-	virtual void DeleteLeaf(Leaf* p) override { delete (MyLeaf*) p; }
 	virtual const Merkle::Hash& get_LeafHash(Node& n, Merkle::Hash&) override { return ((MyLeaf&) n).m_Hash; }
+	virtual void SaveLeaf(IStream& s, const Leaf& x) override { s.Write(((const MyLeaf&) x).m_Hash.m_pData, Merkle::Hash::nBytes); }
+	virtual void LoadLeaf(IStream& s, Leaf& x) override { s.Read(((MyLeaf&) x).m_Hash.m_pData, Merkle::Hash::nBytes); }
 };
 
 
@@ -233,6 +326,7 @@ public:
 		return (MyLeaf*) RadixTree::Find(cu, key.m_pArr, key.s_Bits, bCreate);
 	}
 
+	UtxoTree() :RadixHashTree(sizeof(MyLeaf)) { static_assert(alignof(MyLeaf) <= sizeof(Ref), ""); }
 	~UtxoTree() { Clear(); }
 
     template<typename Archive>
@@ -253,10 +347,10 @@ public:
 
 
 protected:
-	virtual Leaf* CreateLeaf() override { return new MyLeaf; }
 	virtual uint8_t* GetLeafKey(const Leaf& x) const override { return ((MyLeaf&) x).m_Key.m_pArr; }
-	virtual void DeleteLeaf(Leaf* p) override { delete (MyLeaf*) p; }
 	virtual const Merkle::Hash& get_LeafHash(Node&, Merkle::Hash&) override;
+	virtual void SaveLeaf(IStream&, const Leaf&) override;
+	virtual void LoadLeaf(IStream&, Leaf&) override;
 
 	struct ISerializer {
 		virtual void Process(uint32_t&) = 0;
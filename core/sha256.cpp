@@ -0,0 +1,249 @@
+// Copyright 2018 The Beam Team
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <assert.h>
+#include <string.h>
+#include "sha256.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#	define SHA256_X86_SUPPORTED
+#	include <immintrin.h>
+#	ifdef _MSC_VER
+#		include <intrin.h>
+#		define SHA256_TARGET_SHANI
+#		define SHA256_TARGET_AVX2
+#	else
+#		include <cpuid.h>
+#		define SHA256_TARGET_SHANI __attribute__((target("sha,sse4.1")))
+#		define SHA256_TARGET_AVX2 __attribute__((target("avx2")))
+#	endif
+#endif
+
+static const uint32_t s_pK[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#ifdef SHA256_X86_SUPPORTED
+
+static void GetCpuid(uint32_t* pRes, uint32_t nLeaf)
+{
+#ifdef _MSC_VER
+	__cpuidex((int*) pRes, nLeaf, 0);
+#else
+	__cpuid_count(nLeaf, 0, pRes[0], pRes[1], pRes[2], pRes[3]);
+#endif
+}
+
+bool Sha256::IsShaNiSupported()
+{
+	uint32_t pRes[4];
+	GetCpuid(pRes, 0);
+	if (pRes[0] < 7)
+		return false;
+
+	GetCpuid(pRes, 1);
+	if (!(pRes[2] & (1 << 19))) // SSE4.1
+		return false;
+
+	GetCpuid(pRes, 7);
+	return 0 != (pRes[1] & (1 << 29));
+}
+
+bool Sha256::IsAvx2Supported()
+{
+#ifdef _MSC_VER
+	uint32_t pRes[4];
+	GetCpuid(pRes, 0);
+	if (pRes[0] < 7)
+		return false;
+
+	GetCpuid(pRes, 1);
+	if (!(pRes[2] & (1 << 27))) // OSXSAVE
+		return false;
+
+	if (6 != (_xgetbv(0) & 6)) // OS saves YMM registers
+		return false;
+
+	GetCpuid(pRes, 7);
+	return 0 != (pRes[1] & (1 << 5));
+#else
+	__builtin_cpu_init(); // may be called during static initialization
+	return 0 != __builtin_cpu_supports("avx2");
+#endif
+}
+
+SHA256_TARGET_SHANI
+void Sha256::TransformShaNi(uint32_t* pS, const uint8_t* pData, size_t nBlocks)
+{
+	const __m128i kMask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL); // big-endian words
+
+	// the state is kept as ABEF, CDGH
+	__m128i x = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*) pS), 0xB1); // CDAB
+	__m128i s1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*) (pS + 4)), 0x1B); // EFGH
+	__m128i s0 = _mm_alignr_epi8(x, s1, 8); // ABEF
+	s1 = _mm_blend_epi16(s1, x, 0xF0); // CDGH
+
+	for (; nBlocks--; pData += s_BlockSize)
+	{
+		const __m128i s0Prev = s0;
+		const __m128i s1Prev = s1;
+
+		__m128i pW[4]; // message schedule, sliding window of 16 words
+
+		for (int i = 0; i < 16; i++)
+		{
+			__m128i& w = pW[i & 3];
+
+			if (i < 4)
+				w = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (pData + (i << 4))), kMask);
+			else
+			{
+				x = _mm_add_epi32(_mm_sha256msg1_epu32(w, pW[(i - 3) & 3]), _mm_alignr_epi8(pW[(i - 1) & 3], pW[(i - 2) & 3], 4));
+				w = _mm_sha256msg2_epu32(x, pW[(i - 1) & 3]);
+			}
+
+			x = _mm_add_epi32(w, _mm_loadu_si128((const __m128i*) (s_pK + (i << 2))));
+			s1 = _mm_sha256rnds2_epu32(s1, s0, x);
+			s0 = _mm_sha256rnds2_epu32(s0, s1, _mm_shuffle_epi32(x, 0x0E));
+		}
+
+		s0 = _mm_add_epi32(s0, s0Prev);
+		s1 = _mm_add_epi32(s1, s1Prev);
+	}
+
+	x = _mm_shuffle_epi32(s0, 0x1B); // FEBA
+	s1 = _mm_shuffle_epi32(s1, 0xB1); // DCHG
+	_mm_storeu_si128((__m128i*) pS, _mm_blend_epi16(x, s1, 0xF0)); // DCBA
+	_mm_storeu_si128((__m128i*) (pS + 4), _mm_alignr_epi8(s1, x, 8)); // HGFE
+}
+
+#define SHA256_ROTR(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#define SHA256_XOR3(a, b, c) _mm256_xor_si256(_mm256_xor_si256(a, b), c)
+
+SHA256_TARGET_AVX2
+void Sha256::TransformAvx2(uint32_t* pS, const uint8_t* const* ppData, size_t nBlocks)
+{
+	static_assert(s_Lanes == 8, "");
+
+	__m256i pV[8]; // a..h, lane per stream
+	for (int i = 0; i < 8; i++)
+		pV[i] = _mm256_setr_epi32(pS[i], pS[8 + i], pS[16 + i], pS[24 + i], pS[32 + i], pS[40 + i], pS[48 + i], pS[56 + i]);
+
+	const __m256i kMask = _mm256_setr_epi8(
+		3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+		3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12); // big-endian words
+
+	for (size_t iBlock = 0; iBlock < nBlocks; iBlock++)
+	{
+		const size_t nOffset = iBlock * s_BlockSize;
+
+		__m256i pW[16];
+		for (int i = 0; i < 16; i++)
+		{
+			uint32_t pWord[8];
+			for (uint32_t j = 0; j < s_Lanes; j++)
+				memcpy(pWord + j, ppData[j] + nOffset + (i << 2), sizeof(uint32_t));
+
+			pW[i] = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*) pWord), kMask);
+		}
+
+		__m256i a = pV[0], b = pV[1], c = pV[2], d = pV[3], e = pV[4], f = pV[5], g = pV[6], h = pV[7];
+
+		for (int i = 0; i < 64; i++)
+		{
+			__m256i& w = pW[i & 15];
+			if (i >= 16)
+			{
+				const __m256i& w15 = pW[(i - 15) & 15];
+				const __m256i& w2 = pW[(i - 2) & 15];
+
+				__m256i s0 = SHA256_XOR3(SHA256_ROTR(w15, 7), SHA256_ROTR(w15, 18), _mm256_srli_epi32(w15, 3));
+				__m256i s1 = SHA256_XOR3(SHA256_ROTR(w2, 17), SHA256_ROTR(w2, 19), _mm256_srli_epi32(w2, 10));
+
+				w = _mm256_add_epi32(_mm256_add_epi32(w, s0), _mm256_add_epi32(pW[(i - 7) & 15], s1));
+			}
+
+			__m256i t1 = _mm256_add_epi32(h, SHA256_XOR3(SHA256_ROTR(e, 6), SHA256_ROTR(e, 11), SHA256_ROTR(e, 25)));
+			t1 = _mm256_add_epi32(t1, _mm256_xor_si256(g, _mm256_and_si256(e, _mm256_xor_si256(f, g)))); // Ch
+			t1 = _mm256_add_epi32(t1, _mm256_add_epi32(w, _mm256_set1_epi32(s_pK[i])));
+
+			__m256i t2 = SHA256_XOR3(SHA256_ROTR(a, 2), SHA256_ROTR(a, 13), SHA256_ROTR(a, 22));
+			t2 = _mm256_add_epi32(t2, _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)))); // Maj
+
+			h = g;
+			g = f;
+			f = e;
+			e = _mm256_add_epi32(d, t1);
+			d = c;
+			c = b;
+			b = a;
+			a = _mm256_add_epi32(t1, t2);
+		}
+
+		pV[0] = _mm256_add_epi32(pV[0], a);
+		pV[1] = _mm256_add_epi32(pV[1], b);
+		pV[2] = _mm256_add_epi32(pV[2], c);
+		pV[3] = _mm256_add_epi32(pV[3], d);
+		pV[4] = _mm256_add_epi32(pV[4], e);
+		pV[5] = _mm256_add_epi32(pV[5], f);
+		pV[6] = _mm256_add_epi32(pV[6], g);
+		pV[7] = _mm256_add_epi32(pV[7], h);
+	}
+
+	for (int i = 0; i < 8; i++)
+	{
+		uint32_t pWord[8];
+		_mm256_storeu_si256((__m256i*) pWord, pV[i]);
+
+		for (uint32_t j = 0; j < s_Lanes; j++)
+			pS[(j << 3) + i] = pWord[j];
+	}
+}
+
+#undef SHA256_ROTR
+#undef SHA256_XOR3
+
+#else // SHA256_X86_SUPPORTED
+
+bool Sha256::IsShaNiSupported()
+{
+	return false;
+}
+
+bool Sha256::IsAvx2Supported()
+{
+	return false;
+}
+
+void Sha256::TransformShaNi(uint32_t* pS, const uint8_t* pData, size_t nBlocks)
+{
+	assert(false); // not supported
+}
+
+void Sha256::TransformAvx2(uint32_t* pS, const uint8_t* const* ppData, size_t nBlocks)
+{
+	assert(false); // not supported
+}
+
+#endif // SHA256_X86_SUPPORTED
+
+bool Sha256::s_bUseShaNi = Sha256::IsShaNiSupported();
+bool Sha256::s_bUseAvx2 = Sha256::IsAvx2Supported();
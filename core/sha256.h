@@ -0,0 +1,37 @@
+// Copyright 2018 The Beam Team
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Hardware-accelerated SHA-256 compression functions. ECC::Hash::Processor uses them when supported, the secp256k1 code is the portable fallback.
+struct Sha256
+{
+	static const uint32_t s_BlockSize = 64;
+	static const uint32_t s_Lanes = 8; // for multi-buffer
+
+	// Detected at startup. Can be turned off to use the portable implementation
+	static bool s_bUseShaNi;
+	static bool s_bUseAvx2;
+
+	static bool IsShaNiSupported();
+	static bool IsAvx2Supported();
+
+	// Process nBlocks consequent blocks. pS is the state (a..h)
+	static void TransformShaNi(uint32_t* pS, const uint8_t* pData, size_t nBlocks);
+
+	// Process s_Lanes independent streams, nBlocks each. pS are the states, s_Lanes * 8 words
+	static void TransformAvx2(uint32_t* pS, const uint8_t* const* ppData, size_t nBlocks);
+};
@@ -18,6 +18,7 @@
 #include "../../utility/serialize.h"
 #include "../serialization_adapters.h"
 #include "../aes.h"
+#include "../sha256.h"
 #include "../proto.h"
 
 #include "secp256k1-zkp/include/secp256k1_rangeproof.h" // For benchmark comparison with secp256k1
@@ -107,6 +108,87 @@ void TestHash()
 		// hash values must change, even if no explicit input was fed.
 		verify_test(!(hv == hv2));
 	}
+
+	// known answers
+	static const uint8_t pSha[] = {
+		0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+		0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad };
+
+	hp.Reset();
+	hp.Write("abc", 3);
+	hp >> hv;
+	verify_test(!memcmp(hv.m_pData, pSha, sizeof(pSha)));
+
+	static const uint8_t pHmac[] = {
+		0x5b, 0xdc, 0xc1, 0x46, 0xbf, 0x60, 0x75, 0x4e, 0x6a, 0x04, 0x24, 0x26, 0x08, 0x95, 0x75, 0xc7,
+		0x5a, 0x00, 0x3f, 0x08, 0x9d, 0x27, 0x39, 0x83, 0x9d, 0xec, 0x58, 0xb9, 0x64, 0xec, 0x38, 0x43 };
+
+	const char szMsg[] = "what do ya want for nothing?";
+	Hash::Mac hmac("Jefe", 4);
+	hmac.Write(szMsg, sizeof(szMsg) - 1);
+	hmac >> hv;
+	verify_test(!memcmp(hv.m_pData, pHmac, sizeof(pHmac)));
+
+	// all the implementations (SHA-NI, multi-buffer AVX2, portable) must agree
+	const bool bUseShaNi = Sha256::s_bUseShaNi;
+	const bool bUseAvx2 = Sha256::s_bUseAvx2;
+
+	uint8_t pBuf[0x1000];
+	GenerateRandom(pBuf, sizeof(pBuf));
+
+	const uint32_t pSizes[] = { 0, 1, 55, 56, 63, 64, 65, 119, 120, 128, 64 * 3 + 17 };
+	const uint32_t nCount = 11; // not a multiple of lanes
+
+	for (size_t iSize = 0; iSize < _countof(pSizes); iSize++)
+	{
+		const uint32_t nSize = pSizes[iSize];
+		Hash::Value pRef[3];
+
+		for (int iPass = 0; iPass < 4; iPass++)
+		{
+			Sha256::s_bUseShaNi = bUseShaNi && (1 & iPass);
+			Sha256::s_bUseAvx2 = bUseAvx2 && (2 & iPass);
+
+			Hash::Value pRes[_countof(pRef)];
+
+			hp.Reset();
+			hp.Write(pBuf, nSize);
+			hp >> pRes[0];
+
+			hp.Reset();
+			for (uint32_t nDone = 0; nDone < nSize; nDone += 7)
+				hp.Write(pBuf + nDone, std::min(nSize - nDone, 7U));
+			hp >> pRes[1];
+
+			verify_test(pRes[0] == pRes[1]);
+
+			hmac.Reset(pBuf + 0x800, nSize);
+			hmac.Write(pBuf, nSize);
+			hmac >> pRes[2];
+
+			for (size_t i = 0; i < _countof(pRef); i++)
+			{
+				if (iPass)
+					verify_test(pRes[i] == pRef[i]);
+				else
+					pRef[i] = pRes[i];
+			}
+
+			Hash::Value pMulti[nCount];
+			Hash::Processor::Multi(pMulti, pBuf, nSize, nCount);
+
+			for (uint32_t i = 0; i < nCount; i++)
+			{
+				hp.Reset();
+				hp.Write(pBuf + i * nSize, nSize);
+				hp >> hv;
+				verify_test(pMulti[i] == hv);
+			}
+		}
+	}
+
+	Sha256::s_bUseShaNi = bUseShaNi;
+	Sha256::s_bUseAvx2 = bUseAvx2;
 }
 
 void TestScalars()
@@ -223,6 +305,29 @@ void TestPoints()
 		verify_test(p1 == Zero);
 	}
 
+	{
+		// fast mode, the casual scalar is split by the endomorphism
+		Mode::Scope scope(Mode::Fast);
+
+		for (int i = 0; i < 300; i++)
+		{
+			if (i)
+				SetRandom(s0);
+			else
+			{
+				s0 = 1U;
+				s0 = -s0;
+			}
+
+			p0 = Context::get().G * s0;
+
+			s1 = -s0;
+			p1 = p0;
+			p1 += g * s1;
+			verify_test(p1 == Zero);
+		}
+	}
+
 	// H-gen
 	Point::Native h = Context::get().H * 1U;
 	verify_test(!(h == Zero));
@@ -279,6 +384,57 @@ void TestPoints()
 	verify_test(p1 == Zero);
 }
 
+void TestMultiMac()
+{
+	Mode::Scope scope(Mode::Fast);
+
+	// large enough to use the bucket method for casual points
+	const uint32_t nCasual = MultiMac::Pippenger::nMinCasual + 40;
+
+	typedef MultiMac_WithBufs<nCasual, 1> MyMultiMac;
+	std::unique_ptr<MyMultiMac> pMm(new MyMultiMac);
+	MyMultiMac& mm = *pMm;
+
+	Scalar::Native k0 = 1U;
+	Point::Native g = Context::get().G * k0;
+	Point::Native pt, ptRef(Zero);
+
+	for (uint32_t i = 0; i < nCasual; i++)
+	{
+		Scalar::Native k1;
+		SetRandom(k0);
+		SetRandom(k1);
+
+		pt = g * k0;
+
+		if (!i)
+			k1 = Zero;
+		if (1 == i)
+			k1 = 1U;
+		if (2 == i)
+		{
+			k1 = 1U;
+			k1 = -k1;
+		}
+
+		mm.m_Bufs.m_pCasual[mm.m_Casual++].Init(pt, k1);
+		ptRef += pt * k1; // single mult, windowed method
+	}
+
+	Scalar::Native& kPrep = mm.m_Bufs.m_pKPrep[0];
+	SetRandom(kPrep);
+	mm.m_Bufs.m_ppPrepared[0] = &Context::get().m_Ipp.G_;
+	mm.m_Prepared = 1;
+
+	ptRef += Context::get().G * kPrep;
+
+	mm.Calculate(pt);
+
+	pt = -pt;
+	pt += ptRef;
+	verify_test(pt == Zero);
+}
+
 void TestSigning()
 {
 	for (int i = 0; i < 30; i++)
@@ -727,6 +883,40 @@ void TestTransaction()
 	verify_test(!ctx.m_Fee.Hi && (ctx.m_Fee.Lo == fee1 + fee2));
 }
 
+void TestOutputCreateMulti()
+{
+	const uint32_t nCount = 11;
+
+	std::vector<beam::Output> vRef(nCount), vRes(nCount);
+	std::vector<beam::Output::CreateTask> vTasks(nCount);
+
+	for (uint32_t i = 0; i < nCount; i++)
+	{
+		beam::Output::CreateTask& t = vTasks[i];
+		SetRandom(t.m_Key);
+		t.m_Value = 1000 + i * 77;
+		t.m_Public = !(i % 5);
+
+		vRef[i].m_Incubation = vRes[i].m_Incubation = i;
+		vRef[i].Create(t.m_Key, t.m_Value, t.m_Public);
+	}
+
+	for (uint32_t nThreads = 1; nThreads <= 4; nThreads += 3)
+	{
+		for (uint32_t i = 0; i < nCount; i++)
+			vTasks[i].m_pOutput = &vRes[i];
+
+		beam::Output::CreateMulti(vTasks, nThreads);
+
+		for (uint32_t i = 0; i < nCount; i++)
+		{
+			verify_test(vRes[i] == vRef[i]); // byte-identical
+			vRes[i].m_pConfidential.reset();
+			vRes[i].m_pPublic.reset();
+		}
+	}
+}
+
 void TestTransactionKernelConsuming()
 {
 	beam::Transaction t;
@@ -811,6 +1001,18 @@ void TestAES()
 	se.enc.Proceed(pBuf, pBuf); // inplace encode
 	verify_test(!memcmp(pBuf, pCiphertext, sizeof(pBuf)));
 
+	if (AES::IsHwSupported())
+	{
+		// same with the other implementation
+		AES::s_bUseHw = !AES::s_bUseHw;
+
+		memcpy(pBuf, pPlaintext, sizeof(pBuf));
+		se.enc.Proceed(pBuf, pBuf);
+		verify_test(!memcmp(pBuf, pCiphertext, sizeof(pBuf)));
+
+		AES::s_bUseHw = !AES::s_bUseHw;
+	}
+
 	struct {
 		uint32_t zero0 = 0;
 		AES::Decoder dec;
@@ -822,6 +1024,40 @@ void TestAES()
 
 	sd.dec.Proceed(pBuf, pBuf); // inplace decode
 	verify_test(!memcmp(pBuf, pBuf, sizeof(pPlaintext)));
+
+	// CTR mode. The cipherstream must not depend on the implementation, and on how the message is split
+	std::vector<uint8_t> vMsg(0x10000 + 7), pRes[2];
+	for (size_t i = 0; i < vMsg.size(); i++)
+		vMsg[i] = (uint8_t) i;
+
+	const bool bUseHw = AES::s_bUseHw;
+
+	for (int iPass = 0; iPass < 2; iPass++)
+	{
+		AES::s_bUseHw = bUseHw && !iPass;
+
+		AES::StreamCipher asc;
+		asc.Reset();
+
+		std::vector<uint8_t>& v = pRes[iPass];
+		v = vMsg;
+
+		for (size_t nDone = 0, nChunk = 1; nDone < v.size(); nChunk = nChunk * 3 + 1)
+		{
+			uint32_t n = (uint32_t) std::min(nChunk % 1000, v.size() - nDone);
+			asc.XCrypt(se.enc, &v[nDone], n);
+			nDone += n;
+		}
+
+		// decrypt back at once
+		asc.Reset();
+		std::vector<uint8_t> v2 = v;
+		asc.XCrypt(se.enc, &v2.front(), (uint32_t) v2.size());
+		verify_test(v2 == vMsg);
+	}
+
+	AES::s_bUseHw = bUseHw;
+	verify_test(pRes[0] == pRes[1]);
 }
 
 void TestBbs()
@@ -948,20 +1184,101 @@ void TestDifficulty()
 	}
 }
 
+void TestContextFile()
+{
+	const char* szPath = "ecc_context_test.bin";
+	remove(szPath);
+
+	std::vector<uint8_t> vCtx(sizeof(Context));
+	memcpy(&vCtx.front(), &Context::get(), sizeof(Context));
+
+	verify_test(!InitializeContext(szPath)); // built, file created
+	verify_test(!memcmp(&vCtx.front(), &Context::get(), sizeof(Context)));
+
+	// Fails if the context differs from the one whose hash is compiled in (ContextFile::s_pKnown in ecc.cpp), or the layout isn't listed there
+	bool bMapped = InitializeContext(szPath);
+	verify_test(bMapped);
+	if (!bMapped)
+	{
+		remove(szPath);
+		return;
+	}
+	verify_test(!memcmp(&vCtx.front(), &Context::get(), sizeof(Context)));
+
+	InitializeContext(); // unmap before tampering
+
+	{
+		// corrupt the body
+		std::fstream fs(szPath, std::ios_base::in | std::ios_base::out | std::ios_base::binary);
+		verify_test(fs.is_open());
+
+		fs.seekg(-1, std::ios_base::end);
+		char ch = 0;
+		fs.read(&ch, 1);
+		ch ^= 1;
+		fs.seekp(-1, std::ios_base::end);
+		fs.write(&ch, 1);
+	}
+
+	verify_test(!InitializeContext(szPath)); // rejected, rebuilt
+	verify_test(InitializeContext(szPath));
+	verify_test(!memcmp(&vCtx.front(), &Context::get(), sizeof(Context)));
+
+	InitializeContext();
+
+	{
+		// bogus inner product generator, but a self-consistent file. The header ends with the checksum and the body hash (keyed by the checksum)
+		std::vector<uint8_t> vFile;
+		{
+			std::ifstream fs(szPath, std::ios_base::binary);
+			vFile.assign(std::istreambuf_iterator<char>(fs), std::istreambuf_iterator<char>());
+		}
+
+		verify_test(vFile.size() > sizeof(Context) + sizeof(Hash::Value) * 2);
+		size_t nHdr = vFile.size() - sizeof(Context);
+
+		const Context& ctx = Context::get();
+		size_t nOffs = (const uint8_t*) &ctx.m_Ipp.m_pGen_[1][InnerProduct::nDim - 1] - (const uint8_t*) &ctx;
+		vFile[nHdr + nOffs] ^= 1;
+
+		Hash::Value hvChecksum, hvBody;
+		memcpy(hvChecksum.m_pData, &vFile[nHdr - sizeof(Hash::Value) * 2], sizeof(Hash::Value));
+
+		Hash::Processor hp;
+		hp << hvChecksum;
+		hp.Write(&vFile[nHdr], sizeof(Context));
+		hp >> hvBody;
+		memcpy(&vFile[nHdr - sizeof(Hash::Value)], hvBody.m_pData, sizeof(Hash::Value));
+
+		std::ofstream fs(szPath, std::ios_base::binary | std::ios_base::trunc);
+		fs.write((const char*) &vFile.front(), vFile.size());
+	}
+
+	verify_test(!InitializeContext(szPath)); // rejected, doesn't match the compiled-in hash. Rebuilt
+	verify_test(InitializeContext(szPath));
+	verify_test(!memcmp(&vCtx.front(), &Context::get(), sizeof(Context)));
+
+	InitializeContext();
+	remove(szPath);
+}
+
 void TestAll()
 {
 	TestUintBig();
 	TestHash();
 	TestScalars();
 	TestPoints();
+	TestMultiMac();
 	TestSigning();
 	TestCommitments();
 	TestRangeProof();
 	TestTransaction();
+	TestOutputCreateMulti();
 	TestTransactionKernelConsuming();
 	TestAES();
 	TestBbs();
 	TestDifficulty();
+	TestContextFile();
 }
 
 
@@ -1247,6 +1564,34 @@ void RunBenchmark()
 		} while (bm.ShouldContinue());
 	}
 
+	for (int iPass = 0; iPass < 2; iPass++)
+	{
+		// hw-accelerated (if supported) vs portable
+		const bool bUseShaNi = Sha256::s_bUseShaNi;
+		const bool bUseAvx2 = Sha256::s_bUseAvx2;
+		if (iPass)
+		{
+			if (!bUseShaNi && !bUseAvx2)
+				break;
+			Sha256::s_bUseShaNi = Sha256::s_bUseAvx2 = false;
+		}
+
+		const uint32_t nCount = 0x400;
+		std::vector<uint8_t> vBuf(nCount * 64);
+		std::vector<Hash::Value> vRes(nCount);
+
+		BenchmarkMeter bm(iPass ? "Hash.Multi.64B-x1K (portable)" : "Hash.Multi.64B-x1K");
+		do
+		{
+			for (uint32_t i = 0; i < bm.N; i++)
+				Hash::Processor::Multi(&vRes.front(), &vBuf.front(), 64, nCount);
+
+		} while (bm.ShouldContinue());
+
+		Sha256::s_bUseShaNi = bUseShaNi;
+		Sha256::s_bUseAvx2 = bUseAvx2;
+	}
+
 	Hash::Processor() << "abcd" >> hv;
 
 	Signature sig;
@@ -1368,6 +1713,39 @@ void RunBenchmark()
 	}
 
 	{
+		TransactionMaker tm;
+		tm.AddInput(0, 3000);
+		tm.AddOutput(0, 1000);
+		tm.AddOutput(0, 1900);
+
+		std::vector<beam::TxKernel::Ptr> lstDummy;
+		tm.CreateTxKernel(tm.m_Trans.m_vKernelsOutput, 100, lstDummy);
+		tm.m_Trans.Sort();
+
+		BenchmarkMeter bm("Transaction.Validate");
+		bm.N = 10;
+		do
+		{
+			for (uint32_t i = 0; i < bm.N; i++)
+			{
+				beam::TxBase::Context ctx;
+				verify_test(tm.m_Trans.IsValid(ctx));
+			}
+
+		} while (bm.ShouldContinue());
+	}
+
+	for (int iPass = 0; iPass < 2; iPass++)
+	{
+		// AES-NI (if supported) vs table-driven
+		const bool bUseHw = AES::s_bUseHw;
+		if (iPass)
+		{
+			if (!bUseHw)
+				break;
+			AES::s_bUseHw = false;
+		}
+
 		AES::Encoder enc;
 		enc.Init(hv.m_pData);
 		AES::StreamCipher asc;
@@ -1375,7 +1753,7 @@ void RunBenchmark()
 
 		uint8_t pBuf[0x400];
 
-		BenchmarkMeter bm("AES.XCrypt-1MB");
+		BenchmarkMeter bm(AES::s_bUseHw ? "AES.XCrypt-1MB (AES-NI)" : "AES.XCrypt-1MB");
 		bm.N = 10;
 		do
 		{
@@ -1386,6 +1764,8 @@ void RunBenchmark()
 			}
 
 		} while (bm.ShouldContinue());
+
+		AES::s_bUseHw = bUseHw;
 	}
 
 
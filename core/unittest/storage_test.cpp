@@ -312,6 +312,60 @@ namespace beam
 
 		verify_test(vKeys.size() == t.Count());
 
+		// parallel rehash, should give the same result
+		for (uint32_t nThreads = 2; nThreads <= 5; nThreads += 3)
+		{
+			UtxoTree t1, t2;
+			t2.m_nRehashThreads = nThreads;
+
+			for (uint32_t i = 0; i < vKeys.size(); i++)
+			{
+				UtxoTree::Cursor cu;
+				bool bCreate = true;
+				t1.Find(cu, vKeys[i], bCreate)->m_Value.m_Count = i;
+				t2.Find(cu, vKeys[i], bCreate)->m_Value.m_Count = i;
+			}
+
+			t2.get_Hash(hv2);
+			verify_test(hv2 == hv1);
+
+			// modify a part, and compare with the single-threaded
+			for (uint32_t i = 0; i < vKeys.size(); i += 7)
+			{
+				UtxoTree::Cursor cu;
+				bool bCreate = false;
+				t1.Find(cu, vKeys[i], bCreate)->m_Value.m_Count++;
+				cu.Invalidate();
+
+				t2.Find(cu, vKeys[i], bCreate)->m_Value.m_Count++;
+				cu.Invalidate();
+			}
+
+			Merkle::Hash hv3;
+			t1.get_Hash(hv3);
+			t2.get_Hash(hv2);
+			verify_test(hv2 == hv3);
+
+			// small dirty part (rehashed serially), then a large one again with the same workers
+			for (uint32_t nStep : { 5000U, 3U })
+			{
+				for (uint32_t i = 0; i < vKeys.size(); i += nStep)
+				{
+					UtxoTree::Cursor cu;
+					bool bCreate = false;
+					t1.Find(cu, vKeys[i], bCreate)->m_Value.m_Count++;
+					cu.Invalidate();
+
+					t2.Find(cu, vKeys[i], bCreate)->m_Value.m_Count++;
+					cu.Invalidate();
+				}
+
+				t1.get_Hash(hv3);
+				t2.get_Hash(hv2);
+				verify_test(hv2 == hv3);
+			}
+		}
+
 		// serialization
 		Serializer ser;
 		t.save(ser);
@@ -326,6 +380,63 @@ namespace beam
 		t.get_Hash(hv2);
 		verify_test(hv2 == hv1);
 
+		// snapshot
+		struct Stream
+			:public RadixHashTree::IStream
+		{
+			ByteBuffer m_Buf;
+			size_t m_nPos = 0;
+
+			virtual void Write(const void* p, uint32_t n) override
+			{
+				m_Buf.insert(m_Buf.end(), (const uint8_t*) p, (const uint8_t*) p + n);
+			}
+
+			virtual void Read(void* p, uint32_t n) override
+			{
+				verify_test(m_nPos + n <= m_Buf.size());
+				memcpy(p, &m_Buf.at(m_nPos), n);
+				m_nPos += n;
+			}
+		} s;
+
+		t.SaveSnapshot(s);
+
+		{
+			UtxoTree t2;
+			t2.LoadSnapshot(s);
+			verify_test(s.m_nPos == s.m_Buf.size());
+
+			t2.get_Hash(hv2);
+			verify_test(hv2 == hv1);
+			verify_test(vKeys.size() == t2.Count());
+
+			// the restored tree should be fully functional
+			for (uint32_t i = 0; i < vKeys.size(); i += 3)
+			{
+				UtxoTree::Cursor cu;
+				bool bCreate = false;
+				UtxoTree::MyLeaf* p = t2.Find(cu, vKeys[i], bCreate);
+
+				verify_test(p && (p->m_Value.m_Count == i));
+				t2.Delete(cu);
+			}
+
+			t2.get_Hash(hv2);
+
+			// compare with the tree constructed from scratch
+			Serializer ser2;
+			t2.save(ser2);
+			sb = ser2.buffer();
+			der.reset(sb.first, sb.second);
+
+			UtxoTree t3;
+			t3.load(der);
+
+			t3.get_Hash(hvMid);
+			verify_test(hvMid == hv2);
+		}
+
 		// narrow traverse
 		struct Traveler
 			:public RadixTree::ITraveler
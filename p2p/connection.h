@@ -46,6 +46,12 @@ public:
     /// Disables all messages
     void disable_all_msg_types() { _msgReader.disable_all_msg_types(); }
 
+    /// Temporarily stops reading from the stream (backpressure). Messages already received are still dispatched
+    void pause_read() { _stream->pause_read(); }
+
+    /// Resumes reading after pause_read()
+    io::Result resume_read() { return _stream->resume_read(); }
+
     /// Writes fragments to stream
     io::Result write_msg(const SerializedMsg& fragments);
 
@@ -55,18 +55,7 @@ Result TcpStream::enable_read(const TcpStream::Callback& callback) {
 
     alloc_read_buffer();
 
-    static uv_alloc_cb read_alloc_cb = [](
-        uv_handle_t* handle,
-        size_t /*suggested_size*/,
-        uv_buf_t* buf
-    ) {
-        TcpStream* self = reinterpret_cast<TcpStream*>(handle->data);
-        if (self) {
-            *buf = self->_readBuffer;
-        }
-    };
-
-    ErrorCode errorCode = (ErrorCode)uv_read_start((uv_stream_t*)_handle, read_alloc_cb, on_read);
+    ErrorCode errorCode = (ErrorCode)uv_read_start((uv_stream_t*)_handle, on_alloc, on_read);
     if (errorCode != 0) {
         _callback = Callback();
         free_read_buffer();
@@ -88,6 +77,28 @@ void TcpStream::disable_read() {
     free_read_buffer();
 }
 
+void TcpStream::pause_read() {
+    if (is_connected()) {
+        int errorCode = uv_read_stop((uv_stream_t*)_handle);
+        if (errorCode) {
+            LOG_DEBUG() << "uv_read_stop failed,code=" << errorCode;
+        }
+    }
+}
+
+Result TcpStream::resume_read() {
+    if (!_callback || !is_connected()) {
+        return make_unexpected(EC_ENOTCONN);
+    }
+
+    ErrorCode errorCode = (ErrorCode)uv_read_start((uv_stream_t*)_handle, on_alloc, on_read);
+    if (errorCode != 0) {
+        return make_unexpected(errorCode);
+    }
+
+    return Ok();
+}
+
 Result TcpStream::write(const SharedBuffer& buf) {
     if (!buf.empty()) {
         if (!is_connected()) return make_unexpected(EC_ENOTCONN);
@@ -197,6 +208,13 @@ Address TcpStream::peer_address() const {
     return Address(sa);
 }
 
+void TcpStream::on_alloc(uv_handle_t* handle, size_t /*suggested_size*/, uv_buf_t* buf) {
+    TcpStream* self = reinterpret_cast<TcpStream*>(handle->data);
+    if (self) {
+        *buf = self->_readBuffer;
+    }
+}
+
 void TcpStream::on_read(uv_stream_t* handle, ssize_t nread, const uv_buf_t* buf) {
     LOG_VERBOSE() << TRACE(handle) << TRACE(nread) << TRACE(handle->data);
 
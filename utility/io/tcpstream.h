@@ -46,6 +46,12 @@ public:
     /// Disables listening to data and events
     void disable_read();
 
+    /// Temporarily stops reading, keeps the callback and the read buffer. Safe to call from within the callback
+    void pause_read();
+
+    /// Resumes reading after pause_read()
+    Result resume_read();
+
     /// Writes raw data, returns status code
     Result write(const void* data, size_t size) {
         return write(SharedBuffer(data, size));
@@ -78,6 +84,7 @@ public:
     Address peer_address() const;
 
 private:
+    static void on_alloc(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf);
     static void on_read(uv_stream_t* handle, ssize_t nread, const uv_buf_t* buf);
 
     friend class TcpServer;
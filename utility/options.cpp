@@ -38,6 +38,10 @@ namespace beam
         const char* IMPORT = "import";
         const char* MINING_THREADS = "mining_threads";
         const char* VERIFICATION_THREADS = "verification_threads";
+        const char* SNAPSHOT_PERIOD = "snapshot_period";
+        const char* DB_PROFILE = "db_profile";
+        const char* GROUP_COMMIT_BLOCKS = "group_commit_blocks";
+        const char* GROUP_COMMIT_MS = "group_commit_ms";
         const char* MINER_ID = "miner_id";
         const char* NODE_PEER = "peer";
         const char* PASS = "pass";
@@ -107,6 +111,10 @@ namespace beam
             (cli::TREASURY_BLOCK, po::value<string>()->default_value("treasury.mw"), "Block pack to import treasury from")
             (cli::MINING_THREADS, po::value<uint32_t>()->default_value(0), "number of mining threads(there is no mining if 0)")
             (cli::VERIFICATION_THREADS, po::value<int>()->default_value(-1), "number of threads for cryptographic verifications (0 = single thread, -1 = auto)")
+            (cli::SNAPSHOT_PERIOD, po::value<Height>()->default_value(1440), "save the UTXO/kernel snapshot once in this number of blocks and on exit, for faster startup (0 = disabled)")
+            (cli::DB_PROFILE, po::value<string>()->default_value("safe"), "node storage durability profile: 'safe' (survives power loss), 'sync' (faster, survives crash but not power loss, for the initial sync), 'default' (SQLite defaults)")
+            (cli::GROUP_COMMIT_BLOCKS, po::value<uint32_t>()->default_value(100), "while catching up, commit this number of blocks per DB transaction (0 or 1 = each block)")
+            (cli::GROUP_COMMIT_MS, po::value<uint32_t>()->default_value(1000), "while catching up, commit at least once in this time, ms")
             (cli::MINER_ID, po::value<uint32_t>()->default_value(0), "seed for miner nonce generation")
             (cli::NODE_PEER, po::value<vector<string>>()->multitoken(), "nodes to connect to")
             (cli::IMPORT, po::value<Height>()->default_value(0), "Specify the blockchain height to import. The compressed history is asumed to be downloaded the the specified directory")
@@ -36,6 +36,10 @@ namespace beam
         extern const char* IMPORT;
         extern const char* MINING_THREADS;
         extern const char* VERIFICATION_THREADS;
+        extern const char* SNAPSHOT_PERIOD;
+        extern const char* DB_PROFILE;
+        extern const char* GROUP_COMMIT_BLOCKS;
+        extern const char* GROUP_COMMIT_MS;
         extern const char* MINER_ID;
         extern const char* NODE_PEER;
         extern const char* PASS;
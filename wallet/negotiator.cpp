@@ -564,20 +564,30 @@ namespace beam::wallet
     vector<Output::Ptr> Negotiator::FSMDefinition::getTxOutputs(const TxID& txID) const
     {
         vector<Output::Ptr> outputs;
-        m_parent.m_keychain->visit([this, &txID, &outputs](const Coin& c)->bool
+        vector<Output::CreateTask> tasks;
+        m_parent.m_keychain->visit([this, &txID, &outputs, &tasks](const Coin& c)->bool
         {
             if (c.m_createTxId == txID && c.m_status == Coin::Draft)
             {
                 Output::Ptr output = make_unique<Output>();
                 output->m_Coinbase = false;
 
-                Scalar::Native blindingFactor = m_parent.m_keychain->calcKey(c);
-                output->Create(blindingFactor, c.m_amount);
+                tasks.emplace_back();
+                Output::CreateTask& task = tasks.back();
+                task.m_pOutput = output.get();
+                task.m_Key = m_parent.m_keychain->calcKey(c);
+                task.m_Value = c.m_amount;
 
                 outputs.push_back(move(output));
             }
             return true;
         });
+
+        // range proofs are the costly part, create them in parallel
+        Output::CreateMulti(tasks);
+        for (auto& task : tasks)
+            task.m_Key = Zero;
+
         return outputs;
     }
 }